@@ -0,0 +1,106 @@
+/**
+ * BinaryProtocol.cpp - Implementation of the binary payload reader
+ */
+
+#include "BinaryProtocol.h"
+
+// Constructor
+BinaryReader::BinaryReader(const uint8_t* data, size_t length) :
+    _data(data),
+    _length(data != NULL ? length : 0),
+    _position(0),
+    _error(false) {
+}
+
+// Read a single byte
+bool BinaryReader::readByte(uint8_t& value) {
+    if (_position >= _length) {
+        _error = true;
+        return false;
+    }
+    value = _data[_position++];
+    return true;
+}
+
+// Read an unsigned LEB128 varint
+bool BinaryReader::readVarint(uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte;
+        if (!readByte(byte)) {
+            return false;
+        }
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    
+    // More than 5 bytes cannot be a 32-bit value
+    _error = true;
+    return false;
+}
+
+// Take a run of bytes without copying
+const uint8_t* BinaryReader::readBytes(size_t count) {
+    if (count > _length - _position) {
+        _error = true;
+        return NULL;
+    }
+    const uint8_t* bytes = _data + _position;
+    _position += count;
+    return bytes;
+}
+
+// Get a value from a packed bit array
+uint8_t binaryUnpackBits(const uint8_t* data, uint32_t index, uint8_t bits) {
+    uint32_t bit = index * bits;
+    uint16_t word = data[bit >> 3];
+    
+    // A value may straddle two bytes
+    if ((bit & 7) + bits > 8) {
+        word |= (uint16_t)data[(bit >> 3) + 1] << 8;
+    }
+    return (word >> (bit & 7)) & ((1 << bits) - 1);
+}
+
+// Decode a frame delta command
+bool binaryDecodeDelta(BinaryReader& reader, uint8_t* channels, size_t channelCount) {
+    size_t cursor = 0;
+    
+    while (true) {
+        uint32_t token;
+        if (!reader.readVarint(token)) {
+            return false;
+        }
+        
+        uint8_t run = token & 0x03;
+        uint32_t length = (token >> 2) + 1;
+        if (run == BIN_DELTA_END) {
+            return true;
+        }
+        if (length > channelCount - cursor) {
+            return false;
+        }
+        
+        if (run == BIN_DELTA_WRITE) {
+            const uint8_t* values = reader.readBytes(length);
+            if (values == NULL) {
+                return false;
+            }
+            if (channels != NULL) {
+                memcpy(channels + cursor, values, length);
+            }
+        } else if (run == BIN_DELTA_REPEAT) {
+            uint8_t value;
+            if (!reader.readByte(value)) {
+                return false;
+            }
+            if (channels != NULL) {
+                memset(channels + cursor, value, length);
+            }
+        }
+        
+        cursor += length;
+    }
+}
@@ -0,0 +1,141 @@
+/**
+ * BinaryProtocol.h - Compact binary downlink command format
+ * 
+ * Binary downlinks are sent on their own fPort and carry a version byte
+ * followed by any number of commands. Each command is an opcode and a few
+ * compact fields; addresses and counts are unsigned LEB128 varints, so
+ * small values take a single byte.
+ * 
+ *   [version] [opcode fields...] [opcode fields...] ...
+ * 
+ * With BINARY_FLAG_SEQUENCE set in the version byte, a varint sequence
+ * number (0-65535) follows it, used to drop retransmitted payloads.
+ * 
+ * The reader works directly on the received buffer and never allocates.
+ */
+
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BINARY_PROTOCOL_PORT 2     // fPort that carries binary commands
+#define BINARY_PROTOCOL_VERSION 1  // Version byte at the start of every payload
+#define BINARY_FLAG_SEQUENCE 0x80  // Version byte flag: a varint sequence number follows
+
+// Command opcodes
+enum BinaryOpcode {
+  BIN_OP_CHANNELS = 0x01,       // varint address, varint count, count values
+  BIN_OP_FIXTURES_RGBW = 0x02,  // varint first fixture, varint count, count x R G B W
+  BIN_OP_FIXTURES_RGB = 0x03,   // varint first fixture, varint count, count x R G B
+  BIN_OP_FILL = 0x04,           // varint first fixture, varint count, R G B W
+  BIN_OP_PATTERN = 0x05,        // pattern type (0 = stop), varint speed ms, varint cycles
+  BIN_OP_DELTA = 0x06,          // frame delta runs from channel 1, see below
+  BIN_OP_PALETTE_SET = 0x07,    // varint first entry, varint count, count x R G B W (persisted)
+  BIN_OP_PALETTE_FIXTURES = 0x08, // varint first fixture, varint count, count x palette index
+  BIN_OP_PALETTE_GROUP = 0x09,  // group ID (0xFF = all), palette index
+  BIN_OP_PALETTE_PACKED = 0x0A, // bits per index (4 or 6), varint first fixture, varint count, packed indices
+  BIN_OP_QUANTIZED = 0x0B       // format (bit 7 = dither), varint first fixture, varint count, packed colors
+};
+
+// Frame delta runs. Each run starts with a varint token: the low two bits
+// select the run type and the remaining bits hold the run length minus one.
+enum BinaryDeltaRun {
+  BIN_DELTA_SKIP = 0,    // Leave n channels unchanged
+  BIN_DELTA_WRITE = 1,   // n channel values follow
+  BIN_DELTA_REPEAT = 2,  // One value follows, written to n channels
+  BIN_DELTA_END = 3      // End of the delta command
+};
+
+class BinaryReader {
+public:
+    /**
+     * Constructor
+     * 
+     * @param data Payload to read
+     * @param length Payload length in bytes
+     */
+    BinaryReader(const uint8_t* data, size_t length);
+
+    /**
+     * Read a single byte
+     * 
+     * @return true if a byte was available
+     */
+    bool readByte(uint8_t& value);
+
+    /**
+     * Read an unsigned LEB128 varint of up to 32 bits
+     * 
+     * @return true if a complete varint was read
+     */
+    bool readVarint(uint32_t& value);
+
+    /**
+     * Take a run of bytes without copying
+     * 
+     * @param count Number of bytes
+     * @return Pointer into the payload, or NULL if fewer bytes remain
+     */
+    const uint8_t* readBytes(size_t count);
+
+    /**
+     * Get the number of unread bytes
+     */
+    size_t remaining() const { return _length - _position; }
+
+    /**
+     * Check whether the whole payload has been read
+     */
+    bool atEnd() const { return _position >= _length; }
+
+    /**
+     * Check whether a read ran past the end or hit a malformed field
+     */
+    bool hasError() const { return _error; }
+
+    /**
+     * Get the current read position
+     */
+    size_t position() const { return _position; }
+
+private:
+    const uint8_t* _data;
+    size_t _length;
+    size_t _position;
+    bool _error;
+};
+
+/**
+ * Get a value from a packed bit array
+ * Values are packed LSB first, so with 4 bits the first value is the low
+ * nibble of the first byte
+ * 
+ * @param data Packed array
+ * @param index Value index
+ * @param bits Bits per value (1-8)
+ */
+uint8_t binaryUnpackBits(const uint8_t* data, uint32_t index, uint8_t bits);
+
+/**
+ * Get the number of bytes needed for a packed bit array
+ */
+inline size_t binaryPackedSize(uint32_t count, uint8_t bits) {
+    return ((size_t)count * bits + 7) / 8;
+}
+
+/**
+ * Decode a frame delta command
+ * Call once with channels = NULL to validate the runs, then again on a
+ * copy of the reader to apply them, so a malformed delta changes nothing
+ * 
+ * @param reader Reader positioned after the opcode; advanced past the END run
+ * @param channels Channel buffer to update (channel 1 first), or NULL to validate only
+ * @param channelCount Number of channels in the buffer
+ * @return true if the runs are well formed and stay inside the buffer
+ */
+bool binaryDecodeDelta(BinaryReader& reader, uint8_t* channels, size_t channelCount);
+
+#endif // BINARY_PROTOCOL_H
@@ -0,0 +1,77 @@
+/**
+ * ColorPalette.cpp - Implementation of the on-device color table
+ */
+
+#include "ColorPalette.h"
+
+// First entries of the default palette; the rest start black
+static const RgbwColor DEFAULT_PALETTE[] = {
+    {0, 0, 0, 0},         // 0 off
+    {0, 0, 0, 255},       // 1 white
+    {255, 0, 0, 0},       // 2 red
+    {0, 255, 0, 0},       // 3 green
+    {0, 0, 255, 0},       // 4 blue
+    {255, 255, 0, 0},     // 5 yellow
+    {0, 255, 255, 0},     // 6 cyan
+    {255, 0, 255, 0},     // 7 magenta
+    {255, 128, 0, 0},     // 8 orange
+    {255, 160, 0, 60},    // 9 amber
+    {128, 0, 255, 0},     // 10 purple
+    {255, 60, 120, 0},    // 11 pink
+    {255, 140, 40, 255},  // 12 warm white
+    {160, 200, 255, 255}, // 13 cool white
+    {0, 128, 64, 0},      // 14 teal
+    {64, 0, 0, 0}         // 15 dim red
+};
+
+// Constructor
+ColorPalette::ColorPalette() {
+    reset();
+}
+
+// Set a palette entry
+bool ColorPalette::set(uint8_t index, const RgbwColor& color) {
+    if (index >= PALETTE_SIZE) {
+        return false;
+    }
+    _colors[index] = color;
+    return true;
+}
+
+// Get a palette entry
+RgbwColor ColorPalette::get(uint8_t index) const {
+    if (index >= PALETTE_SIZE) {
+        return RgbwColor{0, 0, 0, 0};
+    }
+    return _colors[index];
+}
+
+// Restore the default palette
+void ColorPalette::reset() {
+    memset(_colors, 0, sizeof(_colors));
+    memcpy(_colors, DEFAULT_PALETTE, sizeof(DEFAULT_PALETTE));
+}
+
+// Load the palette stored under its own key by older firmware
+bool ColorPalette::loadLegacy() {
+    if (!_preferences.begin("palette", true)) {
+        return false;
+    }
+    
+    RgbwColor stored[PALETTE_SIZE];
+    bool loaded = _preferences.getBytes("colors", stored, sizeof(stored)) == sizeof(stored);
+    if (loaded) {
+        memcpy(_colors, stored, sizeof(_colors));
+    }
+    
+    _preferences.end();
+    return loaded;
+}
+
+// Remove the old key once the palette is stored in the new layout
+void ColorPalette::clearLegacy() {
+    if (_preferences.begin("palette", false)) {
+        _preferences.clear();
+        _preferences.end();
+    }
+}
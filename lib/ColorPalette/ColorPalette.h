@@ -0,0 +1,62 @@
+/**
+ * ColorPalette.h - On-device color table for palette-indexed commands
+ * 
+ * Holds a table of RGBW colors that downlinks refer to by index, so a
+ * fixture color costs 4 or 6 bits instead of 3-4 bytes. The table can be
+ * uploaded over the air and is kept in the persisted state.
+ */
+
+#ifndef COLOR_PALETTE_H
+#define COLOR_PALETTE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "DmxController.h"
+
+#define PALETTE_SIZE 64  // Number of palette entries
+
+class ColorPalette {
+public:
+    /**
+     * Constructor - starts with the default palette
+     */
+    ColorPalette();
+
+    /**
+     * Set a palette entry
+     * 
+     * @param index Entry index (0 to PALETTE_SIZE - 1)
+     * @param color RGBW color
+     * @return true if the index was valid
+     */
+    bool set(uint8_t index, const RgbwColor& color);
+
+    /**
+     * Get a palette entry; out-of-range indices return black
+     */
+    RgbwColor get(uint8_t index) const;
+
+    /**
+     * Restore the default palette
+     */
+    void reset();
+
+    /**
+     * Load the palette stored under its own key by older firmware
+     * (the palette is now part of the state blob, see StateStore.h)
+     * 
+     * @return true if a saved palette was found
+     */
+    bool loadLegacy();
+
+    /**
+     * Remove the key read by loadLegacy
+     */
+    void clearLegacy();
+
+private:
+    RgbwColor _colors[PALETTE_SIZE];
+    Preferences _preferences;
+};
+
+#endif // COLOR_PALETTE_H
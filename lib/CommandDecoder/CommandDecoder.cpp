@@ -0,0 +1,259 @@
+/**
+ * CommandDecoder.cpp - Downlink decoding, separated from what the commands do
+ */
+
+#include "CommandDecoder.h"
+
+// Colors of the single-byte commands 0-4
+static const uint8_t singleByteColors[5][4] = {
+    {0, 0, 0, 0},      // Off
+    {255, 0, 0, 0},    // Red
+    {0, 255, 0, 0},    // Green
+    {0, 0, 255, 0},    // Blue
+    {0, 0, 0, 255}     // White
+};
+
+CommandDecoder::CommandDecoder(CommandSink& sink, uint32_t maxFixtures, uint32_t paletteSize)
+    : _sink(sink), _maxFixtures(maxFixtures), _paletteSize(paletteSize) {
+}
+
+bool CommandDecoder::decodeText(uint8_t* payload, size_t size) {
+    if (payload == NULL || size == 0) {
+        return false;
+    }
+    if (size == 1) {
+        return decodeSingleByte(payload[0]);
+    }
+    return _sink.applyJson((char*)payload, size);
+}
+
+bool CommandDecoder::decodeSingleByte(uint8_t cmd) {
+    if (cmd == 0xAA || cmd == 0xFF) {
+        _sink.setAllFixtures(0, 255, 0, 0, true);
+        return true;
+    }
+
+    int index = -1;
+    if (cmd <= 4) {
+        index = cmd;
+    } else if (cmd >= '0' && cmd <= '4') {
+        index = cmd - '0';
+    }
+    if (index < 0) {
+        return false;
+    }
+
+    const uint8_t* c = singleByteColors[index];
+    _sink.setAllFixtures(c[0], c[1], c[2], c[3], false);
+    return true;
+}
+
+bool CommandDecoder::decodeBinary(const uint8_t* payload, size_t size, BinaryDecodeInfo& info) {
+    info.sequenced = false;
+    info.seq = 0;
+    info.duplicate = false;
+    info.commands = 0;
+    info.error = NULL;
+    info.errorOffset = 0;
+
+    BinaryReader reader(payload, size);
+    uint8_t version = 0;
+    if (!reader.readByte(version) || (version & ~BINARY_FLAG_SEQUENCE) != BINARY_PROTOCOL_VERSION) {
+        info.error = "Unsupported binary protocol version";
+        return false;
+    }
+
+    if (version & BINARY_FLAG_SEQUENCE) {
+        uint32_t seq;
+        if (!reader.readVarint(seq)) {
+            info.error = "Truncated sequence number";
+            info.errorOffset = reader.position();
+            return false;
+        }
+        info.sequenced = true;
+        info.seq = seq & 0xFFFF;
+    }
+
+    // Check every command first; a malformed payload changes nothing and
+    // does not use up its sequence number
+    BinaryReader commands = reader;
+    while (!reader.atEnd()) {
+        uint8_t opcode;
+        reader.readByte(opcode);
+        const char* error = "Malformed binary command";
+        if (!decodeCommand(opcode, reader, error, false)) {
+            info.error = error;
+            info.errorOffset = reader.position();
+            return false;
+        }
+    }
+
+    // A retransmitted payload is acknowledged without being applied again
+    if (info.sequenced && _sink.isRepeat(info.seq)) {
+        info.duplicate = true;
+        return true;
+    }
+
+    const char* error;
+    while (!commands.atEnd()) {
+        uint8_t opcode;
+        commands.readByte(opcode);
+        decodeCommand(opcode, commands, error, true);
+        info.commands++;
+    }
+    if (info.sequenced) {
+        _sink.recordSequence(info.seq);
+    }
+    return true;
+}
+
+// Read one command's fields and check them; pass the command on if apply is set
+bool CommandDecoder::decodeCommand(uint8_t opcode, BinaryReader& reader, const char*& error, bool apply) {
+    uint32_t first, count;
+
+    switch (opcode) {
+        case BIN_OP_CHANNELS: {
+            if (!reader.readVarint(first) || !reader.readVarint(count)) {
+                return false;
+            }
+            if (first < 1 || first > DECODER_MAX_CHANNEL || count == 0 || count > DECODER_MAX_CHANNEL + 1 - first) {
+                error = "Binary channel run out of range";
+                return false;
+            }
+            const uint8_t* values = reader.readBytes(count);
+            if (values == NULL) {
+                return false;
+            }
+            if (apply) {
+                _sink.setChannels(first, values, count);
+            }
+            return true;
+        }
+
+        case BIN_OP_FIXTURES_RGBW:
+        case BIN_OP_FIXTURES_RGB: {
+            if (!reader.readVarint(first) || !reader.readVarint(count) || count > _maxFixtures) {
+                return false;
+            }
+            uint8_t stride = (opcode == BIN_OP_FIXTURES_RGBW) ? 4 : 3;
+            const uint8_t* colors = reader.readBytes(count * stride);
+            if (colors == NULL) {
+                return false;
+            }
+            if (apply) {
+                _sink.setFixtures(first, count, colors, stride);
+            }
+            return true;
+        }
+
+        case BIN_OP_FILL: {
+            if (!reader.readVarint(first) || !reader.readVarint(count)) {
+                return false;
+            }
+            const uint8_t* c = reader.readBytes(4);
+            if (c == NULL) {
+                return false;
+            }
+            if (apply) {
+                _sink.fillFixtures(first, count, c);
+            }
+            return true;
+        }
+
+        case BIN_OP_PATTERN: {
+            uint8_t type;
+            uint32_t speed, cycles;
+            if (!reader.readByte(type) || !reader.readVarint(speed) || !reader.readVarint(cycles)) {
+                return false;
+            }
+            if (!_sink.isPatternType(type)) {
+                error = "Unknown binary pattern type";
+                return false;
+            }
+            if (apply) {
+                _sink.setPattern(type, speed, cycles);
+            }
+            return true;
+        }
+
+        case BIN_OP_DELTA: {
+            // Validate first so a malformed delta leaves the frame untouched
+            BinaryReader runs = reader;
+            if (!binaryDecodeDelta(reader, NULL, DECODER_MAX_CHANNEL)) {
+                error = "Malformed frame delta";
+                return false;
+            }
+            if (apply) {
+                _sink.applyFrameDelta(runs);
+            }
+            return true;
+        }
+
+        case BIN_OP_PALETTE_SET: {
+            if (!reader.readVarint(first) || !reader.readVarint(count) ||
+                first > _paletteSize || count > _paletteSize - first) {
+                return false;
+            }
+            const uint8_t* colors = reader.readBytes(count * 4);
+            if (colors == NULL) {
+                return false;
+            }
+            if (apply) {
+                _sink.setPaletteEntries(first, count, colors);
+            }
+            return true;
+        }
+
+        case BIN_OP_PALETTE_FIXTURES:
+        case BIN_OP_PALETTE_PACKED: {
+            uint8_t bits = 8;
+            if (opcode == BIN_OP_PALETTE_PACKED && (!reader.readByte(bits) || (bits != 4 && bits != 6))) {
+                return false;
+            }
+            if (!reader.readVarint(first) || !reader.readVarint(count) || count > _maxFixtures) {
+                return false;
+            }
+            const uint8_t* indices = reader.readBytes(binaryPackedSize(count, bits));
+            if (indices == NULL) {
+                return false;
+            }
+            if (apply) {
+                _sink.setFixturePalette(first, count, indices, bits);
+            }
+            return true;
+        }
+
+        case BIN_OP_PALETTE_GROUP: {
+            uint8_t group, index;
+            if (!reader.readByte(group) || !reader.readByte(index)) {
+                return false;
+            }
+            if (apply) {
+                _sink.setGroupPalette(group, index);
+            }
+            return true;
+        }
+
+        case BIN_OP_QUANTIZED: {
+            uint8_t format;
+            if (!reader.readByte(format) || !reader.readVarint(first) || !reader.readVarint(count) || count > _maxFixtures) {
+                return false;
+            }
+            bool dither = format & 0x80;
+            format &= 0x7F;
+            size_t packedSize = _sink.quantizedSize(format, count);
+            const uint8_t* packed = reader.readBytes(packedSize);
+            if (packedSize == 0 || packed == NULL) {
+                return false;
+            }
+            if (apply) {
+                _sink.setQuantized(format, dither, first, count, packed);
+            }
+            return true;
+        }
+
+        default:
+            error = "Unknown binary opcode";
+            return false;
+    }
+}
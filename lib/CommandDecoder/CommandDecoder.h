@@ -0,0 +1,150 @@
+/**
+ * CommandDecoder.h - Downlink decoding, separated from what the commands do
+ *
+ * The decoder checks the framing and every field of a downlink and hands
+ * each well-formed command to a CommandSink. The firmware's sink drives
+ * the DMX controller; any other sink (a recorder, a counter) can replace
+ * it, so the decoding has no dependency on the hardware, Arduino or
+ * FreeRTOS and can be built and exercised on a host.
+ *
+ * Decoding never allocates and never reads outside the payload. A binary
+ * payload is checked in full before anything is applied: a malformed
+ * command rejects the whole payload, and its sequence number is not
+ * recorded, so a corrected retry is still accepted.
+ */
+
+#ifndef COMMAND_DECODER_H
+#define COMMAND_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "BinaryProtocol.h"
+
+#define DECODER_MAX_CHANNEL 512  // Highest DMX address in a channel run
+
+/**
+ * Receiver of decoded commands
+ * Fields have been range checked against the limits given to the decoder
+ */
+class CommandSink {
+public:
+    virtual ~CommandSink() {}
+
+    /**
+     * Check a sequence number
+     * Called once a sequenced payload has been validated, before it is applied
+     *
+     * @return true if the payload was already applied and must be skipped
+     */
+    virtual bool isRepeat(uint16_t seq) = 0;
+
+    // Record the sequence number of a payload once it has been applied
+    virtual void recordSequence(uint16_t seq) = 0;
+
+    // Single-byte command: every fixture set to one color
+    virtual void setAllFixtures(uint8_t r, uint8_t g, uint8_t b, uint8_t w, bool testTrigger) = 0;
+
+    // Text payload of more than one byte, passed on unparsed (may be edited in place)
+    virtual bool applyJson(char* json, size_t length) = 0;
+
+    // Raw channel values starting at a DMX address (1-512)
+    virtual void setChannels(uint16_t first, const uint8_t* values, size_t count) = 0;
+
+    // Consecutive fixtures, stride 4 (RGBW) or 3 (RGB, white off) bytes per fixture
+    virtual void setFixtures(uint32_t first, uint32_t count, const uint8_t* colors, uint8_t stride) = 0;
+
+    // Up to count fixtures from first set to one RGBW color
+    virtual void fillFixtures(uint32_t first, uint32_t count, const uint8_t* rgbw) = 0;
+
+    // Check a pattern type before the payload is applied (0 stops the pattern)
+    virtual bool isPatternType(uint8_t type) = 0;
+
+    // Start a pattern, or stop it with type 0
+    virtual void setPattern(uint8_t type, uint32_t speed, uint32_t cycles) = 0;
+
+    /**
+     * Apply a frame delta with binaryDecodeDelta()
+     *
+     * @param runs Reader positioned at the runs, which are known to be well formed
+     */
+    virtual void applyFrameDelta(BinaryReader runs) = 0;
+
+    // Palette entries first..first+count-1, count x RGBW
+    virtual void setPaletteEntries(uint32_t first, uint32_t count, const uint8_t* colors) = 0;
+
+    // Consecutive fixtures with one palette index each, bits per index (4, 6 or 8)
+    virtual void setFixturePalette(uint32_t first, uint32_t count, const uint8_t* indices, uint8_t bits) = 0;
+
+    // Every fixture of a group (0xFF = all) set to one palette entry
+    virtual void setGroupPalette(uint8_t group, uint8_t index) = 0;
+
+    /**
+     * Get the size of a run of quantized colors
+     *
+     * @return Packed size in bytes, 0 if the format is unknown
+     */
+    virtual size_t quantizedSize(uint8_t format, uint32_t count) = 0;
+
+    // Consecutive fixtures with quantized colors
+    virtual void setQuantized(uint8_t format, bool dither, uint32_t first, uint32_t count, const uint8_t* packed) = 0;
+};
+
+/**
+ * Outcome of decoding a binary payload
+ */
+struct BinaryDecodeInfo {
+    bool sequenced;       // The payload carried a sequence number
+    uint16_t seq;
+    bool duplicate;       // Skipped as a repeat
+    uint16_t commands;    // Commands applied
+    const char* error;    // NULL, or why decoding stopped
+    size_t errorOffset;   // Byte position of the error
+};
+
+class CommandDecoder {
+public:
+    /**
+     * Constructor
+     *
+     * @param sink Receiver of the decoded commands
+     * @param maxFixtures Most fixtures a single command may address
+     * @param paletteSize Number of palette entries
+     */
+    CommandDecoder(CommandSink& sink, uint32_t maxFixtures, uint32_t paletteSize);
+
+    /**
+     * Decode a payload from the text port: a single-byte command or JSON
+     *
+     * @return true if the payload was a known command and was applied
+     */
+    bool decodeText(uint8_t* payload, size_t size);
+
+    /**
+     * Decode a single-byte command
+     * 0-4 (binary or ASCII digit) set all fixtures to off, red, green, blue
+     * or white; 0xAA and 0xFF are test triggers that set them to green
+     *
+     * @return true if the byte was a known command
+     */
+    bool decodeSingleByte(uint8_t cmd);
+
+    /**
+     * Decode a binary command payload
+     *
+     * @param payload The payload, version byte first
+     * @param size The size of the payload
+     * @param info Filled with the sequence number, command count and any error
+     * @return true if every command was applied (or the payload was a repeat),
+     *         false if the payload was rejected and nothing was applied
+     */
+    bool decodeBinary(const uint8_t* payload, size_t size, BinaryDecodeInfo& info);
+
+private:
+    CommandSink& _sink;
+    uint32_t _maxFixtures;
+    uint32_t _paletteSize;
+
+    bool decodeCommand(uint8_t opcode, BinaryReader& reader, const char*& error, bool apply);
+};
+
+#endif // COMMAND_DECODER_H
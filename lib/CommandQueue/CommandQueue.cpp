@@ -0,0 +1,46 @@
+/**
+ * CommandQueue.cpp - Lock-free hand-off of downlinks to the DMX task
+ */
+
+#include "CommandQueue.h"
+
+CommandQueue::CommandQueue() : _head(0), _tail(0), _dropped(0) {
+}
+
+bool CommandQueue::push(const uint8_t* payload, size_t length, uint8_t port, uint32_t receivedMs) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (length > COMMAND_MAX_PAYLOAD || head - _tail.load(std::memory_order_acquire) >= COMMAND_QUEUE_LENGTH) {
+        _dropped++;
+        return false;
+    }
+
+    QueuedCommand& slot = _slots[head & (COMMAND_QUEUE_LENGTH - 1)];
+    slot.receivedMs = receivedMs;
+    slot.port = port;
+    slot.length = length;
+    memcpy(slot.payload, payload, length);
+
+    // Publish the slot only once its contents are written
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+QueuedCommand* CommandQueue::peek() {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) {
+        return NULL;
+    }
+    return &_slots[tail & (COMMAND_QUEUE_LENGTH - 1)];
+}
+
+void CommandQueue::pop() {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail != _head.load(std::memory_order_acquire)) {
+        // Hand the slot back only once the consumer is done with it
+        _tail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+size_t CommandQueue::size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+}
@@ -0,0 +1,75 @@
+/**
+ * CommandQueue.h - Lock-free hand-off of downlinks to the DMX task
+ * 
+ * A single-producer/single-consumer ring of fixed-size slots. The LoRa
+ * callback (producer) copies each downlink into a slot and returns; the
+ * DMX task (consumer) applies the queued commands at the next frame
+ * boundary. Only the producer moves the head and only the consumer moves
+ * the tail, so neither side ever waits on the other.
+ */
+
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define COMMAND_QUEUE_LENGTH 8      // Slots in the ring (power of two)
+#define COMMAND_MAX_PAYLOAD 242     // Largest LoRaWAN downlink payload
+
+/**
+ * A downlink waiting to be applied
+ */
+struct QueuedCommand {
+    uint32_t receivedMs;                    // millis() when the downlink arrived
+    uint8_t port;                           // fPort
+    uint8_t length;                         // Payload length in bytes
+    uint8_t payload[COMMAND_MAX_PAYLOAD];   // Raw payload, parsed in place by the consumer
+};
+
+class CommandQueue {
+public:
+    CommandQueue();
+
+    /**
+     * Copy a downlink into the next free slot (producer only)
+     * 
+     * @param payload Payload data
+     * @param length Payload length
+     * @param port fPort the payload arrived on
+     * @param receivedMs millis() at reception
+     * @return false if the queue is full or the payload is too large
+     */
+    bool push(const uint8_t* payload, size_t length, uint8_t port, uint32_t receivedMs);
+
+    /**
+     * Get the oldest queued command (consumer only)
+     * The slot stays owned by the consumer until pop()
+     * 
+     * @return The command, or NULL if the queue is empty
+     */
+    QueuedCommand* peek();
+
+    /**
+     * Release the slot returned by peek() (consumer only)
+     */
+    void pop();
+
+    /**
+     * Get the number of queued commands
+     */
+    size_t size() const;
+
+    /**
+     * Get the number of downlinks dropped because the queue was full
+     */
+    uint32_t getDropped() const { return _dropped; }
+
+private:
+    QueuedCommand _slots[COMMAND_QUEUE_LENGTH];
+    std::atomic<uint32_t> _head;    // Commands pushed, written by the producer
+    std::atomic<uint32_t> _tail;    // Commands popped, written by the consumer
+    uint32_t _dropped;              // Written by the producer
+};
+
+#endif // COMMAND_QUEUE_H
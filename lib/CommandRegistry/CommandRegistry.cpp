@@ -0,0 +1,18 @@
+/**
+ * CommandRegistry.cpp - Runtime form of the command name hash
+ */
+
+#include "CommandRegistry.h"
+
+// FNV-1a hash of a name that is not null-terminated
+uint32_t commandHash(const char* name, size_t length, bool ignoreCase) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = (uint8_t)name[i];
+        if (ignoreCase && c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,106 @@
+/**
+ * CommandRegistry.h - Constant-time lookup of command handlers
+ * 
+ * Commands are declared once in a table, each with a 32-bit key: the
+ * FNV-1a hash of its name for JSON commands (computed at compile time with
+ * commandHash()), or its opcode / fPort for binary routing. The registry
+ * indexes a table into an open-addressed slot array at startup, so
+ * dispatch is a hash and a probe however many commands exist.
+ */
+
+#ifndef COMMAND_REGISTRY_H
+#define COMMAND_REGISTRY_H
+
+#include <Arduino.h>
+
+#define REGISTRY_SLOTS 32  // Slot count (power of two, at least twice the largest table)
+
+/**
+ * FNV-1a hash of a null-terminated name, usable in constant expressions
+ */
+constexpr uint32_t commandHash(const char* name, uint32_t hash = 2166136261u) {
+    return *name ? commandHash(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+/**
+ * FNV-1a hash of a name that is not null-terminated
+ * 
+ * @param name Name characters
+ * @param length Number of characters
+ * @param ignoreCase Hash the lower-case form of the name
+ */
+uint32_t commandHash(const char* name, size_t length, bool ignoreCase);
+
+/**
+ * Registry over a table of entries that have a uint32_t `key` member
+ */
+template <typename Entry>
+class CommandRegistry {
+public:
+    CommandRegistry() : _count(0) {
+        memset(_slots, 0, sizeof(_slots));
+    }
+
+    /**
+     * Index a table of entries
+     * 
+     * @param entries Table (must outlive the registry)
+     * @param count Number of entries
+     * @return false if the table is too large or two entries share a key
+     */
+    bool build(const Entry* entries, size_t count) {
+        memset(_slots, 0, sizeof(_slots));
+        _count = 0;
+        if (count > REGISTRY_SLOTS / 2) {
+            return false;
+        }
+        
+        for (size_t i = 0; i < count; i++) {
+            uint32_t slot = mix(entries[i].key);
+            while (_slots[slot] != NULL) {
+                if (_slots[slot]->key == entries[i].key) {
+                    return false;
+                }
+                slot = (slot + 1) & (REGISTRY_SLOTS - 1);
+            }
+            _slots[slot] = &entries[i];
+            _count++;
+        }
+        return true;
+    }
+
+    /**
+     * Find the entry for a key
+     * 
+     * @return The entry, or NULL if no entry has this key
+     */
+    const Entry* find(uint32_t key) const {
+        uint32_t slot = mix(key);
+        while (_slots[slot] != NULL) {
+            if (_slots[slot]->key == key) {
+                return _slots[slot];
+            }
+            slot = (slot + 1) & (REGISTRY_SLOTS - 1);
+        }
+        return NULL;
+    }
+
+    /**
+     * Get the number of indexed entries
+     */
+    size_t size() const { return _count; }
+
+private:
+    const Entry* _slots[REGISTRY_SLOTS];
+    size_t _count;
+
+    // Spread small keys such as opcodes and ports over the slots
+    static uint32_t mix(uint32_t key) {
+        key ^= key >> 16;
+        key *= 0x45D9F3Bu;
+        key ^= key >> 16;
+        return key & (REGISTRY_SLOTS - 1);
+    }
+};
+
+#endif // COMMAND_REGISTRY_H
@@ -0,0 +1,110 @@
+/**
+ * CommandReport.cpp - Batched acknowledgement of downlink commands
+ */
+
+#include "CommandReport.h"
+
+CommandReport::CommandReport()
+    : _hasSequence(false), _highest(0), _received(0), _applied(0), _downlinksApplied(0),
+      _downlinksFailed(0), _ping(false), _sentApplied(0), _sentFailed(0), _sentPing(false),
+      _pending(false), _pendingSinceMs(0) {
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+// Called with the lock held
+void CommandReport::markPending() {
+    if (!_pending) {
+        _pending = true;
+        _pendingSinceMs = millis();
+    }
+}
+
+void CommandReport::recordSequenced(uint16_t seq, bool applied) {
+    portENTER_CRITICAL(&_lock);
+    if (!_hasSequence) {
+        _hasSequence = true;
+        _highest = seq;
+    }
+
+    // Slide the window up to a newer number (serial number arithmetic, so it may wrap)
+    int16_t ahead = (int16_t)(seq - _highest);
+    if (ahead > 0) {
+        _received = ahead < 32 ? _received << ahead : 0;
+        _applied = ahead < 32 ? _applied << ahead : 0;
+        _highest = seq;
+    }
+
+    uint16_t age = _highest - seq;
+    if (age < 32) {
+        _received |= 1UL << age;
+        if (applied) {
+            _applied |= 1UL << age;
+        } else {
+            _applied &= ~(1UL << age);
+        }
+    }
+    markPending();
+    portEXIT_CRITICAL(&_lock);
+}
+
+void CommandReport::recordDownlink(bool success) {
+    portENTER_CRITICAL(&_lock);
+    uint8_t& count = success ? _downlinksApplied : _downlinksFailed;
+    if (count < 255) {
+        count++;
+    }
+    markPending();
+    portEXIT_CRITICAL(&_lock);
+}
+
+void CommandReport::recordPing() {
+    portENTER_CRITICAL(&_lock);
+    _ping = true;
+    markPending();
+    portEXIT_CRITICAL(&_lock);
+}
+
+size_t CommandReport::build(uint8_t* out, uint8_t statusFlags) {
+    portENTER_CRITICAL(&_lock);
+    uint8_t flags = statusFlags & (REPORT_DMX_OK | REPORT_CLOCK_SYNCED | REPORT_TRANSFER_ACTIVE);
+    if (_ping) {
+        flags |= REPORT_PING;
+    }
+    if (_hasSequence) {
+        flags |= REPORT_HAS_SEQUENCE;
+    }
+
+    out[0] = REPORT_VERSION;
+    out[1] = flags;
+    out[2] = _highest & 0xFF;
+    out[3] = _highest >> 8;
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (_received >> (8 * i)) & 0xFF;
+        out[8 + i] = (_applied >> (8 * i)) & 0xFF;
+    }
+    out[12] = _downlinksApplied;
+    out[13] = _downlinksFailed;
+
+    // The window stays, so sequenced results are repeated until newer ones push them out
+    _sentApplied = _downlinksApplied;
+    _sentFailed = _downlinksFailed;
+    _sentPing = _ping;
+    _downlinksApplied = 0;
+    _downlinksFailed = 0;
+    _ping = false;
+    _pending = false;
+    portEXIT_CRITICAL(&_lock);
+    return REPORT_SIZE;
+}
+
+void CommandReport::sendFailed() {
+    portENTER_CRITICAL(&_lock);
+    _downlinksApplied = min(_downlinksApplied + _sentApplied, 255);
+    _downlinksFailed = min(_downlinksFailed + _sentFailed, 255);
+    _ping |= _sentPing;
+    _sentApplied = 0;
+    _sentFailed = 0;
+    _sentPing = false;
+    markPending();
+    portEXIT_CRITICAL(&_lock);
+}
@@ -0,0 +1,105 @@
+/**
+ * CommandReport.h - Batched acknowledgement of downlink commands
+ * 
+ * Instead of answering each command with its own uplink, results are
+ * collected here and sent as one compact binary report with the next
+ * heartbeat (or a single coalesced uplink shortly after a burst).
+ * 
+ * Sequenced commands are tracked in a 32-command window below the highest
+ * sequence number seen, as two bitmaps: received and applied. A command
+ * that is received but not applied failed; one that is not received was
+ * lost and should be re-sent. Unsequenced commands are only counted.
+ * 
+ * Report layout (REPORT_SIZE bytes, multi-byte fields little-endian):
+ *   [0]     REPORT_VERSION
+ *   [1]     flags (ReportFlag)
+ *   [2-3]   highest sequence number
+ *   [4-7]   received bitmap, bit i = sequence number (highest - i)
+ *   [8-11]  applied bitmap, same layout
+ *   [12]    downlinks applied since the last report (saturating)
+ *   [13]    downlinks failed since the last report (saturating)
+ */
+
+#ifndef COMMAND_REPORT_H
+#define COMMAND_REPORT_H
+
+#include <Arduino.h>
+
+#define REPORT_VERSION 1
+#define REPORT_SIZE 14
+
+// Status flags in byte 1 of the report
+enum ReportFlag {
+    REPORT_DMX_OK = 0x01,           // DMX output initialised
+    REPORT_CLOCK_SYNCED = 0x02,     // Show clock synchronised
+    REPORT_PING = 0x04,             // A ping was received since the last report
+    REPORT_TRANSFER_ACTIVE = 0x08,  // A fragmented transfer is in progress
+    REPORT_HAS_SEQUENCE = 0x10      // Bytes 2-11 are valid
+};
+
+class CommandReport {
+public:
+    CommandReport();
+
+    /**
+     * Record the result of a sequenced command (duplicates count as applied)
+     * 
+     * @param seq Sequence number
+     * @param applied true if the command was applied
+     */
+    void recordSequenced(uint16_t seq, bool applied);
+
+    /**
+     * Record the result of a downlink, sequenced or not
+     */
+    void recordDownlink(bool success);
+
+    /**
+     * Record a ping, answered by the next report
+     */
+    void recordPing();
+
+    /**
+     * Check whether there are results the server has not been sent
+     */
+    bool isPending() const { return _pending; }
+
+    /**
+     * Get millis() of the oldest unreported result
+     */
+    uint32_t getPendingSinceMs() const { return _pendingSinceMs; }
+
+    /**
+     * Build the report and start collecting the next one
+     * 
+     * @param out Buffer of at least REPORT_SIZE bytes
+     * @param statusFlags REPORT_DMX_OK, REPORT_CLOCK_SYNCED and REPORT_TRANSFER_ACTIVE as applicable
+     * @return Number of bytes written
+     */
+    size_t build(uint8_t* out, uint8_t statusFlags);
+
+    /**
+     * Keep the results pending after the report could not be sent
+     * The counts and ping taken by the last build() go into the next report
+     */
+    void sendFailed();
+
+private:
+    portMUX_TYPE _lock;
+    bool _hasSequence;
+    uint16_t _highest;
+    uint32_t _received;
+    uint32_t _applied;
+    uint8_t _downlinksApplied;
+    uint8_t _downlinksFailed;
+    bool _ping;
+    uint8_t _sentApplied;           // Taken by the last build(), restored if it is not sent
+    uint8_t _sentFailed;
+    bool _sentPing;
+    bool _pending;
+    uint32_t _pendingSinceMs;
+
+    void markPending();
+};
+
+#endif // COMMAND_REPORT_H
@@ -0,0 +1,159 @@
+/**
+ * CommandScheduler.cpp - Implementation of the scheduled command min-heap
+ */
+
+#include "CommandScheduler.h"
+#include <string.h>
+
+// Constructor
+CommandScheduler::CommandScheduler() {
+    clear();
+}
+
+// Remove all queued commands
+void CommandScheduler::clear() {
+    _count = 0;
+    _nextOrder = 0;
+    _freeCount = SCHEDULER_CAPACITY;
+    for (int i = 0; i < SCHEDULER_CAPACITY; i++) {
+        _freeSlots[i] = (uint8_t)(SCHEDULER_CAPACITY - 1 - i);
+    }
+}
+
+// Ordering used by the heap - wrap-safe comparison of millis() values
+bool CommandScheduler::before(const HeapNode& a, const HeapNode& b) {
+    int32_t diff = (int32_t)(a.executeAt - b.executeAt);
+    if (diff != 0) {
+        return diff < 0;
+    }
+    return (int32_t)(a.order - b.order) < 0;
+}
+
+// Move a node up until the heap property holds
+void CommandScheduler::siftUp(int index) {
+    HeapNode node = _heap[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!before(node, _heap[parent])) {
+            break;
+        }
+        _heap[index] = _heap[parent];
+        index = parent;
+    }
+    _heap[index] = node;
+}
+
+// Move a node down until the heap property holds
+void CommandScheduler::siftDown(int index) {
+    HeapNode node = _heap[index];
+    while (true) {
+        int child = 2 * index + 1;
+        if (child >= _count) {
+            break;
+        }
+        if (child + 1 < _count && before(_heap[child + 1], _heap[child])) {
+            child++;
+        }
+        if (!before(_heap[child], node)) {
+            break;
+        }
+        _heap[index] = _heap[child];
+        index = child;
+    }
+    _heap[index] = node;
+}
+
+// Remove the heap node at the given index and release its slot
+void CommandScheduler::removeAt(int index) {
+    _freeSlots[_freeCount++] = _heap[index].slot;
+    _count--;
+    
+    if (index == _count) {
+        return;
+    }
+    
+    // Move the last node into the hole and restore the heap property
+    _heap[index] = _heap[_count];
+    if (index > 0 && before(_heap[index], _heap[(index - 1) / 2])) {
+        siftUp(index);
+    } else {
+        siftDown(index);
+    }
+}
+
+// Add a command to the queue
+bool CommandScheduler::schedule(uint32_t executeAt, const uint8_t* payload, size_t length, uint8_t port, uint16_t id) {
+    if (_count >= SCHEDULER_CAPACITY || length > SCHEDULER_MAX_PAYLOAD || payload == NULL) {
+        return false;
+    }
+    
+    // Store the payload in a free slot
+    uint8_t slot = _freeSlots[--_freeCount];
+    ScheduledCommand& cmd = _slots[slot];
+    cmd.executeAt = executeAt;
+    cmd.id = id;
+    cmd.port = port;
+    cmd.length = (uint16_t)length;
+    memcpy(cmd.payload, payload, length);
+    
+    // Insert the key into the heap
+    HeapNode node;
+    node.executeAt = executeAt;
+    node.order = _nextOrder++;
+    node.slot = slot;
+    _heap[_count] = node;
+    siftUp(_count);
+    _count++;
+    
+    return true;
+}
+
+// Remove the earliest command if it is due
+bool CommandScheduler::popDue(uint32_t now, ScheduledCommand& out) {
+    if (_count == 0 || (int32_t)(now - _heap[0].executeAt) < 0) {
+        return false;
+    }
+    
+    const ScheduledCommand& cmd = _slots[_heap[0].slot];
+    out.executeAt = cmd.executeAt;
+    out.id = cmd.id;
+    out.port = cmd.port;
+    out.length = cmd.length;
+    memcpy(out.payload, cmd.payload, cmd.length);
+    
+    removeAt(0);
+    return true;
+}
+
+// Get the execution time of the earliest command
+bool CommandScheduler::peekNextTime(uint32_t& executeAt) const {
+    if (_count == 0) {
+        return false;
+    }
+    executeAt = _heap[0].executeAt;
+    return true;
+}
+
+// Cancel all commands with the given ID
+int CommandScheduler::cancel(uint16_t id) {
+    // Compact the heap array, dropping matching nodes
+    int kept = 0;
+    for (int i = 0; i < _count; i++) {
+        if (_slots[_heap[i].slot].id == id) {
+            _freeSlots[_freeCount++] = _heap[i].slot;
+        } else {
+            _heap[kept++] = _heap[i];
+        }
+    }
+    
+    int removed = _count - kept;
+    _count = kept;
+    
+    // Rebuild the heap bottom-up
+    if (removed > 0) {
+        for (int i = _count / 2 - 1; i >= 0; i--) {
+            siftDown(i);
+        }
+    }
+    return removed;
+}
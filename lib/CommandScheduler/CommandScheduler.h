@@ -0,0 +1,107 @@
+/**
+ * CommandScheduler.h - Time-ordered queue of commands to execute later
+ * 
+ * Commands are stored with an absolute execution time on the local millis()
+ * timeline and kept in a fixed-capacity binary min-heap, so the next due
+ * command is always available in O(1) and insert/pop cost O(log n).
+ * No dynamic allocation is performed after construction.
+ */
+
+#ifndef COMMAND_SCHEDULER_H
+#define COMMAND_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Scheduler configuration
+#define SCHEDULER_CAPACITY 16      // Maximum number of pending commands
+#define SCHEDULER_MAX_PAYLOAD 192  // Maximum stored command size in bytes
+#define SCHEDULER_MAX_DELAY_MS 0x7FFFFFFFUL  // Furthest execution time millis() can order (about 24.8 days)
+
+// A command waiting for its execution time
+struct ScheduledCommand {
+  uint32_t executeAt;                       // Local millis() at which to execute
+  uint16_t id;                              // Caller-assigned ID (0 = none), used for cancel
+  uint8_t port;                             // Port the command was received on
+  uint16_t length;                          // Number of valid bytes in payload
+  uint8_t payload[SCHEDULER_MAX_PAYLOAD];   // Raw command bytes
+};
+
+class CommandScheduler {
+public:
+    CommandScheduler();
+
+    /**
+     * Add a command to the queue
+     * 
+     * @param executeAt Local millis() at which the command should run
+     * @param payload Command bytes
+     * @param length Number of command bytes
+     * @param port Port the command was received on
+     * @param id Optional ID for later cancellation (0 = none)
+     * @return true if queued, false if the queue is full or the command too large
+     */
+    bool schedule(uint32_t executeAt, const uint8_t* payload, size_t length, uint8_t port, uint16_t id = 0);
+
+    /**
+     * Remove the earliest command if it is due
+     * 
+     * @param now Current local millis()
+     * @param out Receives the command
+     * @return true if a due command was returned
+     */
+    bool popDue(uint32_t now, ScheduledCommand& out);
+
+    /**
+     * Get the execution time of the earliest queued command
+     * 
+     * @param executeAt Receives the execution time
+     * @return true if the queue is not empty
+     */
+    bool peekNextTime(uint32_t& executeAt) const;
+
+    /**
+     * Cancel all queued commands with the given ID
+     * 
+     * @return Number of commands removed
+     */
+    int cancel(uint16_t id);
+
+    /**
+     * Remove all queued commands
+     */
+    void clear();
+
+    /**
+     * Get the number of queued commands
+     */
+    int size() const { return _count; }
+
+    /**
+     * Get the maximum number of queued commands
+     */
+    int capacity() const { return SCHEDULER_CAPACITY; }
+
+private:
+    // Heap node - small so that sifting does not move payloads around
+    struct HeapNode {
+        uint32_t executeAt;
+        uint32_t order;   // Insertion counter, keeps equal times in FIFO order
+        uint8_t slot;     // Index into _slots
+    };
+
+    ScheduledCommand _slots[SCHEDULER_CAPACITY];  // Payload storage
+    uint8_t _freeSlots[SCHEDULER_CAPACITY];       // Stack of unused slot indices
+    int _freeCount;
+    HeapNode _heap[SCHEDULER_CAPACITY];
+    int _count;
+    uint32_t _nextOrder;
+
+    // Heap helpers
+    static bool before(const HeapNode& a, const HeapNode& b);
+    void siftUp(int index);
+    void siftDown(int index);
+    void removeAt(int index);
+};
+
+#endif // COMMAND_SCHEDULER_H
@@ -0,0 +1,200 @@
+/**
+ * DailySchedule.cpp - Implementation of the autonomous daily schedule
+ */
+
+#include "DailySchedule.h"
+
+// Layout version of the persisted table
+#define DAILY_STORAGE_VERSION 1
+
+// Constructor
+DailySchedule::DailySchedule() :
+    _latitude(0),
+    _longitude(0),
+    _utcOffset(0),
+    _count(0),
+    _resolvedCount(0),
+    _cursor(0),
+    _resolvedDay(-1),
+    _sunrise(SOLAR_NEVER_RISES),
+    _sunset(SOLAR_NEVER_SETS) {
+}
+
+// Set the location
+void DailySchedule::setLocation(float latitude, float longitude, int16_t utcOffsetMinutes) {
+    _latitude = latitude;
+    _longitude = longitude;
+    _utcOffset = utcOffsetMinutes;
+    _resolvedDay = -1;
+}
+
+// Add an entry
+bool DailySchedule::addEntry(DailyAnchor anchor, int16_t minutes, uint8_t daysMask, const uint8_t* payload, size_t length) {
+    if (_count >= DAILY_MAX_ENTRIES || length > DAILY_MAX_PAYLOAD || payload == NULL) {
+        return false;
+    }
+    
+    DailyEntry& entry = _entries[_count++];
+    entry.anchor = anchor;
+    entry.minutes = minutes;
+    entry.daysMask = daysMask & DAILY_ALL_DAYS;
+    entry.length = (uint16_t)length;
+    memcpy(entry.payload, payload, length);
+    
+    _resolvedDay = -1;
+    return true;
+}
+
+// Remove all entries
+void DailySchedule::clear() {
+    _count = 0;
+    _resolvedCount = 0;
+    _cursor = 0;
+    _resolvedDay = -1;
+}
+
+// Split a Unix time into local day and minute
+void DailySchedule::localTime(uint32_t unixSeconds, int32_t& day, int16_t& minute) const {
+    int64_t local = (int64_t)unixSeconds + (int64_t)_utcOffset * 60;
+    day = (int32_t)(local / 86400);
+    minute = (int16_t)((local % 86400) / 60);
+}
+
+// Build the sorted event list for a local day
+void DailySchedule::resolveDay(int32_t day) {
+    CivilDate date = solarCivilFromDays(day);
+    
+    // Solar events in local minutes
+    int16_t rise = solarEventUtcMinutes(date.dayOfYear, _latitude, _longitude, true);
+    int16_t set = solarEventUtcMinutes(date.dayOfYear, _latitude, _longitude, false);
+    _sunrise = rise >= 0 ? (int16_t)((rise + _utcOffset + 1440) % 1440) : rise;
+    _sunset = set >= 0 ? (int16_t)((set + _utcOffset + 1440) % 1440) : set;
+    
+    _resolvedCount = 0;
+    for (int i = 0; i < _count; i++) {
+        const DailyEntry& entry = _entries[i];
+        if (!(entry.daysMask & (1 << date.weekday))) {
+            continue;
+        }
+        
+        int16_t minute;
+        if (entry.anchor == DAILY_AT_SUNRISE) {
+            if (_sunrise < 0) continue;
+            minute = _sunrise + entry.minutes;
+        } else if (entry.anchor == DAILY_AT_SUNSET) {
+            if (_sunset < 0) continue;
+            minute = _sunset + entry.minutes;
+        } else {
+            minute = entry.minutes;
+        }
+        
+        // Offsets that leave the day are clamped to it
+        if (minute < 0) minute = 0;
+        if (minute > 1439) minute = 1439;
+        
+        // Insertion sort - the table is small and keeps entry order for ties
+        int pos = _resolvedCount++;
+        while (pos > 0 && _resolved[pos - 1].minute > minute) {
+            _resolved[pos] = _resolved[pos - 1];
+            pos--;
+        }
+        _resolved[pos].minute = minute;
+        _resolved[pos].entry = (uint8_t)i;
+    }
+    
+    _resolvedDay = day;
+    _cursor = 0;
+}
+
+// Resolve for now and position the cursor after the current minute
+const DailyEntry* DailySchedule::resync(uint32_t unixSeconds) {
+    int32_t day;
+    int16_t minute;
+    localTime(unixSeconds, day, minute);
+    resolveDay(day);
+    
+    while (_cursor < _resolvedCount && _resolved[_cursor].minute <= minute) {
+        _cursor++;
+    }
+    
+    return _cursor > 0 ? &_entries[_resolved[_cursor - 1].entry] : NULL;
+}
+
+// Get the next entry if it is due
+const DailyEntry* DailySchedule::popDue(uint32_t unixSeconds) {
+    int32_t day;
+    int16_t minute;
+    localTime(unixSeconds, day, minute);
+    
+    // A new day starts with a fresh table from the first event
+    if (day != _resolvedDay) {
+        bool firstResolve = _resolvedDay < 0;
+        resolveDay(day);
+        if (firstResolve) {
+            // Skip events that already passed, resync() handles catching up
+            while (_cursor < _resolvedCount && _resolved[_cursor].minute < minute) {
+                _cursor++;
+            }
+        }
+    }
+    
+    if (_cursor >= _resolvedCount || _resolved[_cursor].minute > minute) {
+        return NULL;
+    }
+    return &_entries[_resolved[_cursor++].entry];
+}
+
+// Local minute of the next event
+int16_t DailySchedule::getNextEventMinute() const {
+    if (_cursor >= _resolvedCount) {
+        return -1;
+    }
+    return _resolved[_cursor].minute;
+}
+
+// Save to persistent storage
+bool DailySchedule::save() {
+    if (!_preferences.begin("daily", false)) {
+        Serial.println("Failed to open schedule preferences");
+        return false;
+    }
+    
+    _preferences.putUChar("version", DAILY_STORAGE_VERSION);
+    _preferences.putFloat("lat", _latitude);
+    _preferences.putFloat("lon", _longitude);
+    _preferences.putShort("tz", _utcOffset);
+    _preferences.putUChar("count", (uint8_t)_count);
+    if (_count > 0) {
+        _preferences.putBytes("entries", _entries, sizeof(DailyEntry) * _count);
+    } else {
+        _preferences.remove("entries");
+    }
+    
+    _preferences.end();
+    Serial.println("Daily schedule saved to persistent storage");
+    return true;
+}
+
+// Load from persistent storage
+bool DailySchedule::load() {
+    if (!_preferences.begin("daily", true)) {
+        return false;
+    }
+    
+    bool loaded = false;
+    if (_preferences.getUChar("version", 0) == DAILY_STORAGE_VERSION) {
+        _latitude = _preferences.getFloat("lat", 0);
+        _longitude = _preferences.getFloat("lon", 0);
+        _utcOffset = _preferences.getShort("tz", 0);
+        _count = min((int)_preferences.getUChar("count", 0), DAILY_MAX_ENTRIES);
+        
+        if (_count > 0 && _preferences.getBytes("entries", _entries, sizeof(DailyEntry) * _count) != sizeof(DailyEntry) * _count) {
+            _count = 0;
+        }
+        loaded = true;
+    }
+    
+    _preferences.end();
+    _resolvedDay = -1;
+    return loaded;
+}
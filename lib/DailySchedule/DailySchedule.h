@@ -0,0 +1,147 @@
+/**
+ * DailySchedule.h - Autonomous time-of-day and sunrise/sunset schedule
+ * 
+ * Stores a table of commands that run every day (or on selected weekdays)
+ * at a fixed local time or at an offset from sunrise or sunset. Solar times
+ * are computed on the device from the configured location, so the node
+ * runs its day without downlinks once its clock has been synchronised.
+ * 
+ * The table is resolved into a time-sorted list once per day (and whenever
+ * it changes), and a cursor points at the next event, so checking for due
+ * events costs a single comparison.
+ */
+
+#ifndef DAILY_SCHEDULE_H
+#define DAILY_SCHEDULE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "SolarTime.h"
+
+#define DAILY_MAX_ENTRIES 16      // Maximum number of schedule entries
+#define DAILY_MAX_PAYLOAD 128     // Maximum stored command size in bytes
+#define DAILY_ALL_DAYS 0x7F       // Weekday mask for every day (bit 0 = Sunday)
+
+// What an entry's time is relative to
+enum DailyAnchor {
+  DAILY_AT_TIME = 0,    // Minutes after local midnight
+  DAILY_AT_SUNRISE,     // Minutes relative to sunrise
+  DAILY_AT_SUNSET       // Minutes relative to sunset
+};
+
+// One schedule entry
+struct DailyEntry {
+  uint8_t anchor;                     // DailyAnchor
+  uint8_t daysMask;                   // Weekdays the entry runs on
+  int16_t minutes;                    // Time of day or offset, in minutes
+  uint16_t length;                    // Number of valid bytes in payload
+  uint8_t payload[DAILY_MAX_PAYLOAD]; // Command to execute
+};
+
+class DailySchedule {
+public:
+    DailySchedule();
+
+    /**
+     * Set the location and time zone used to resolve the schedule
+     * 
+     * @param latitude Latitude in degrees (north positive)
+     * @param longitude Longitude in degrees (east positive)
+     * @param utcOffsetMinutes Local time zone offset from UTC in minutes
+     */
+    void setLocation(float latitude, float longitude, int16_t utcOffsetMinutes);
+
+    /**
+     * Add an entry to the table
+     * 
+     * @return true if added, false if the table is full or the payload too large
+     */
+    bool addEntry(DailyAnchor anchor, int16_t minutes, uint8_t daysMask, const uint8_t* payload, size_t length);
+
+    /**
+     * Remove all entries
+     */
+    void clear();
+
+    /**
+     * Resolve the table for the current day and position the cursor
+     * 
+     * @param unixSeconds Current Unix time
+     * @return The most recent entry that has already passed today, so the
+     *         caller can restore the state the schedule expects, or NULL
+     */
+    const DailyEntry* resync(uint32_t unixSeconds);
+
+    /**
+     * Get the next entry if it is due, advancing the cursor
+     * Re-resolves the table automatically when the local day changes
+     * 
+     * @param unixSeconds Current Unix time
+     * @return The due entry, or NULL if nothing is due
+     */
+    const DailyEntry* popDue(uint32_t unixSeconds);
+
+    /**
+     * Get the number of entries in the table
+     */
+    int size() const { return _count; }
+
+    /**
+     * Get today's sunrise in local minutes after midnight (negative if none)
+     */
+    int16_t getSunrise() const { return _sunrise; }
+
+    /**
+     * Get today's sunset in local minutes after midnight (negative if none)
+     */
+    int16_t getSunset() const { return _sunset; }
+
+    /**
+     * Get the local minute of the next event, or -1 if none is left today
+     */
+    int16_t getNextEventMinute() const;
+
+    /**
+     * Save the location and table to persistent storage
+     */
+    bool save();
+
+    /**
+     * Load the location and table from persistent storage
+     * 
+     * @return true if a schedule was loaded
+     */
+    bool load();
+
+private:
+    // Location
+    float _latitude;
+    float _longitude;
+    int16_t _utcOffset;
+
+    // Table
+    DailyEntry _entries[DAILY_MAX_ENTRIES];
+    int _count;
+
+    // Resolved events for the current local day, sorted by time
+    struct ResolvedEvent {
+        int16_t minute;   // Local minutes after midnight
+        uint8_t entry;    // Index into _entries
+    };
+    ResolvedEvent _resolved[DAILY_MAX_ENTRIES];
+    int _resolvedCount;
+    int _cursor;
+    int32_t _resolvedDay;  // Local days since epoch, -1 = not resolved
+    int16_t _sunrise;
+    int16_t _sunset;
+
+    Preferences _preferences;
+
+    // Local days since epoch and minute of day for a Unix time
+    void localTime(uint32_t unixSeconds, int32_t& day, int16_t& minute) const;
+
+    // Build the sorted event list for a local day
+    void resolveDay(int32_t day);
+};
+
+#endif // DAILY_SCHEDULE_H
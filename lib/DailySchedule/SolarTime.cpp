@@ -0,0 +1,79 @@
+/**
+ * SolarTime.cpp - Implementation of the sunrise equation and calendar helpers
+ */
+
+#include "SolarTime.h"
+#include <math.h>
+
+#define DEG_TO_RAD_F 0.017453292f
+#define RAD_TO_DEG_F 57.29577951f
+
+// Official zenith for sunrise/sunset, includes refraction and solar disc radius
+#define SOLAR_ZENITH 90.833f
+
+// Days since 1970-01-01 to civil date (Howard Hinnant's algorithm)
+CivilDate solarCivilFromDays(int32_t days) {
+    CivilDate date;
+    date.weekday = (uint8_t)((days % 7 + 11) % 7);  // 1970-01-01 was a Thursday
+    
+    int32_t z = days + 719468;
+    int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    uint32_t doe = (uint32_t)(z - era * 146097);
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32_t y = (int32_t)yoe + era * 400;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    date.day = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+    date.month = (uint8_t)(mp < 10 ? mp + 3 : mp - 9);
+    date.year = y + (date.month <= 2 ? 1 : 0);
+    
+    // Day of year from the month table
+    static const uint16_t cumulative[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+    bool leap = (date.year % 4 == 0 && date.year % 100 != 0) || date.year % 400 == 0;
+    date.dayOfYear = cumulative[date.month - 1] + date.day + ((leap && date.month > 2) ? 1 : 0);
+    return date;
+}
+
+// Wrap a value into [0, range)
+static float wrap(float value, float range) {
+    value = fmodf(value, range);
+    return value < 0 ? value + range : value;
+}
+
+// Sunrise equation
+int16_t solarEventUtcMinutes(uint16_t dayOfYear, float latitude, float longitude, bool sunrise) {
+    float lngHour = longitude / 15.0f;
+    float t = dayOfYear + ((sunrise ? 6.0f : 18.0f) - lngHour) / 24.0f;
+    
+    // Sun's mean anomaly and true longitude
+    float m = 0.9856f * t - 3.289f;
+    float l = wrap(m + 1.916f * sinf(m * DEG_TO_RAD_F) + 0.020f * sinf(2 * m * DEG_TO_RAD_F) + 282.634f, 360.0f);
+    
+    // Right ascension, in the same quadrant as L, in hours
+    float ra = wrap(RAD_TO_DEG_F * atanf(0.91764f * tanf(l * DEG_TO_RAD_F)), 360.0f);
+    ra += floorf(l / 90.0f) * 90.0f - floorf(ra / 90.0f) * 90.0f;
+    ra /= 15.0f;
+    
+    // Declination and local hour angle
+    float sinDec = 0.39782f * sinf(l * DEG_TO_RAD_F);
+    float cosDec = cosf(asinf(sinDec));
+    float cosH = (cosf(SOLAR_ZENITH * DEG_TO_RAD_F) - sinDec * sinf(latitude * DEG_TO_RAD_F))
+               / (cosDec * cosf(latitude * DEG_TO_RAD_F));
+    if (cosH > 1.0f) {
+        return SOLAR_NEVER_RISES;
+    }
+    if (cosH < -1.0f) {
+        return SOLAR_NEVER_SETS;
+    }
+    
+    float h = RAD_TO_DEG_F * acosf(cosH);
+    if (sunrise) {
+        h = 360.0f - h;
+    }
+    h /= 15.0f;
+    
+    // Local mean time of the event, converted to UTC
+    float localMean = h + ra - 0.06571f * t - 6.622f;
+    float ut = wrap(localMean - lngHour, 24.0f);
+    return (int16_t)(ut * 60.0f + 0.5f) % 1440;
+}
@@ -0,0 +1,43 @@
+/**
+ * SolarTime.h - Offline sunrise/sunset and calendar helpers
+ * 
+ * Uses the sunrise equation from the Almanac for Computers, which is
+ * accurate to a minute or two for latitudes below the polar circles and
+ * needs no network access or lookup tables.
+ */
+
+#ifndef SOLAR_TIME_H
+#define SOLAR_TIME_H
+
+#include <stdint.h>
+
+// Result values when the sun does not rise or set on a given day
+#define SOLAR_NEVER_RISES  (-1)
+#define SOLAR_NEVER_SETS   (-2)
+
+// Calendar date
+struct CivilDate {
+  int32_t year;
+  uint8_t month;      // 1-12
+  uint8_t day;        // 1-31
+  uint8_t weekday;    // 0 = Sunday
+  uint16_t dayOfYear; // 1-366
+};
+
+/**
+ * Convert a day count since 1970-01-01 to a calendar date
+ */
+CivilDate solarCivilFromDays(int32_t days);
+
+/**
+ * Compute sunrise or sunset for a date
+ * 
+ * @param dayOfYear Day of the year (1-366)
+ * @param latitude Latitude in degrees (north positive)
+ * @param longitude Longitude in degrees (east positive)
+ * @param sunrise True for sunrise, false for sunset
+ * @return Minutes after midnight UTC (0-1439), or SOLAR_NEVER_RISES / SOLAR_NEVER_SETS
+ */
+int16_t solarEventUtcMinutes(uint16_t dayOfYear, float latitude, float longitude, bool sunrise);
+
+#endif // SOLAR_TIME_H
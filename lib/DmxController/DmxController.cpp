@@ -24,6 +24,9 @@ DmxController::DmxController(uint8_t dmxPort, uint8_t txPin, uint8_t rxPin, uint
     _fixtures = NULL;
     _numFixtures = 0;
     _channelsPerFixture = 0;
+    _intensity = NULL;
+    _intensityActive = false;
+    memset(_groupMasks, 0, sizeof(_groupMasks));
     
     // Initialize scanner variables
     _scanCurrentAddr = 1;
@@ -45,9 +48,9 @@ void DmxController::begin() {
     _dmxData[0] = 0; // Start code must be 0
     
     // Always properly delete any previous driver to avoid "already installed" error
-    // We'll ignore any errors here since it might not be installed yet
+    // We'll ignore any errors here since it might not be installed yet. The
+    // output below drives the UART directly, so there is nothing to wait for
     dmx_driver_delete((dmx_port_t)_dmxPort);
-    delay(500); // Give it time to fully uninstall
     
     Serial.println("Installing DMX driver with hardware UART...");
     
@@ -77,6 +80,9 @@ void DmxController::initializeFixtures(int numFixtures, int channelsPerFixture)
     if (_fixtures != NULL) {
         delete[] _fixtures;
     }
+    if (_intensity != NULL) {
+        delete[] _intensity;
+    }
     
     // Store configuration
     _numFixtures = numFixtures;
@@ -85,6 +91,19 @@ void DmxController::initializeFixtures(int numFixtures, int channelsPerFixture)
     // Allocate new array
     _fixtures = new FixtureConfig[numFixtures];
     
+    // All fixtures start at full intensity
+    _intensity = new uint8_t[numFixtures];
+    memset(_intensity, 255, numFixtures);
+    _intensityActive = false;
+    
+    // Positions are optional, start with none
+    for (int i = 0; i < numFixtures; i++) {
+        _fixtures[i].hasPosition = false;
+        _fixtures[i].x = 0;
+        _fixtures[i].y = 0;
+        _fixtures[i].z = 0;
+    }
+    
     Serial.print("Initialized for ");
     Serial.print(numFixtures);
     Serial.print(" fixtures with ");
@@ -120,6 +139,52 @@ void DmxController::setFixtureConfig(int index, const char* name, int startAddr,
     }
 }
 
+// Set fixture position
+void DmxController::setFixturePosition(int index, int16_t x, int16_t y, int16_t z) {
+    if (index >= 0 && index < _numFixtures && _fixtures != NULL) {
+        _fixtures[index].hasPosition = true;
+        _fixtures[index].x = x;
+        _fixtures[index].y = y;
+        _fixtures[index].z = z;
+    }
+}
+
+// Define group membership
+void DmxController::setGroupMask(uint8_t group, uint32_t mask) {
+    if (group < DMX_MAX_GROUPS) {
+        _groupMasks[group] = mask;
+    }
+}
+
+// Get group membership
+uint32_t DmxController::getGroupMask(uint8_t group) {
+    if (group == DMX_GROUP_ALL) {
+        return _numFixtures >= 32 ? 0xFFFFFFFFUL : ((1UL << _numFixtures) - 1);
+    }
+    if (group < DMX_MAX_GROUPS) {
+        return _groupMasks[group];
+    }
+    return 0;
+}
+
+// Set a fixture's output intensity
+void DmxController::setFixtureIntensity(int fixtureIndex, uint8_t level) {
+    if (fixtureIndex >= 0 && fixtureIndex < _numFixtures && _intensity != NULL) {
+        _intensity[fixtureIndex] = level;
+        if (level < 255) {
+            _intensityActive = true;
+        }
+    }
+}
+
+// Reset all intensities
+void DmxController::clearFixtureIntensity() {
+    if (_intensity != NULL) {
+        memset(_intensity, 255, _numFixtures);
+    }
+    _intensityActive = false;
+}
+
 // Get a fixture's configuration
 FixtureConfig* DmxController::getFixture(int index) {
     if (index >= 0 && index < _numFixtures && _fixtures != NULL) {
@@ -149,6 +214,22 @@ void DmxController::setManualFixtureColor(int startAddr, uint8_t r, uint8_t g, u
     _dmxData[startAddr + 3] = w; // White channel
 }
 
+// Set the colors of consecutive fixtures from an array
+void DmxController::setFixtureColors(const RgbwColor* colors, int count, int firstFixture) {
+    if (colors == NULL || _fixtures == NULL || firstFixture < 0 || firstFixture >= _numFixtures) {
+        return;
+    }
+    
+    count = min(count, _numFixtures - firstFixture);
+    for (int i = 0; i < count; i++) {
+        const FixtureConfig& fixture = _fixtures[firstFixture + i];
+        _dmxData[fixture.redChannel] = colors[i].r;
+        _dmxData[fixture.greenChannel] = colors[i].g;
+        _dmxData[fixture.blueChannel] = colors[i].b;
+        _dmxData[fixture.whiteChannel] = colors[i].w;
+    }
+}
+
 // Send the current DMX data to the fixtures
 void DmxController::sendData() {
     // Ensure DMX start code is 0
@@ -181,8 +262,23 @@ void DmxController::sendData() {
         Serial1.flush();                // Wait for completion
         Serial1.updateBaudRate(250000); // Restore DMX baud rate (standard)
         
+        // Apply fixture intensities to a copy so the stored frame is untouched
+        const uint8_t* frame = _dmxData;
+        if (_intensityActive && _fixtures != NULL) {
+            memcpy(_outputData, _dmxData, DMX_PACKET_SIZE);
+            for (int i = 0; i < _numFixtures; i++) {
+                uint16_t level = _intensity[i];
+                if (level == 255) continue;
+                _outputData[_fixtures[i].redChannel] = (_dmxData[_fixtures[i].redChannel] * level) / 255;
+                _outputData[_fixtures[i].greenChannel] = (_dmxData[_fixtures[i].greenChannel] * level) / 255;
+                _outputData[_fixtures[i].blueChannel] = (_dmxData[_fixtures[i].blueChannel] * level) / 255;
+                _outputData[_fixtures[i].whiteChannel] = (_dmxData[_fixtures[i].whiteChannel] * level) / 255;
+            }
+            frame = _outputData;
+        }
+        
         // Send DMX data - all 513 bytes (start code + 512 channels)
-        Serial1.write(_dmxData, DMX_PACKET_SIZE);
+        Serial1.write(frame, DMX_PACKET_SIZE);
         Serial1.flush();                // Ensure all data is completely sent
         
         // Wait longer to ensure data is fully transmitted (helps with stability)
@@ -742,6 +838,18 @@ void DmxController::updateRainbowStep(uint32_t step, bool staggered) {
     // This just updates the DMX buffer with new values
 }
 
+// Render a single step of the rainbow pattern into a color array
+void DmxController::renderRainbowStep(uint32_t step, bool staggered, RgbwColor* colors) {
+    if (_fixtures == NULL || _numFixtures <= 0 || colors == NULL) {
+        return;
+    }
+    
+    for (int i = 0; i < _numFixtures; i++) {
+        uint8_t hue = (step + (staggered ? (i * 256 / _numFixtures) : 0)) % 256;
+        colors[i] = hsvToRgb(hue, 255, 255);
+    }
+}
+
 // Run a strobe test pattern on all fixtures
 void DmxController::runStrobeTest(uint8_t color, int count, int onTimeMs, int offTimeMs, bool alternate) {
     if (_fixtures == NULL || _numFixtures <= 0) {
@@ -759,24 +867,9 @@ void DmxController::runStrobeTest(uint8_t color, int count, int onTimeMs, int of
     Serial.print("ms off time. Mode: ");
     Serial.println(alternate ? "Alternating" : "All fixtures");
     
-    // Create arrays for color values
-    uint8_t rValues[4] = {255, 255, 0, 0};     // White, Red, Green, Blue
-    uint8_t gValues[4] = {255, 0, 255, 0};     // White, Red, Green, Blue
-    uint8_t bValues[4] = {255, 0, 0, 255};     // White, Red, Green, Blue
-    uint8_t wValues[4] = {255, 0, 0, 0};       // Only White uses W channel
-    
-    // Ensure color selection is within bounds
-    color = min(color, (uint8_t)3);
-    
-    // Store selected color values
-    uint8_t r = rValues[color];
-    uint8_t g = gValues[color];
-    uint8_t b = bValues[color];
-    uint8_t w = wValues[color];
-    
     // Print selected color
     Serial.print("Strobe color: ");
-    switch(color) {
+    switch(min(color, (uint8_t)3)) {
         case 0: Serial.println("WHITE"); break;
         case 1: Serial.println("RED"); break;
         case 2: Serial.println("GREEN"); break;
@@ -785,28 +878,7 @@ void DmxController::runStrobeTest(uint8_t color, int count, int onTimeMs, int of
     
     // Run the strobe pattern
     for (int i = 0; i < count; i++) {
-        // Clear all channels first
-        clearAllChannels();
-        
-        // Set the fixture colors based on the selected mode
-        if (alternate) {
-            // Alternating mode: turn on either odd or even fixtures
-            bool evenPhase = (i % 2 == 0);
-            
-            for (int f = 0; f < _numFixtures; f++) {
-                bool isEvenFixture = (f % 2 == 0);
-                
-                // Only light up fixtures that match the current phase
-                if (isEvenFixture == evenPhase) {
-                    setFixtureColor(f, r, g, b, w);
-                }
-            }
-        } else {
-            // All fixtures mode: turn on all fixtures
-            for (int f = 0; f < _numFixtures; f++) {
-                setFixtureColor(f, r, g, b, w);
-            }
-        }
+        setStrobeFlash(color, i, true, alternate);
         
         // Send the DMX data for "on" phase
         sendData();
@@ -823,7 +895,7 @@ void DmxController::runStrobeTest(uint8_t color, int count, int onTimeMs, int of
         delay(onTimeMs);
         
         // Turn all fixtures off
-        clearAllChannels();
+        setStrobeFlash(color, i, false, alternate);
         sendData();
         
         // Wait for the "off" time
@@ -837,6 +909,30 @@ void DmxController::runStrobeTest(uint8_t color, int count, int onTimeMs, int of
     Serial.println("Strobe test pattern complete!");
 }
 
+// Set the fixtures for one phase of a strobe flash
+void DmxController::setStrobeFlash(uint8_t color, int flash, bool on, bool alternate) {
+    // Clear all channels first
+    clearAllChannels();
+    if (!on) {
+        return;
+    }
+    
+    // White, Red, Green, Blue; only white uses the W channel
+    static const uint8_t rValues[4] = {255, 255, 0, 0};
+    static const uint8_t gValues[4] = {255, 0, 255, 0};
+    static const uint8_t bValues[4] = {255, 0, 0, 255};
+    static const uint8_t wValues[4] = {255, 0, 0, 0};
+    color = min(color, (uint8_t)3);
+    
+    // Alternating mode: turn on either odd or even fixtures
+    bool evenPhase = (flash % 2 == 0);
+    for (int f = 0; f < _numFixtures; f++) {
+        if (!alternate || (f % 2 == 0) == evenPhase) {
+            setFixtureColor(f, rValues[color], gValues[color], bValues[color], wValues[color]);
+        }
+    }
+}
+
 // Helper function to blink an LED a specific number of times
 void DmxController::blinkLED(int ledPin, int times, int delayMs) {
     for (int i = 0; i < times; i++) {
@@ -847,97 +943,128 @@ void DmxController::blinkLED(int ledPin, int times, int delayMs) {
     }
 }
 
-// Save the current DMX settings to persistent storage
-bool DmxController::saveSettings() {
-    // Open the preferences with the namespace "dmx_settings"
-    if (!_preferences.begin("dmx_settings", false)) {
-        Serial.println("Failed to open preferences");
+// Bytes per fixture in an exported patch
+#define PATCH_FIXTURE_SIZE 17
+
+static void putU16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static uint16_t getU16(const uint8_t* in) {
+    return in[0] | (in[1] << 8);
+}
+
+// Serialize the patch: fixture addresses, channels, positions and groups
+size_t DmxController::exportPatch(uint8_t* out, size_t capacity) const {
+    size_t size = 2 + (size_t)_numFixtures * PATCH_FIXTURE_SIZE + DMX_MAX_GROUPS * 4;
+    if (size > capacity || _numFixtures > 255 || _channelsPerFixture > 255) {
+        return 0;
+    }
+
+    uint8_t* p = out;
+    *p++ = _numFixtures;
+    *p++ = _channelsPerFixture;
+    for (int i = 0; i < _numFixtures; i++) {
+        const FixtureConfig& f = _fixtures[i];
+        putU16(p, f.startAddr);
+        putU16(p + 2, f.redChannel);
+        putU16(p + 4, f.greenChannel);
+        putU16(p + 6, f.blueChannel);
+        putU16(p + 8, f.whiteChannel);
+        p[10] = f.hasPosition ? 1 : 0;
+        putU16(p + 11, (uint16_t)f.x);
+        putU16(p + 13, (uint16_t)f.y);
+        putU16(p + 15, (uint16_t)f.z);
+        p += PATCH_FIXTURE_SIZE;
+    }
+    for (int g = 0; g < DMX_MAX_GROUPS; g++) {
+        putU16(p, _groupMasks[g] & 0xFFFF);
+        putU16(p + 2, _groupMasks[g] >> 16);
+        p += 4;
+    }
+    return size;
+}
+
+// Restore a patch written by exportPatch
+bool DmxController::importPatch(const uint8_t* data, size_t length) {
+    if (length < 2) {
         return false;
     }
-    
-    // Store the number of fixtures and channels per fixture for validation on load
-    _preferences.putInt("num_fixtures", _numFixtures);
-    _preferences.putInt("chan_per_fix", _channelsPerFixture);
-    
-    // Create a buffer for the DMX data (excluding the start code)
-    size_t dataSize = DMX_PACKET_SIZE - 1;  // Exclude the start code
-    
-    // Store the DMX data (excluding the start code at index 0)
-    _preferences.putBytes("dmx_data", &_dmxData[1], dataSize);
-    
-    // Store fixture configurations
-    if (_fixtures != NULL && _numFixtures > 0) {
-        for (int i = 0; i < _numFixtures; i++) {
-            char keyBuffer[32]; // Buffer for storing key names
-            
-            // Format key names using snprintf
-            snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_addr", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].startAddr);
-            
-            snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_red", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].redChannel);
-            
-            snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_green", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].greenChannel);
-            
-            snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_blue", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].blueChannel);
-            
-            snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_white", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].whiteChannel);
-            // We can't store the name directly as it's a char* pointer
-        }
+    int numFixtures = data[0];
+    int channelsPerFixture = data[1];
+    if (length != 2 + (size_t)numFixtures * PATCH_FIXTURE_SIZE + DMX_MAX_GROUPS * 4) {
+        return false;
+    }
+
+    initializeFixtures(numFixtures, channelsPerFixture);
+    const uint8_t* p = data + 2;
+    for (int i = 0; i < numFixtures; i++) {
+        FixtureConfig& f = _fixtures[i];
+        f.name = "Fixture";  // Names are not stored
+        f.startAddr = getU16(p);
+        f.redChannel = getU16(p + 2);
+        f.greenChannel = getU16(p + 4);
+        f.blueChannel = getU16(p + 6);
+        f.whiteChannel = getU16(p + 8);
+        f.hasPosition = p[10] != 0;
+        f.x = (int16_t)getU16(p + 11);
+        f.y = (int16_t)getU16(p + 13);
+        f.z = (int16_t)getU16(p + 15);
+        p += PATCH_FIXTURE_SIZE;
+    }
+    for (int g = 0; g < DMX_MAX_GROUPS; g++) {
+        _groupMasks[g] = getU16(p) | ((uint32_t)getU16(p + 2) << 16);
+        p += 4;
     }
-    
-    _preferences.end();
-    Serial.println("DMX settings saved to persistent storage");
     return true;
 }
 
-// Load DMX settings from persistent storage
-bool DmxController::loadSettings() {
-    bool settingsLoaded = false;
-    
-    // Open the preferences with the namespace "dmx_settings"
+// Load settings stored as separate keys by older firmware
+bool DmxController::loadLegacySettings() {
     if (!_preferences.begin("dmx_settings", true)) {
-        Serial.println("Failed to open preferences");
         return false;
     }
     
-    // Check if we have saved settings
+    bool loaded = false;
     if (_preferences.isKey("dmx_data")) {
-        // Validate the number of fixtures and channels per fixture
+        // Restore the saved patch, then the frame that goes with it
         int savedNumFixtures = _preferences.getInt("num_fixtures", 0);
         int savedChannelsPerFixture = _preferences.getInt("chan_per_fix", 0);
-        
-        // Only load if the configuration is compatible
-        if (savedNumFixtures == _numFixtures && savedChannelsPerFixture == _channelsPerFixture) {
-            // Create a buffer for the DMX data (excluding the start code)
-            size_t dataSize = DMX_PACKET_SIZE - 1;  // Exclude the start code
-            
-            // Load the DMX data (excluding the start code at index 0)
-            _preferences.getBytes("dmx_data", &_dmxData[1], dataSize);
-            
-            // Ensure the start code is 0
-            _dmxData[0] = 0;
-            
-            Serial.println("DMX settings loaded from persistent storage");
-            settingsLoaded = true;
-        } else {
-            Serial.println("Saved DMX configuration is incompatible with current setup");
+        if (savedNumFixtures > 0 && savedNumFixtures <= 255 && _preferences.isKey("fix_0_addr")) {
+            initializeFixtures(savedNumFixtures, savedChannelsPerFixture);
+            for (int i = 0; i < savedNumFixtures; i++) {
+                char keyBuffer[32];
+                FixtureConfig& f = _fixtures[i];
+                f.name = "Fixture";
+                snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_addr", i);
+                f.startAddr = _preferences.getInt(keyBuffer, 0);
+                snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_red", i);
+                f.redChannel = _preferences.getInt(keyBuffer, 0);
+                snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_green", i);
+                f.greenChannel = _preferences.getInt(keyBuffer, 0);
+                snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_blue", i);
+                f.blueChannel = _preferences.getInt(keyBuffer, 0);
+                snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_white", i);
+                f.whiteChannel = _preferences.getInt(keyBuffer, 0);
+            }
         }
-    } else {
-        Serial.println("No saved DMX settings found");
+        
+        // The frame excludes the start code at index 0
+        loaded = _preferences.getBytes("dmx_data", &_dmxData[1], DMX_PACKET_SIZE - 1) == DMX_PACKET_SIZE - 1;
+        _dmxData[0] = 0;
     }
     
     _preferences.end();
-    
-    // If no settings were loaded, set the default white color
-    if (!settingsLoaded) {
-        setDefaultWhite();
+    return loaded;
+}
+
+// Remove the old keys once their contents are stored in the new layout
+void DmxController::clearLegacySettings() {
+    if (_preferences.begin("dmx_settings", false)) {
+        _preferences.clear();
+        _preferences.end();
     }
-    
-    return settingsLoaded;
 }
 
 // Set all fixtures to default white color
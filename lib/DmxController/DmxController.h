@@ -12,7 +12,7 @@
 
 #include <Arduino.h>
 #include <esp_dmx.h>
-#include <Preferences.h>  // For persistent storage
+#include <Preferences.h>  // For settings stored by older firmware
 
 // Add the DMX_INTR_FLAGS_DEFAULT definition if it's not already included
 #ifndef DMX_INTR_FLAGS_DEFAULT
@@ -22,6 +22,8 @@
 // DMX configuration
 #define DMX_PACKET_SIZE 513  // DMX packet size (512 channels + start code)
 #define DMX_TIMEOUT_TICK 100 // Timeout for DMX operations
+#define DMX_MAX_GROUPS 8     // Number of fixture groups
+#define DMX_GROUP_ALL 0xFF   // Group ID that addresses every fixture
 
 // Fixture configuration structure
 struct FixtureConfig {
@@ -31,6 +33,10 @@ struct FixtureConfig {
   int greenChannel;
   int blueChannel;
   int whiteChannel;
+  bool hasPosition;   // True if x/y/z have been set
+  int16_t x;          // Optional position in the rig (any consistent unit)
+  int16_t y;
+  int16_t z;
 };
 
 // Simple color structure for RGBW
@@ -84,6 +90,15 @@ public:
      * @param w White value (0-255), defaults to 0
      */
     void setManualFixtureColor(int startAddr, uint8_t r, uint8_t g, uint8_t b, uint8_t w = 0);
+    
+    /**
+     * Set the colors of consecutive fixtures from an array
+     * 
+     * @param colors One RGBW color per fixture
+     * @param count Number of colors (clamped to the number of fixtures)
+     * @param firstFixture Index of the fixture that gets the first color
+     */
+    void setFixtureColors(const RgbwColor* colors, int count, int firstFixture = 0);
 
     /**
      * Initialize the fixtures array with default values
@@ -135,6 +150,45 @@ public:
     void setFixtureConfig(int index, const char* name, int startAddr, 
                          int rChan, int gChan, int bChan, int wChan);
 
+    /**
+     * Set a fixture's position in the rig for spatial effects
+     * 
+     * @param index Index in fixtures array
+     * @param x X coordinate
+     * @param y Y coordinate
+     * @param z Z coordinate, defaults to 0 for flat rigs
+     */
+    void setFixturePosition(int index, int16_t x, int16_t y, int16_t z = 0);
+
+    /**
+     * Define the fixtures that belong to a group
+     * 
+     * @param group Group ID (0 to DMX_MAX_GROUPS - 1)
+     * @param mask Fixture bitmask, bit 0 = fixture index 0
+     */
+    void setGroupMask(uint8_t group, uint32_t mask);
+
+    /**
+     * Get the fixture bitmask of a group
+     * DMX_GROUP_ALL returns a mask of all fixtures, unknown groups return 0
+     */
+    uint32_t getGroupMask(uint8_t group);
+
+    /**
+     * Set the output intensity of a fixture
+     * Intensity scales the fixture's RGBW channels when the frame is sent,
+     * without changing the stored DMX data
+     * 
+     * @param fixtureIndex Index of the fixture in the fixtures array
+     * @param level Intensity (0-255, 255 = full)
+     */
+    void setFixtureIntensity(int fixtureIndex, uint8_t level);
+
+    /**
+     * Reset all fixture intensities to full
+     */
+    void clearFixtureIntensity();
+
     /**
      * Get the number of configured fixtures
      */
@@ -176,6 +230,16 @@ public:
      * Thread-safe version for use with FreeRTOS tasks
      */
     void updateRainbowStep(uint32_t step, bool staggered = true);
+    
+    /**
+     * Render a single step of the rainbow animation into a color array
+     * Produces the same colors as updateRainbowStep without touching the DMX data
+     * 
+     * @param step Animation step (one hue period is 256 steps)
+     * @param staggered Shift the hue across fixtures
+     * @param colors Output array with one entry per fixture
+     */
+    void renderRainbowStep(uint32_t step, bool staggered, RgbwColor* colors);
 
     /**
      * Run a strobe test pattern on all fixtures
@@ -188,6 +252,17 @@ public:
      */
     void runStrobeTest(uint8_t color = 0, int count = 20, int onTimeMs = 50, int offTimeMs = 50, bool alternate = false);
 
+    /**
+     * Set the fixtures for one phase of a strobe flash
+     * Updates the DMX buffer only, for stepping the strobe without blocking
+     * 
+     * @param color Color to use for the strobe (0=white, 1=red, 2=green, 3=blue)
+     * @param flash Index of the flash (selects the fixtures in alternate mode)
+     * @param on true for the "on" phase, false to turn everything off
+     * @param alternate If true, light odd and even fixtures on alternate flashes
+     */
+    void setStrobeFlash(uint8_t color, int flash, bool on, bool alternate);
+
     /**
      * Helper function to blink an LED a specific number of times
      * 
@@ -198,20 +273,33 @@ public:
     static void blinkLED(int ledPin, int times, int delayMs);
 
     /**
-     * Save the current DMX settings to persistent storage
-     * This saves the current state of all DMX channels
+     * Serialize the patch: fixture addresses, channels, positions and
+     * groups (fixture names are not included)
+     * 
+     * @param out Output buffer
+     * @param capacity Size of the buffer
+     * @return Bytes written, 0 if the patch does not fit
+     */
+    size_t exportPatch(uint8_t* out, size_t capacity) const;
+
+    /**
+     * Restore a patch written by exportPatch
      * 
-     * @return True if saved successfully
+     * @return True if the data was a valid patch
      */
-    bool saveSettings();
+    bool importPatch(const uint8_t* data, size_t length);
 
     /**
-     * Load DMX settings from persistent storage
-     * If no settings exist, default to white
+     * Load the patch and frame stored as separate keys by older firmware
      * 
-     * @return True if settings were loaded, false if defaults were used
+     * @return True if a saved frame was found
+     */
+    bool loadLegacySettings();
+
+    /**
+     * Remove the keys read by loadLegacySettings
      */
-    bool loadSettings();
+    void clearLegacySettings();
 
     /**
      * Set all fixtures to default white color
@@ -224,12 +312,16 @@ private:
     uint8_t _rxPin;
     uint8_t _dirPin;
     uint8_t _dmxData[DMX_PACKET_SIZE];  // Array to hold DMX data
+    uint8_t _outputData[DMX_PACKET_SIZE]; // Frame after intensity scaling
     bool _isInitialized = false;        // Flag indicating if DMX is properly initialized
-    Preferences _preferences;           // Preferences instance for storing settings
+    Preferences _preferences;           // Preferences instance for legacy settings
     
     FixtureConfig* _fixtures;  // Dynamic array of fixture configurations
     int _numFixtures;          // Number of fixtures
     int _channelsPerFixture;   // Number of channels per fixture
+    uint8_t* _intensity;       // Per-fixture output intensity
+    bool _intensityActive;     // True if any intensity is below full
+    uint32_t _groupMasks[DMX_MAX_GROUPS]; // Fixture bitmask per group
 
     // Internal counter for scanner function
     int _scanCurrentAddr;
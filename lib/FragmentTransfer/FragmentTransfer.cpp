@@ -0,0 +1,203 @@
+/**
+ * FragmentTransfer.cpp - Reassembly of payloads too large for one downlink
+ */
+
+#include "FragmentTransfer.h"
+#include <rom/crc.h>
+
+#define FLASH_SECTOR_SIZE 4096
+
+FragmentTransfer::FragmentTransfer()
+    : _partition(NULL), _active(false), _session(0), _content(0), _size(0), _crc(0),
+      _fragmentSize(0), _parityCount(0), _fragmentCount(0), _received(0), _recovered(0),
+      _parityReceived(0) {
+}
+
+bool FragmentTransfer::begin(uint8_t session, uint8_t content, uint32_t size, uint8_t fragmentSize,
+                             uint8_t parityCount, uint32_t crc) {
+    _active = false;
+
+    if (size == 0 || size > FRAG_MAX_SIZE || fragmentSize == 0 || fragmentSize > FRAG_MAX_FRAGMENT_SIZE ||
+        parityCount > FRAG_MAX_PARITY) {
+        Serial.println("Fragment session parameters out of range");
+        return false;
+    }
+    uint32_t fragmentCount = (size + fragmentSize - 1) / fragmentSize;
+    if (fragmentCount > FRAG_MAX_FRAGMENTS) {
+        Serial.println("Fragment session has too many fragments");
+        return false;
+    }
+
+    // Reassemble into the data partition of the default partition table
+    if (_partition == NULL) {
+        _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+    }
+    if (_partition == NULL || _partition->size < size) {
+        Serial.println("No flash area for fragmented transfers");
+        return false;
+    }
+
+    uint32_t eraseSize = (size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+    if (esp_partition_erase_range(_partition, 0, eraseSize) != ESP_OK) {
+        Serial.println("Failed to erase transfer area");
+        return false;
+    }
+
+    _session = session;
+    _content = content;
+    _size = size;
+    _crc = crc;
+    _fragmentSize = fragmentSize;
+    _parityCount = parityCount;
+    _fragmentCount = fragmentCount;
+    _received = 0;
+    _recovered = 0;
+    _parityReceived = 0;
+    memset(_bitmap, 0, sizeof(_bitmap));
+    memset(_groupXor, 0, sizeof(_groupXor));
+    for (uint32_t p = 0; p < parityCount; p++) {
+        // Groups are data indices p, p + P, p + 2P, ...
+        _groupMissing[p] = fragmentCount > p ? (fragmentCount - p + parityCount - 1) / parityCount : 0;
+    }
+    _active = true;
+
+    Serial.print("Fragment session ");
+    Serial.print(session);
+    Serial.print(": ");
+    Serial.print(size);
+    Serial.print(" bytes in ");
+    Serial.print(fragmentCount);
+    Serial.print(" fragments of ");
+    Serial.print(fragmentSize);
+    Serial.print(", ");
+    Serial.print(parityCount);
+    Serial.println(" parity");
+    return true;
+}
+
+bool FragmentTransfer::isSameSession(uint8_t session, uint32_t size, uint8_t fragmentSize,
+                                     uint8_t parityCount, uint32_t crc) const {
+    return _active && _session == session && _size == size && _fragmentSize == fragmentSize &&
+           _parityCount == parityCount && _crc == crc;
+}
+
+bool FragmentTransfer::hasFragment(uint32_t index) const {
+    return index < _fragmentCount && (_bitmap[index >> 3] & (1 << (index & 7)));
+}
+
+FragmentResult FragmentTransfer::addFragment(uint8_t session, uint32_t index, const uint8_t* data, size_t length) {
+    if (!_active || session != _session || length != _fragmentSize || index >= (uint32_t)_fragmentCount + _parityCount) {
+        return FRAG_REJECTED;
+    }
+    if (isComplete()) {
+        return FRAG_DUPLICATE;
+    }
+
+    if (index >= _fragmentCount) {
+        // Parity fragment
+        uint32_t group = index - _fragmentCount;
+        if (_parityReceived & (1 << group)) {
+            return FRAG_DUPLICATE;
+        }
+        _parityReceived |= 1 << group;
+        xorIntoGroup(group, data);
+        tryRecover(group);
+    } else {
+        if (hasFragment(index)) {
+            return FRAG_DUPLICATE;
+        }
+        if (!storeFragment(index, data)) {
+            return FRAG_REJECTED;
+        }
+        if (_parityCount > 0) {
+            uint32_t group = index % _parityCount;
+            xorIntoGroup(group, data);
+            _groupMissing[group]--;
+            tryRecover(group);
+        }
+    }
+
+    if (!isComplete()) {
+        return FRAG_ACCEPTED;
+    }
+    return verify() ? FRAG_COMPLETE : FRAG_CORRUPT;
+}
+
+void FragmentTransfer::abort() {
+    _active = false;
+}
+
+// Write a data fragment to its place in flash (the padding of the last one is dropped)
+bool FragmentTransfer::storeFragment(uint32_t index, const uint8_t* data) {
+    uint32_t offset = index * _fragmentSize;
+    uint32_t length = min((uint32_t)_fragmentSize, _size - offset);
+    if (esp_partition_write(_partition, offset, data, length) != ESP_OK) {
+        Serial.println("Failed to write fragment to flash");
+        return false;
+    }
+    _bitmap[index >> 3] |= 1 << (index & 7);
+    _received++;
+    return true;
+}
+
+void FragmentTransfer::xorIntoGroup(uint32_t group, const uint8_t* data) {
+    uint8_t* acc = _groupXor[group];
+    for (uint32_t i = 0; i < _fragmentSize; i++) {
+        acc[i] ^= data[i];
+    }
+}
+
+// With the parity and all but one data fragment of a group, the XOR is the missing fragment
+void FragmentTransfer::tryRecover(uint32_t group) {
+    if (!(_parityReceived & (1 << group)) || _groupMissing[group] != 1) {
+        return;
+    }
+
+    for (uint32_t index = group; index < _fragmentCount; index += _parityCount) {
+        if (!hasFragment(index)) {
+            if (storeFragment(index, _groupXor[group])) {
+                _groupMissing[group] = 0;
+                _recovered++;
+                Serial.print("Fragment ");
+                Serial.print(index);
+                Serial.println(" rebuilt from parity");
+            }
+            return;
+        }
+    }
+}
+
+// Check the reassembled payload against the CRC from the setup message
+bool FragmentTransfer::verify() {
+    uint8_t buffer[256];
+    uint32_t crc = 0;
+    for (uint32_t offset = 0; offset < _size; offset += sizeof(buffer)) {
+        uint32_t length = min((uint32_t)sizeof(buffer), _size - offset);
+        if (esp_partition_read(_partition, offset, buffer, length) != ESP_OK) {
+            return false;
+        }
+        crc = crc32_le(crc, buffer, length);
+    }
+    if (crc != _crc) {
+        Serial.print("Fragmented payload CRC mismatch: 0x");
+        Serial.println(crc, HEX);
+        _active = false;
+        return false;
+    }
+    return true;
+}
+
+const uint8_t* FragmentTransfer::map(spi_flash_mmap_handle_t& handle) {
+    if (!isComplete()) {
+        return NULL;
+    }
+    const void* ptr = NULL;
+    if (esp_partition_mmap(_partition, 0, _size, SPI_FLASH_MMAP_DATA, &ptr, &handle) != ESP_OK) {
+        return NULL;
+    }
+    return (const uint8_t*)ptr;
+}
+
+void FragmentTransfer::unmap(spi_flash_mmap_handle_t handle) {
+    spi_flash_munmap(handle);
+}
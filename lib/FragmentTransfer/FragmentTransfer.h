@@ -0,0 +1,151 @@
+/**
+ * FragmentTransfer.h - Reassembly of payloads too large for one downlink
+ * 
+ * Modelled on the LoRaWAN Fragmented Data Block Transport: the server
+ * announces a session (total size, fragment size, parity count and CRC),
+ * then sends numbered fragments on FRAGMENT_PORT in any order. Each data
+ * fragment is written straight to its place in flash, so the payload can
+ * be far larger than RAM allows.
+ * 
+ * Forward error correction uses interleaved XOR parity: with P parity
+ * fragments, parity fragment p is the XOR of every data fragment i with
+ * i % P == p. One lost data fragment per parity group is rebuilt without
+ * a retransmission, so bursts of up to P consecutive losses are repaired.
+ * 
+ * Payload layout (fPort 3):
+ *   [FRAG_OP_SETUP] session, type, varint size, fragment size, parity count, CRC32 (LE)
+ *   [FRAG_OP_DATA] session, varint index, fragment bytes
+ *   [FRAG_OP_STATUS] session                     request a status uplink
+ *   [FRAG_OP_ABORT] session
+ * 
+ * Indices 0 to N-1 are data fragments (the last one zero-padded),
+ * N to N+P-1 are parity fragments.
+ */
+
+#ifndef FRAGMENT_TRANSFER_H
+#define FRAGMENT_TRANSFER_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#define FRAGMENT_PORT 3             // fPort that carries fragmentation messages
+#define FRAG_MAX_FRAGMENT_SIZE 240  // Largest fragment (a downlink minus the header)
+#define FRAG_MAX_FRAGMENTS 1024     // Data fragments per session
+#define FRAG_MAX_PARITY 8           // Parity fragments per session
+#define FRAG_MAX_SIZE (64 * 1024)   // Largest reassembled payload
+
+// Message opcodes
+enum FragmentOpcode {
+    FRAG_OP_SETUP = 0x01,
+    FRAG_OP_DATA = 0x02,
+    FRAG_OP_STATUS = 0x03,
+    FRAG_OP_ABORT = 0x04
+};
+
+// What the reassembled payload contains
+enum FragmentContent {
+    FRAG_CONTENT_BINARY = 0,    // A binary command payload, as on BINARY_PROTOCOL_PORT
+    FRAG_CONTENT_JSON = 1       // JSON commands, one per line
+};
+
+// Result of adding a fragment
+enum FragmentResult {
+    FRAG_REJECTED,      // Wrong session, bad index or size, or flash error
+    FRAG_DUPLICATE,     // Already received or rebuilt
+    FRAG_ACCEPTED,      // Stored, payload still incomplete
+    FRAG_COMPLETE,      // Payload complete and its CRC matches
+    FRAG_CORRUPT        // Payload complete but its CRC does not match
+};
+
+class FragmentTransfer {
+public:
+    FragmentTransfer();
+
+    /**
+     * Start a session, discarding any previous one
+     * Erases the flash area the payload will occupy
+     * 
+     * @param session Session ID
+     * @param content FragmentContent of the payload
+     * @param size Payload size in bytes
+     * @param fragmentSize Bytes per fragment
+     * @param parityCount Number of parity fragments (0 for none)
+     * @param crc CRC32 of the payload
+     * @return false if the parameters are out of range or there is no flash area
+     */
+    bool begin(uint8_t session, uint8_t content, uint32_t size, uint8_t fragmentSize,
+               uint8_t parityCount, uint32_t crc);
+
+    /**
+     * Check whether a setup message repeats the running session
+     */
+    bool isSameSession(uint8_t session, uint32_t size, uint8_t fragmentSize, uint8_t parityCount, uint32_t crc) const;
+
+    /**
+     * Add a data or parity fragment
+     * 
+     * @param session Session ID from the message
+     * @param index Fragment index
+     * @param data Fragment bytes
+     * @param length Number of bytes (must equal the fragment size)
+     * @return What happened to the fragment
+     */
+    FragmentResult addFragment(uint8_t session, uint32_t index, const uint8_t* data, size_t length);
+
+    /**
+     * End the session
+     */
+    void abort();
+
+    /**
+     * Map the completed payload into memory
+     * 
+     * @param handle Set to the mapping handle, release it with unmap()
+     * @return Pointer to the payload, or NULL if it is not complete or cannot be mapped
+     */
+    const uint8_t* map(spi_flash_mmap_handle_t& handle);
+
+    /**
+     * Release a mapping returned by map()
+     */
+    void unmap(spi_flash_mmap_handle_t handle);
+
+    bool isActive() const { return _active; }
+    bool isComplete() const { return _active && _received == _fragmentCount; }
+    uint8_t getSession() const { return _session; }
+    uint8_t getContent() const { return _content; }
+    uint32_t getSize() const { return _size; }
+    uint16_t getFragmentCount() const { return _fragmentCount; }
+    uint16_t getReceivedCount() const { return _received; }
+    uint16_t getRecoveredCount() const { return _recovered; }
+
+    /**
+     * Check whether a data fragment has been received or rebuilt
+     */
+    bool hasFragment(uint32_t index) const;
+
+private:
+    const esp_partition_t* _partition;
+    bool _active;
+    uint8_t _session;
+    uint8_t _content;
+    uint32_t _size;
+    uint32_t _crc;
+    uint8_t _fragmentSize;
+    uint8_t _parityCount;
+    uint16_t _fragmentCount;
+    uint16_t _received;
+    uint16_t _recovered;
+
+    uint8_t _bitmap[FRAG_MAX_FRAGMENTS / 8];            // Data fragments stored
+    uint8_t _parityReceived;                            // One bit per parity fragment
+    uint16_t _groupMissing[FRAG_MAX_PARITY];            // Data fragments missing per group
+    uint8_t _groupXor[FRAG_MAX_PARITY][FRAG_MAX_FRAGMENT_SIZE]; // Parity XOR received data, per group
+
+    bool storeFragment(uint32_t index, const uint8_t* data);
+    void xorIntoGroup(uint32_t group, const uint8_t* data);
+    void tryRecover(uint32_t group);
+    bool verify();
+};
+
+#endif // FRAGMENT_TRANSFER_H
@@ -0,0 +1,106 @@
+/**
+ * FrameCache.cpp - Implementation of the pre-rendered frame ring
+ */
+
+#include "FrameCache.h"
+#include <esp_heap_caps.h>
+
+// Constructor
+FrameCache::FrameCache(size_t budgetBytes) :
+    _budget(budgetBytes),
+    _frames(NULL),
+    _allocated(0),
+    _frameCount(0),
+    _fixtureCount(0),
+    _key(0),
+    _rejectedKey(0),
+    _hasRejected(false),
+    _valid(false) {
+}
+
+// Destructor
+FrameCache::~FrameCache() {
+    release();
+}
+
+// Start recording a new period
+bool FrameCache::begin(uint32_t key, uint16_t frameCount, uint16_t fixtureCount) {
+    _valid = false;
+    
+    if (_hasRejected && _rejectedKey == key) {
+        return false;
+    }
+    
+    size_t bytes = (size_t)frameCount * fixtureCount * sizeof(RgbwColor);
+    if (bytes == 0 || bytes > _budget) {
+        _rejectedKey = key;
+        _hasRejected = true;
+        Serial.print("Frame cache: period of ");
+        Serial.print(bytes);
+        Serial.println(" bytes exceeds budget, rendering live");
+        return false;
+    }
+    
+    // Reuse the current block if it is large enough
+    if (bytes > _allocated) {
+        release();
+        
+        // Prefer PSRAM so the cache does not compete with the heap
+        _frames = (RgbwColor*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (_frames == NULL) {
+            _frames = (RgbwColor*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+        }
+        if (_frames == NULL) {
+            _rejectedKey = key;
+            _hasRejected = true;
+            Serial.println("Frame cache: allocation failed, rendering live");
+            return false;
+        }
+        _allocated = bytes;
+    }
+    
+    _key = key;
+    _hasRejected = false;
+    _frameCount = frameCount;
+    _fixtureCount = fixtureCount;
+    return true;
+}
+
+// Get a frame for rendering
+RgbwColor* FrameCache::editFrame(uint16_t index) {
+    if (_frames == NULL || index >= _frameCount) {
+        return NULL;
+    }
+    return _frames + (size_t)index * _fixtureCount;
+}
+
+// Mark the recorded period as complete
+void FrameCache::commit() {
+    _valid = _frames != NULL;
+    
+    if (_valid) {
+        Serial.print("Frame cache: ");
+        Serial.print(_frameCount);
+        Serial.print(" frames cached (");
+        Serial.print((size_t)_frameCount * _fixtureCount * sizeof(RgbwColor));
+        Serial.println(" bytes)");
+    }
+}
+
+// Get a cached frame
+const RgbwColor* FrameCache::getFrame(uint32_t index) const {
+    if (!_valid) {
+        return NULL;
+    }
+    return _frames + (size_t)(index % _frameCount) * _fixtureCount;
+}
+
+// Free the memory
+void FrameCache::release() {
+    if (_frames != NULL) {
+        heap_caps_free(_frames);
+        _frames = NULL;
+    }
+    _allocated = 0;
+    _valid = false;
+}
@@ -0,0 +1,105 @@
+/**
+ * FrameCache.h - Pre-rendered frame ring for periodic effects
+ * 
+ * Periodic effects such as the rainbow or colour fade produce the same
+ * frames every cycle. The cache holds one rendered period as an array of
+ * per-fixture RGBW frames so that playback costs a copy instead of a
+ * colour conversion per fixture. Storage is taken from PSRAM when the
+ * board has it and from the heap otherwise, within a fixed memory budget;
+ * effects whose period does not fit keep rendering live.
+ */
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <Arduino.h>
+#include "DmxController.h"
+
+#define FRAME_CACHE_BUDGET (40 * 1024)  // Maximum bytes of cached frames
+
+/**
+ * Build a cache key that identifies an effect and everything its frames depend on
+ * 
+ * @param effect Effect identifier
+ * @param fixtures Number of fixtures rendered
+ * @param variant Effect option that changes the output (e.g. staggered)
+ */
+inline uint32_t frameCacheKey(uint8_t effect, uint16_t fixtures, uint8_t variant = 0) {
+    return ((uint32_t)effect << 24) | ((uint32_t)variant << 16) | fixtures;
+}
+
+class FrameCache {
+public:
+    /**
+     * Constructor
+     * 
+     * @param budgetBytes Maximum memory the cache may allocate
+     */
+    FrameCache(size_t budgetBytes = FRAME_CACHE_BUDGET);
+    ~FrameCache();
+
+    /**
+     * Start recording a new period, replacing the current contents
+     * Fails if the period exceeds the budget or memory is short; a key
+     * that failed is not retried until a different key has been used
+     * 
+     * @param key Cache key of the effect
+     * @param frameCount Number of frames in one period
+     * @param fixtureCount Number of fixtures per frame
+     * @return true if frames can be written with editFrame()
+     */
+    bool begin(uint32_t key, uint16_t frameCount, uint16_t fixtureCount);
+
+    /**
+     * Get a frame for rendering between begin() and commit()
+     */
+    RgbwColor* editFrame(uint16_t index);
+
+    /**
+     * Mark the recorded period as complete
+     */
+    void commit();
+
+    /**
+     * Check whether a complete period is cached for a key
+     */
+    bool isValid(uint32_t key) const { return _valid && _key == key; }
+
+    /**
+     * Get a cached frame; the index wraps around the period
+     */
+    const RgbwColor* getFrame(uint32_t index) const;
+
+    /**
+     * Drop the cached frames but keep the memory
+     */
+    void invalidate() { _valid = false; }
+
+    /**
+     * Drop the cached frames and free the memory
+     */
+    void release();
+
+    /**
+     * Get the number of frames in the cached period
+     */
+    uint16_t getFrameCount() const { return _frameCount; }
+
+    /**
+     * Get the number of bytes currently allocated
+     */
+    size_t getAllocatedBytes() const { return _allocated; }
+
+private:
+    size_t _budget;
+    RgbwColor* _frames;
+    size_t _allocated;
+    uint16_t _frameCount;
+    uint16_t _fixtureCount;
+    uint32_t _key;
+    uint32_t _rejectedKey;
+    bool _hasRejected;
+    bool _valid;
+};
+
+#endif // FRAME_CACHE_H
@@ -0,0 +1,167 @@
+/**
+ * FxGenerators.cpp - Implementation of the fixed-point effect generators
+ */
+
+#include "FxGenerators.h"
+
+// One period of sine, scaled to 0-255
+static const uint8_t SINE_LUT[256] = {
+    128, 131, 134, 137, 140, 143, 146, 149, 152, 155, 158, 162, 165, 167, 170, 173,
+    176, 179, 182, 185, 188, 190, 193, 196, 198, 201, 203, 206, 208, 211, 213, 215,
+    218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 238, 240, 241, 243, 244,
+    245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+    255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+    245, 244, 243, 241, 240, 238, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+    218, 215, 213, 211, 208, 206, 203, 201, 198, 196, 193, 190, 188, 185, 182, 179,
+    176, 173, 170, 167, 165, 162, 158, 155, 152, 149, 146, 143, 140, 137, 134, 131,
+    128, 124, 121, 118, 115, 112, 109, 106, 103, 100,  97,  93,  90,  88,  85,  82,
+     79,  76,  73,  70,  67,  65,  62,  59,  57,  54,  52,  49,  47,  44,  42,  40,
+     37,  35,  33,  31,  29,  27,  25,  23,  21,  20,  18,  17,  15,  14,  12,  11,
+     10,   9,   7,   6,   5,   5,   4,   3,   2,   2,   1,   1,   1,   0,   0,   0,
+      0,   0,   0,   0,   1,   1,   1,   2,   2,   3,   4,   5,   5,   6,   7,   9,
+     10,  11,  12,  14,  15,  17,  18,  20,  21,  23,  25,  27,  29,  31,  33,  35,
+     37,  40,  42,  44,  47,  49,  52,  54,  57,  59,  62,  65,  67,  70,  73,  76,
+     79,  82,  85,  88,  90,  93,  97, 100, 103, 106, 109, 112, 115, 118, 121, 124,
+};
+
+// Simplex skew factors in Q16: F2 = (sqrt(3) - 1) / 2, G2 = (3 - sqrt(3)) / 6
+#define SIMPLEX_F2_Q16 23987
+#define SIMPLEX_G2_Q16 13849
+#define SIMPLEX_G2_Q8 54
+
+// Gradient directions for simplex noise
+static const int8_t SIMPLEX_GRAD[8][2] = {
+    {1, 1}, {-1, 1}, {1, -1}, {-1, -1},
+    {1, 0}, {-1, 0}, {0, 1}, {0, -1}
+};
+
+// Sine wave with linear interpolation between LUT entries
+uint8_t fxSine8(uint16_t phase) {
+    uint8_t index = phase >> 8;
+    uint8_t frac = phase & 0xFF;
+    int16_t a = SINE_LUT[index];
+    int16_t b = SINE_LUT[(uint8_t)(index + 1)];
+    return (uint8_t)(a + (((b - a) * frac) >> 8));
+}
+
+// Triangle wave
+uint8_t fxTriangle8(uint16_t phase) {
+    uint16_t folded = (phase & 0x8000) ? (uint16_t)~phase : phase;
+    return (uint8_t)(folded >> 7);
+}
+
+// Sawtooth wave
+uint8_t fxSaw8(uint16_t phase) {
+    return (uint8_t)(phase >> 8);
+}
+
+// Square wave
+uint8_t fxSquare8(uint16_t phase, uint8_t duty) {
+    return ((phase >> 8) < duty) ? 255 : 0;
+}
+
+// Integer hash (lowbias32 finaliser)
+uint32_t fxHash32(uint32_t x, uint32_t seed) {
+    x ^= seed * 0x9E3779B9UL;
+    x ^= x >> 16;
+    x *= 0x7FEB352DUL;
+    x ^= x >> 15;
+    x *= 0x846CA68BUL;
+    x ^= x >> 16;
+    return x;
+}
+
+// Hash of a 2D lattice point
+static inline uint32_t hash2D(int32_t i, int32_t j, uint32_t seed) {
+    return fxHash32((uint32_t)i * 0x8DA6B343UL ^ (uint32_t)j * 0xD8163841UL, seed);
+}
+
+// Smoothstep of a Q8 fraction: f * f * (3 - 2f)
+static inline int32_t smooth8(int32_t f) {
+    return (f * f * (768 - 2 * f)) >> 16;
+}
+
+// 1D value noise
+uint8_t fxValueNoise1D(int32_t x, uint32_t seed) {
+    int32_t i = x >> 8;
+    int32_t f = smooth8(x & 0xFF);
+    int32_t a = fxHash32((uint32_t)i, seed) & 0xFF;
+    int32_t b = fxHash32((uint32_t)(i + 1), seed) & 0xFF;
+    return (uint8_t)(a + (((b - a) * f) >> 8));
+}
+
+// 2D value noise
+uint8_t fxValueNoise2D(int32_t x, int32_t y, uint32_t seed) {
+    int32_t i = x >> 8;
+    int32_t j = y >> 8;
+    int32_t fx = smooth8(x & 0xFF);
+    int32_t fy = smooth8(y & 0xFF);
+    
+    int32_t a = hash2D(i, j, seed) & 0xFF;
+    int32_t b = hash2D(i + 1, j, seed) & 0xFF;
+    int32_t c = hash2D(i, j + 1, seed) & 0xFF;
+    int32_t d = hash2D(i + 1, j + 1, seed) & 0xFF;
+    
+    int32_t top = a + (((b - a) * fx) >> 8);
+    int32_t bottom = c + (((d - c) * fx) >> 8);
+    return (uint8_t)(top + (((bottom - top) * fy) >> 8));
+}
+
+// Contribution of one simplex corner (x, y in Q8), result in Q16
+static inline int32_t simplexCorner(int32_t x, int32_t y, uint32_t hash) {
+    int32_t t = 32768 - (x * x + y * y);  // 0.5 - x^2 - y^2 in Q16
+    if (t <= 0) {
+        return 0;
+    }
+    t = (t * t) >> 16;
+    t = (t * t) >> 16;                    // t^4 in Q16
+    
+    const int8_t* g = SIMPLEX_GRAD[hash & 7];
+    int32_t dot = g[0] * x + g[1] * y;    // Q8
+    return t * dot;                       // Q24
+}
+
+// 2D simplex noise
+uint8_t fxSimplex2D(int32_t x, int32_t y, uint32_t seed) {
+    // Skew the input space to find the simplex cell
+    int32_t s = ((int64_t)(x + y) * SIMPLEX_F2_Q16) >> 16;
+    int32_t i = (x + s) >> 8;
+    int32_t j = (y + s) >> 8;
+    
+    // Unskew the cell origin back to input space
+    int32_t t = ((i + j) * SIMPLEX_G2_Q16) >> 8;
+    int32_t x0 = x - (i * 256 - t);
+    int32_t y0 = y - (j * 256 - t);
+    
+    // Pick the triangle the point lies in
+    int32_t i1 = (x0 > y0) ? 1 : 0;
+    int32_t j1 = 1 - i1;
+    
+    int32_t x1 = x0 - i1 * 256 + SIMPLEX_G2_Q8;
+    int32_t y1 = y0 - j1 * 256 + SIMPLEX_G2_Q8;
+    int32_t x2 = x0 - 256 + 2 * SIMPLEX_G2_Q8;
+    int32_t y2 = y0 - 256 + 2 * SIMPLEX_G2_Q8;
+    
+    int32_t n = simplexCorner(x0, y0, hash2D(i, j, seed))
+              + simplexCorner(x1, y1, hash2D(i + i1, j + j1, seed))
+              + simplexCorner(x2, y2, hash2D(i + 1, j + 1, seed));
+    
+    // Scale the corner sum (about +/- 0.0145 in Q24) to +/- 127
+    int32_t out = 128 + (int32_t)(((int64_t)n * 8192) >> 24);
+    if (out < 0) out = 0;
+    if (out > 255) out = 255;
+    return (uint8_t)out;
+}
+
+// Advance the random walk
+uint8_t FxRandomWalk::step() {
+    int32_t range = 2 * _maxStep + 1;
+    int32_t delta = (int32_t)_random.nextRange(range) - _maxStep;
+    int32_t v = _value + delta;
+    
+    // Reflect at the bounds
+    if (v < 0) v = -v;
+    if (v > 255) v = 510 - v;
+    _value = (uint8_t)v;
+    return _value;
+}
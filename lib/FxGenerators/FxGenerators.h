@@ -0,0 +1,150 @@
+/**
+ * FxGenerators.h - Fixed-point wave and noise generators for effects
+ * 
+ * Integer-only building blocks that effects can sample per fixture per
+ * frame: LUT-based periodic waves, hash-based value noise, 2D simplex noise
+ * and a seeded random walk. All generators are pure functions of their
+ * inputs (and seed), so every node renders identical output from the same
+ * parameters regardless of timing or floating point behaviour.
+ * 
+ * Conventions:
+ * - Phases are 16-bit (65536 = one full period)
+ * - Coordinates are Q8 fixed point (256 = one lattice cell)
+ * - Outputs are 0-255 unless stated otherwise
+ */
+
+#ifndef FX_GENERATORS_H
+#define FX_GENERATORS_H
+
+#include <stdint.h>
+
+/**
+ * Sine wave from a 256-entry LUT with linear interpolation
+ * 
+ * @param phase 16-bit phase
+ * @return 0-255, 128 at phase 0
+ */
+uint8_t fxSine8(uint16_t phase);
+
+/**
+ * Triangle wave (0 at phase 0, 255 at half period)
+ */
+uint8_t fxTriangle8(uint16_t phase);
+
+/**
+ * Rising sawtooth wave
+ */
+uint8_t fxSaw8(uint16_t phase);
+
+/**
+ * Square wave with adjustable duty cycle
+ * 
+ * @param phase 16-bit phase
+ * @param duty High portion of the period (0-255)
+ */
+uint8_t fxSquare8(uint16_t phase, uint8_t duty = 128);
+
+/**
+ * Deterministic 32-bit integer hash
+ */
+uint32_t fxHash32(uint32_t x, uint32_t seed);
+
+/**
+ * 1D value noise with smoothstep interpolation
+ * 
+ * @param x Q8 coordinate
+ * @param seed Noise seed
+ */
+uint8_t fxValueNoise1D(int32_t x, uint32_t seed);
+
+/**
+ * 2D value noise with smoothstep interpolation
+ * 
+ * @param x Q8 coordinate
+ * @param y Q8 coordinate
+ * @param seed Noise seed
+ */
+uint8_t fxValueNoise2D(int32_t x, int32_t y, uint32_t seed);
+
+/**
+ * 2D simplex noise
+ * 
+ * @param x Q8 coordinate
+ * @param y Q8 coordinate
+ * @param seed Noise seed
+ * @return 0-255, centred on 128
+ */
+uint8_t fxSimplex2D(int32_t x, int32_t y, uint32_t seed);
+
+/**
+ * Seeded xorshift32 pseudo-random number generator
+ */
+class FxRandom {
+public:
+    FxRandom(uint32_t seed = 1) { setSeed(seed); }
+
+    /**
+     * Reset the generator (seed 0 is replaced by a fixed non-zero value)
+     */
+    void setSeed(uint32_t seed) { _state = seed ? seed : 0x9E3779B9UL; }
+
+    /**
+     * Get the next 32-bit value
+     */
+    uint32_t next() {
+        uint32_t x = _state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        _state = x;
+        return x;
+    }
+
+    /**
+     * Get a value in [0, range)
+     */
+    uint32_t nextRange(uint32_t range) { return (uint32_t)(((uint64_t)next() * range) >> 32); }
+
+private:
+    uint32_t _state;
+};
+
+/**
+ * Bounded random walk driven by a seeded PRNG
+ * Each step moves the value by up to +/- maxStep and reflects at 0 and 255
+ */
+class FxRandomWalk {
+public:
+    FxRandomWalk(uint32_t seed = 1, uint8_t start = 128, uint8_t maxStep = 8) :
+        _random(seed), _value(start), _maxStep(maxStep) {}
+
+    /**
+     * Reset the walk
+     */
+    void reset(uint32_t seed, uint8_t start = 128) {
+        _random.setSeed(seed);
+        _value = start;
+    }
+
+    /**
+     * Set the maximum change per step
+     */
+    void setMaxStep(uint8_t maxStep) { _maxStep = maxStep; }
+
+    /**
+     * Advance one step and return the new value
+     */
+    uint8_t step();
+
+    /**
+     * Get the current value
+     */
+    uint8_t value() const { return _value; }
+
+private:
+    FxRandom _random;
+    uint8_t _value;
+    uint8_t _maxStep;
+};
+
+#endif // FX_GENERATORS_H
@@ -0,0 +1,24 @@
+/**
+ * JsonCapacity.h - ArduinoJson document capacities for JSON commands
+ * 
+ * Documents are fixed at compile time per command kind. Payloads are
+ * parsed in place (zero-copy), so strings take no space and only values
+ * need a slot: every value needs at least a character and a separator,
+ * which bounds the slots any command of a given length can use.
+ */
+
+#ifndef JSON_CAPACITY_H
+#define JSON_CAPACITY_H
+
+#include <ArduinoJson.h>
+
+// The root holds the command and an optional "seq"
+#define JSON_ROOT_CAPACITY JSON_OBJECT_SIZE(2)
+
+// Commands with a fixed shape: the root and one object of up to 12 fields
+#define SMALL_JSON_CAPACITY (JSON_ROOT_CAPACITY + JSON_OBJECT_SIZE(12))
+
+// Any command of up to `size` bytes, arrays and nesting included
+#define JSON_CAPACITY_FOR(size) (JSON_ROOT_CAPACITY + JSON_ARRAY_SIZE((size) / 2))
+
+#endif // JSON_CAPACITY_H
@@ -93,6 +93,25 @@ public:
      */
     bool sendString(const String& data, uint8_t port = 1, bool confirmed = false);
     
+    /**
+     * @brief Request the network time with the next uplink
+     * 
+     * Adds a DeviceTimeReq MAC command to the next uplink. The answer is
+     * picked up from the downlink and can be read with getNetworkTime().
+     */
+    void requestNetworkTime();
+    
+    /**
+     * @brief Get the network time received since the last call
+     * 
+     * @param unixSeconds Unix time in seconds
+     * @param milliseconds Sub-second part in milliseconds
+     * @param localMs millis() at the end of the uplink, which the network time refers to
+     * @return true if a new network time was available
+     * @return false if no answer has been received
+     */
+    bool getNetworkTime(uint32_t& unixSeconds, uint16_t& milliseconds, uint32_t& localMs);
+    
     /**
      * @brief Get the last RSSI value
      * 
@@ -196,6 +215,13 @@ private:
     // Band type
     uint8_t bandType;
     
+    // Network time (DeviceTimeReq/Ans)
+    bool networkTimeRequested;
+    bool networkTimeAvailable;
+    uint32_t networkTimeUnix;
+    uint8_t networkTimeFraction;
+    uint32_t networkTimeLocalMs;
+    
     /**
      * @brief Configure subband channel mask based on the current subband
      * 
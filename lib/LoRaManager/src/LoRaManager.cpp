@@ -42,7 +42,12 @@ LoRaManager::LoRaManager(LoRaWANBand_t freqBand, uint8_t subBand) :
   receivedBytes(0),
   lastErrorCode(RADIOLIB_ERR_NONE),
   consecutiveTransmitErrors(0),
-  downlinkCallback(nullptr) {
+  downlinkCallback(nullptr),
+  networkTimeRequested(false),
+  networkTimeAvailable(false),
+  networkTimeUnix(0),
+  networkTimeFraction(0),
+  networkTimeLocalMs(0) {
   
   // Set this instance as the active one
   instance = this;
@@ -395,8 +400,18 @@ bool LoRaManager::sendData(uint8_t* data, size_t len, uint8_t port, bool confirm
     uint8_t downlinkData[256];
     size_t downlinkLen = sizeof(downlinkData);
     
-    // Send data and wait for downlink
-    int state = node->sendReceive(data, len, port, downlinkData, &downlinkLen, confirmed);
+    // Piggyback a DeviceTimeReq on this uplink if the clock needs syncing
+    if (networkTimeRequested) {
+      node->sendMacCommandReq(RADIOLIB_LORAWAN_MAC_DEVICE_TIME);
+    }
+    
+    // The answer refers to the end of the uplink: its start plus time on air
+    uint32_t uplinkStartMs = millis();
+    
+    // Send data and wait for downlink; the event reports the downlink's own fPort
+    LoRaWANEvent_t downlinkEvent;
+    downlinkEvent.fPort = port;
+    int state = node->sendReceive(data, len, port, downlinkData, &downlinkLen, confirmed, NULL, &downlinkEvent);
     lastErrorCode = state;
     
     // Check for successful transmission
@@ -406,6 +421,21 @@ bool LoRaManager::sendData(uint8_t* data, size_t len, uint8_t port, bool confirm
         Serial.print(F("success! Received downlink in RX"));
         Serial.println(state);
         
+        // Check for a DeviceTimeAns among the MAC commands
+        if (networkTimeRequested) {
+          uint32_t unixSeconds = 0;
+          uint8_t fraction = 0;
+          if (node->getMacDeviceTimeAns(&unixSeconds, &fraction, true) == RADIOLIB_ERR_NONE) {
+            networkTimeUnix = unixSeconds;
+            networkTimeFraction = fraction;
+            networkTimeLocalMs = uplinkStartMs + (uint32_t)node->getLastToA();
+            networkTimeAvailable = true;
+            networkTimeRequested = false;
+            Serial.print(F("[LoRaWAN] Network time: "));
+            Serial.println(unixSeconds);
+          }
+        }
+        
         // Process the downlink data
         if (downlinkLen > 0) {
           Serial.print(F("[LoRaWAN] Received "));
@@ -420,7 +450,7 @@ bool LoRaManager::sendData(uint8_t* data, size_t len, uint8_t port, bool confirm
           
           // Call the callback if registered
           if (downlinkCallback != nullptr) {
-            downlinkCallback(downlinkData, downlinkLen, port);
+            downlinkCallback(downlinkData, downlinkLen, downlinkEvent.fPort);
           }
           
           // Copy the data to our buffer
@@ -533,6 +563,24 @@ bool LoRaManager::sendString(const String& data, uint8_t port, bool confirmed) {
   return sendData((uint8_t*)data.c_str(), data.length(), port, confirmed);
 }
 
+// Request the network time with the next uplink
+void LoRaManager::requestNetworkTime() {
+  networkTimeRequested = true;
+}
+
+// Get the network time received in a DeviceTimeAns
+bool LoRaManager::getNetworkTime(uint32_t& unixSeconds, uint16_t& milliseconds, uint32_t& localMs) {
+  if (!networkTimeAvailable) {
+    return false;
+  }
+  
+  unixSeconds = networkTimeUnix;
+  milliseconds = (uint16_t)(((uint32_t)networkTimeFraction * 1000) >> 8);
+  localMs = networkTimeLocalMs;
+  networkTimeAvailable = false;
+  return true;
+}
+
 // Get the last RSSI value
 float LoRaManager::getLastRssi() {
   return lastRssi;
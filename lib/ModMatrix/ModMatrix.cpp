@@ -0,0 +1,168 @@
+/**
+ * ModMatrix.cpp - Implementation of the LFO modulation matrix
+ */
+
+#include "ModMatrix.h"
+#include <string.h>
+
+// Constructor
+ModMatrix::ModMatrix() {
+    clear();
+}
+
+// Remove all LFOs and routes
+void ModMatrix::clear() {
+    for (int i = 0; i < MOD_MAX_LFOS; i++) {
+        _lfos[i].enabled = false;
+        _lfos[i].value = 0;
+    }
+    for (int i = 0; i < MOD_MAX_ROUTES; i++) {
+        _routes[i].enabled = false;
+    }
+    _routeCount = 0;
+    _hasIntensity = false;
+    _lastEvalMs = 0;
+    _speedMod = 0;
+    _hueOffset = 0;
+    memset(_intensity, 255, sizeof(_intensity));
+}
+
+// Configure an oscillator
+bool ModMatrix::setLfo(uint8_t index, LfoShape shape, uint32_t rateMilliHz, uint32_t beatsQ8, uint32_t seed) {
+    if (index >= MOD_MAX_LFOS) {
+        return false;
+    }
+    
+    Lfo& lfo = _lfos[index];
+    lfo.enabled = true;
+    lfo.shape = shape;
+    lfo.rateMilliHz = rateMilliHz;
+    lfo.beatsQ8 = beatsQ8;
+    lfo.phase = 0;
+    lfo.random.setSeed(seed);
+    lfo.heldValue = (int16_t)(lfo.random.next() >> 16);
+    lfo.lastPhase16 = 0;
+    lfo.value = 0;
+    return true;
+}
+
+// Add a route
+bool ModMatrix::addRoute(uint8_t lfo, ModTarget target, int16_t depth, uint32_t fixtureMask) {
+    if (_routeCount >= MOD_MAX_ROUTES || lfo >= MOD_MAX_LFOS || target == MOD_TARGET_NONE) {
+        return false;
+    }
+    
+    if (depth > 255) depth = 255;
+    if (depth < -255) depth = -255;
+    
+    ModRoute& route = _routes[_routeCount++];
+    route.enabled = true;
+    route.lfo = lfo;
+    route.target = target;
+    route.depth = depth;
+    route.fixtureMask = fixtureMask;
+    
+    if (target == MOD_TARGET_INTENSITY) {
+        _hasIntensity = true;
+    }
+    return true;
+}
+
+// Waveform value for a phase, bipolar
+int16_t ModMatrix::shapeValue(Lfo& lfo, uint16_t phase16) {
+    switch (lfo.shape) {
+        case LFO_SINE:
+            return (int16_t)((fxSine8(phase16) - 128) << 8);
+        case LFO_TRIANGLE:
+            return (int16_t)((fxTriangle8(phase16) - 128) << 8);
+        case LFO_SQUARE:
+            return phase16 < 32768 ? 32767 : -32768;
+        case LFO_SAW:
+            return (int16_t)(phase16 - 32768);
+        case LFO_RANDOM:
+            // Draw a new value each time the phase wraps
+            if (phase16 < lfo.lastPhase16) {
+                lfo.heldValue = (int16_t)(lfo.random.next() >> 16);
+            }
+            return lfo.heldValue;
+    }
+    return 0;
+}
+
+// Advance the LFOs and recompute the outputs
+void ModMatrix::evaluate(uint32_t nowMs, uint64_t beatPosition) {
+    uint32_t elapsed = nowMs - _lastEvalMs;
+    _lastEvalMs = nowMs;
+    
+    // Oscillators
+    for (int i = 0; i < MOD_MAX_LFOS; i++) {
+        Lfo& lfo = _lfos[i];
+        if (!lfo.enabled) continue;
+        
+        uint16_t phase16;
+        if (lfo.beatsQ8 > 0) {
+            // Tempo-locked: phase follows the beat position directly
+            phase16 = (uint16_t)((beatPosition << 8) / lfo.beatsQ8);
+        } else {
+            // Free-running: 2^32 phase units per cycle, rate in mHz
+            lfo.phase += (uint32_t)(((uint64_t)lfo.rateMilliHz * elapsed * 4294967296ULL) / 1000000ULL);
+            phase16 = lfo.phase >> 16;
+        }
+        
+        lfo.value = shapeValue(lfo, phase16);
+        lfo.lastPhase16 = phase16;
+    }
+    
+    // Routes
+    int32_t speed = 0;
+    int32_t hue = 0;
+    if (_hasIntensity) {
+        memset(_intensity, 255, sizeof(_intensity));
+    }
+    
+    for (int r = 0; r < _routeCount; r++) {
+        const ModRoute& route = _routes[r];
+        if (!route.enabled || !_lfos[route.lfo].enabled) continue;
+        
+        int32_t value = _lfos[route.lfo].value;  // -32768..32767
+        switch (route.target) {
+            case MOD_TARGET_SPEED:
+                speed += (value * route.depth) >> 15;
+                break;
+            case MOD_TARGET_HUE:
+                hue += (value * route.depth * 180 / 255) >> 15;
+                break;
+            case MOD_TARGET_INTENSITY: {
+                // Unipolar 0..255, the sign of depth inverts it
+                int32_t unipolar = (value + 32768) >> 8;
+                if (route.depth < 0) unipolar = 255 - unipolar;
+                int32_t depth = route.depth < 0 ? -route.depth : route.depth;
+                int32_t level = 255 - ((depth * (255 - unipolar)) >> 8);
+                
+                for (int f = 0; f < MOD_MAX_FIXTURES; f++) {
+                    if (route.fixtureMask & (1UL << f)) {
+                        _intensity[f] = (uint8_t)((_intensity[f] * level) / 255);
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    
+    if (speed > 255) speed = 255;
+    if (speed < -255) speed = -255;
+    if (hue > 180) hue = 180;
+    if (hue < -180) hue = -180;
+    _speedMod = (int16_t)speed;
+    _hueOffset = (int16_t)hue;
+}
+
+// Intensity of a fixture
+uint8_t ModMatrix::getIntensity(int fixture) const {
+    if (fixture < 0 || fixture >= MOD_MAX_FIXTURES) {
+        return 255;
+    }
+    return _intensity[fixture];
+}
@@ -0,0 +1,141 @@
+/**
+ * ModMatrix.h - LFO modulation matrix for effect parameters
+ * 
+ * A small set of low frequency oscillators that can be routed to effect
+ * speed, colour hue or the intensity of groups of fixtures. The matrix is
+ * evaluated once per frame in fixed point, so layered, evolving looks need
+ * one configuration command instead of a stream of parameter updates.
+ */
+
+#ifndef MOD_MATRIX_H
+#define MOD_MATRIX_H
+
+#include <stdint.h>
+#include "FxGenerators.h"
+
+#define MOD_MAX_LFOS 4       // Number of oscillators
+#define MOD_MAX_ROUTES 8     // Number of LFO -> parameter routes
+#define MOD_MAX_FIXTURES 32  // Fixtures covered by intensity routes
+
+// LFO waveforms
+enum LfoShape {
+  LFO_SINE = 0,
+  LFO_TRIANGLE,
+  LFO_SQUARE,
+  LFO_SAW,
+  LFO_RANDOM    // Sample and hold, new value every period
+};
+
+// Parameters an LFO can be routed to
+enum ModTarget {
+  MOD_TARGET_NONE = 0,
+  MOD_TARGET_SPEED,      // Pattern speed (scales the step interval)
+  MOD_TARGET_HUE,        // Hue offset added to pattern colours
+  MOD_TARGET_INTENSITY   // Intensity of the fixtures in a group
+};
+
+// Oscillator configuration and state
+struct Lfo {
+  bool enabled;
+  LfoShape shape;
+  uint32_t rateMilliHz;     // Free-running rate in mHz (used when beats is 0)
+  uint32_t beatsQ8;         // Period in beats * 256 to follow the tempo clock, 0 = free-running
+  uint32_t phase;           // 32-bit phase accumulator (free-running mode)
+  FxRandom random;          // PRNG for the random shape
+  int16_t heldValue;        // Current sample-and-hold value
+  uint16_t lastPhase16;     // Used to detect period wrap for sample-and-hold
+  int16_t value;            // Latest output, -32768..32767
+};
+
+// LFO to parameter connection
+struct ModRoute {
+  bool enabled;
+  uint8_t lfo;              // Source oscillator
+  ModTarget target;
+  int16_t depth;            // -255..255, sign inverts the LFO
+  uint32_t fixtureMask;     // Fixtures affected by intensity routes
+};
+
+class ModMatrix {
+public:
+    ModMatrix();
+
+    /**
+     * Remove all LFOs and routes and reset the outputs
+     */
+    void clear();
+
+    /**
+     * Configure an oscillator
+     * 
+     * @param index LFO index (0 to MOD_MAX_LFOS - 1)
+     * @param shape Waveform
+     * @param rateMilliHz Rate in mHz for free-running LFOs
+     * @param beatsQ8 Period in beats * 256 to lock to the tempo clock (0 = free-running)
+     * @param seed Seed for the random shape
+     * @return true if the index was valid
+     */
+    bool setLfo(uint8_t index, LfoShape shape, uint32_t rateMilliHz, uint32_t beatsQ8 = 0, uint32_t seed = 1);
+
+    /**
+     * Add a route from an LFO to a parameter
+     * 
+     * @param lfo Source LFO index
+     * @param target Parameter to modulate
+     * @param depth Modulation depth, -255..255
+     * @param fixtureMask Fixtures affected by an intensity route (bit 0 = fixture 1)
+     * @return true if a free route slot was available
+     */
+    bool addRoute(uint8_t lfo, ModTarget target, int16_t depth, uint32_t fixtureMask = 0xFFFFFFFFUL);
+
+    /**
+     * Advance all LFOs and recompute the modulation outputs
+     * Call once per frame
+     * 
+     * @param nowMs Current millis()
+     * @param beatPosition Tempo clock position in 1/65536 beats
+     */
+    void evaluate(uint32_t nowMs, uint64_t beatPosition);
+
+    /**
+     * Check if any route is active
+     */
+    bool isActive() const { return _routeCount > 0; }
+
+    /**
+     * Speed modulation, -255..255 (0 = unmodulated)
+     */
+    int16_t getSpeedMod() const { return _speedMod; }
+
+    /**
+     * Hue offset in degrees, -180..180
+     */
+    int16_t getHueOffset() const { return _hueOffset; }
+
+    /**
+     * Intensity of a fixture, 0-255 (255 = unmodulated)
+     */
+    uint8_t getIntensity(int fixture) const;
+
+    /**
+     * Check if any intensity route is active
+     */
+    bool hasIntensityRoutes() const { return _hasIntensity; }
+
+private:
+    Lfo _lfos[MOD_MAX_LFOS];
+    ModRoute _routes[MOD_MAX_ROUTES];
+    int _routeCount;
+    bool _hasIntensity;
+    uint32_t _lastEvalMs;
+
+    // Outputs
+    int16_t _speedMod;
+    int16_t _hueOffset;
+    uint8_t _intensity[MOD_MAX_FIXTURES];
+
+    // Compute the waveform value for a phase
+    static int16_t shapeValue(Lfo& lfo, uint16_t phase16);
+};
+
+#endif // MOD_MATRIX_H
@@ -0,0 +1,128 @@
+/**
+ * PersistService.cpp - Debounced write-behind persistence
+ */
+
+#include "PersistService.h"
+
+PersistService::PersistService(uint32_t quietMs, uint32_t maxLatencyMs)
+    : _quietMs(quietMs), _maxLatencyMs(max(quietMs, maxLatencyMs)), _task(NULL), _marks(0), _writes(0) {
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+    memset(_targets, 0, sizeof(_targets));
+}
+
+bool PersistService::setTarget(uint8_t id, const char* name, PersistWriter writer) {
+    if (id >= PERSIST_MAX_TARGETS || writer == NULL) {
+        return false;
+    }
+    _targets[id].name = name;
+    _targets[id].writer = writer;
+    return true;
+}
+
+bool PersistService::begin(UBaseType_t priority, BaseType_t core) {
+    if (_task != NULL) {
+        return true;
+    }
+    return xTaskCreatePinnedToCore(taskEntry, "Persist", PERSIST_TASK_STACK, this, priority, &_task, core) == pdPASS;
+}
+
+void PersistService::markDirty(uint8_t id) {
+    if (id >= PERSIST_MAX_TARGETS) {
+        return;
+    }
+
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_lock);
+    Target& target = _targets[id];
+    if (!target.dirty) {
+        target.dirty = true;
+        target.firstDirtyMs = now;
+        target.changes = 0;
+    }
+    target.lastDirtyMs = now;
+    if (target.changes < 0xFFFF) {
+        target.changes++;
+    }
+    _marks++;
+    portEXIT_CRITICAL(&_lock);
+
+    // Let the task recompute its deadline
+    if (_task != NULL) {
+        xTaskNotifyGive(_task);
+    }
+}
+
+bool PersistService::isDirty() const {
+    bool dirty = false;
+    portENTER_CRITICAL(&_lock);
+    for (int i = 0; i < PERSIST_MAX_TARGETS; i++) {
+        dirty |= _targets[i].dirty;
+    }
+    portEXIT_CRITICAL(&_lock);
+    return dirty;
+}
+
+void PersistService::taskEntry(void* parameter) {
+    static_cast<PersistService*>(parameter)->run();
+}
+
+/**
+ * Find a target that is due and clear its dirty flag
+ *
+ * @param waitMs Set to the time until the next target is due
+ * @param changes Set to the number of changes the write covers
+ * @return Target id, or -1 if none is due
+ */
+int PersistService::takeDue(uint32_t& waitMs, uint16_t& changes) {
+    waitMs = UINT32_MAX;
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&_lock);
+    for (int i = 0; i < PERSIST_MAX_TARGETS; i++) {
+        Target& target = _targets[i];
+        if (!target.dirty || target.writer == NULL) {
+            continue;
+        }
+
+        uint32_t quiet = now - target.lastDirtyMs;
+        uint32_t waited = now - target.firstDirtyMs;
+        if (quiet >= _quietMs || waited >= _maxLatencyMs) {
+            target.dirty = false;
+            changes = target.changes;
+            portEXIT_CRITICAL(&_lock);
+            return i;
+        }
+        waitMs = min(waitMs, min(_quietMs - quiet, _maxLatencyMs - waited));
+    }
+    portEXIT_CRITICAL(&_lock);
+    return -1;
+}
+
+void PersistService::run() {
+    for (;;) {
+        uint32_t waitMs;
+        uint16_t changes;
+        int id = takeDue(waitMs, changes);
+
+        if (id >= 0) {
+            Target& target = _targets[id];
+            if (target.writer()) {
+                _writes++;
+                Serial.print("Persisted ");
+                Serial.print(target.name);
+                Serial.print(" (");
+                Serial.print(changes);
+                Serial.println(changes == 1 ? " change)" : " changes coalesced)");
+            } else {
+                Serial.print("Failed to persist ");
+                Serial.print(target.name);
+                Serial.println(", will retry");
+                markDirty(id);
+            }
+            continue;
+        }
+
+        // Sleep until the next deadline or a new change
+        ulTaskNotifyTake(pdTRUE, waitMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(waitMs) + 1);
+    }
+}
@@ -0,0 +1,101 @@
+/**
+ * PersistService.h - Debounced write-behind persistence
+ *
+ * Commands only mark their state dirty; a low-priority task writes it to
+ * flash later. Changes are coalesced: a target is written once it has been
+ * quiet for the quiet period, or once it has been dirty for the maximum
+ * latency even if changes keep arriving. A burst of commands costs one
+ * write instead of one per command, and no command waits on flash.
+ *
+ * The dirty flag is cleared before the writer runs, so a change made
+ * during a write marks the target again and the stored copy catches up.
+ */
+
+#ifndef PERSIST_SERVICE_H
+#define PERSIST_SERVICE_H
+
+#include <Arduino.h>
+
+#define PERSIST_MAX_TARGETS 4          // Independently written pieces of state
+#define PERSIST_QUIET_MS 2000          // Write after this long without a change
+#define PERSIST_MAX_LATENCY_MS 10000   // Write at the latest this long after the first change
+#define PERSIST_TASK_STACK 4096        // Preferences needs a few KB of stack
+
+/**
+ * Writes one target to flash
+ *
+ * @return true if the write succeeded; a failed write is retried
+ */
+typedef bool (*PersistWriter)();
+
+class PersistService {
+public:
+    /**
+     * Constructor
+     *
+     * @param quietMs Quiet period before a write
+     * @param maxLatencyMs Longest a change may wait for its write
+     */
+    PersistService(uint32_t quietMs = PERSIST_QUIET_MS, uint32_t maxLatencyMs = PERSIST_MAX_LATENCY_MS);
+
+    /**
+     * Register a target; call before begin()
+     *
+     * @param id Target number (0 to PERSIST_MAX_TARGETS - 1)
+     * @param name Name for log messages
+     * @param writer Function that writes the target
+     * @return true if the id was valid
+     */
+    bool setTarget(uint8_t id, const char* name, PersistWriter writer);
+
+    /**
+     * Start the writer task
+     * Targets marked dirty before this are written once it runs
+     *
+     * @param priority Task priority; the idle priority keeps writes out of everyone's way
+     * @param core Core to run on
+     * @return true if the task was created
+     */
+    bool begin(UBaseType_t priority = tskIDLE_PRIORITY, BaseType_t core = 1);
+
+    /**
+     * Mark a target as changed; cheap, callable from any task
+     */
+    void markDirty(uint8_t id);
+
+    /**
+     * Check whether any target is waiting to be written
+     */
+    bool isDirty() const;
+
+    /**
+     * Get the number of changes marked and of writes carried out
+     * The difference is the writes saved by coalescing
+     */
+    uint32_t getMarks() const { return _marks; }
+    uint32_t getWrites() const { return _writes; }
+
+private:
+    struct Target {
+        const char* name;
+        PersistWriter writer;
+        bool dirty;
+        uint32_t firstDirtyMs;    // First change since the last write
+        uint32_t lastDirtyMs;     // Most recent change
+        uint16_t changes;         // Changes since the last write
+    };
+
+    Target _targets[PERSIST_MAX_TARGETS];
+    uint32_t _quietMs;
+    uint32_t _maxLatencyMs;
+    TaskHandle_t _task;
+    mutable portMUX_TYPE _lock;
+    volatile uint32_t _marks;
+    volatile uint32_t _writes;
+
+    static void taskEntry(void* parameter);
+    void run();
+    int takeDue(uint32_t& waitMs, uint16_t& changes);
+};
+
+#endif // PERSIST_SERVICE_H
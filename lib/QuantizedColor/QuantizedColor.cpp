@@ -0,0 +1,125 @@
+/**
+ * QuantizedColor.cpp - Implementation of the reduced-precision color expansion
+ */
+
+#include "QuantizedColor.h"
+
+// Fully saturated colors for the 64 hue steps of the HSV encoding
+static const uint8_t HUE_TABLE[64][3] = {
+    {255, 0, 0}, {255, 24, 0}, {255, 48, 0}, {255, 72, 0},
+    {255, 96, 0}, {255, 120, 0}, {255, 144, 0}, {255, 168, 0},
+    {255, 192, 0}, {255, 216, 0}, {255, 240, 0}, {247, 255, 0},
+    {223, 255, 0}, {199, 255, 0}, {175, 255, 0}, {151, 255, 0},
+    {127, 255, 0}, {103, 255, 0}, {79, 255, 0}, {55, 255, 0},
+    {31, 255, 0}, {7, 255, 0}, {0, 255, 16}, {0, 255, 40},
+    {0, 255, 64}, {0, 255, 88}, {0, 255, 112}, {0, 255, 136},
+    {0, 255, 160}, {0, 255, 184}, {0, 255, 208}, {0, 255, 232},
+    {0, 255, 255}, {0, 231, 255}, {0, 207, 255}, {0, 183, 255},
+    {0, 159, 255}, {0, 135, 255}, {0, 111, 255}, {0, 87, 255},
+    {0, 63, 255}, {0, 39, 255}, {0, 15, 255}, {8, 0, 255},
+    {32, 0, 255}, {56, 0, 255}, {80, 0, 255}, {104, 0, 255},
+    {128, 0, 255}, {152, 0, 255}, {176, 0, 255}, {200, 0, 255},
+    {224, 0, 255}, {248, 0, 255}, {255, 0, 239}, {255, 0, 215},
+    {255, 0, 191}, {255, 0, 167}, {255, 0, 143}, {255, 0, 119},
+    {255, 0, 95}, {255, 0, 71}, {255, 0, 47}, {255, 0, 23},
+};
+
+// Output levels for the 2-bit HSV intensity
+static const uint8_t INTENSITY_LEVELS[4] = {0, 85, 170, 255};
+
+// Ordered dither thresholds (0-7) for consecutive fixtures
+static const uint8_t DITHER_ORDER[8] = {0, 4, 2, 6, 1, 5, 3, 7};
+
+// Expansion tables, filled on first use: 4/5/6-bit value -> 8 bits with bit replication
+static uint8_t expand4[16];
+static uint8_t expand5[32];
+static uint8_t expand6[64];
+static bool tablesReady = false;
+
+static void buildTables() {
+    for (int i = 0; i < 16; i++) expand4[i] = (i << 4) | i;
+    for (int i = 0; i < 32; i++) expand5[i] = (i << 3) | (i >> 2);
+    for (int i = 0; i < 64; i++) expand6[i] = (i << 2) | (i >> 4);
+    tablesReady = true;
+}
+
+// Expand a channel and shift it within its quantisation step by the dither threshold
+static inline uint8_t ditherChannel(uint8_t expanded, uint8_t bits, uint8_t threshold) {
+    // Keep off and full exact
+    if (expanded == 0 || expanded == 255) {
+        return expanded;
+    }
+    int step = 256 >> bits;
+    int value = expanded + ((2 * threshold + 1) * step) / 16 - step / 2;
+    return (uint8_t)constrain(value, 0, 255);
+}
+
+// Get the number of bytes a run of packed colors occupies
+size_t quantPackedSize(uint8_t format, uint32_t count) {
+    switch (format) {
+        case QUANT_RGB565: return (size_t)count * 2;
+        case QUANT_RGB444: return ((size_t)count * 3 + 1) / 2;
+        case QUANT_HSV: return count;
+        default: return 0;
+    }
+}
+
+// Expand a run of packed colors
+bool quantDecode(uint8_t format, const uint8_t* data, uint32_t count, bool dither, uint32_t ditherPhase, RgbwColor* colors) {
+    if (!tablesReady) {
+        buildTables();
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        RgbwColor& color = colors[i];
+        color.w = 0;
+        uint8_t threshold = DITHER_ORDER[(ditherPhase + i) & 7];
+        
+        switch (format) {
+            case QUANT_RGB565: {
+                uint16_t v = data[i * 2] | (data[i * 2 + 1] << 8);
+                color.r = expand5[(v >> 11) & 0x1F];
+                color.g = expand6[(v >> 5) & 0x3F];
+                color.b = expand5[v & 0x1F];
+                if (dither) {
+                    color.r = ditherChannel(color.r, 5, threshold);
+                    color.g = ditherChannel(color.g, 6, threshold);
+                    color.b = ditherChannel(color.b, 5, threshold);
+                }
+                break;
+            }
+            
+            case QUANT_RGB444: {
+                // Nibble n is the low half of byte n/2 for even n
+                uint8_t nibbles[3];
+                for (int k = 0; k < 3; k++) {
+                    uint32_t n = i * 3 + k;
+                    nibbles[k] = (data[n >> 1] >> ((n & 1) * 4)) & 0x0F;
+                }
+                color.r = expand4[nibbles[0]];
+                color.g = expand4[nibbles[1]];
+                color.b = expand4[nibbles[2]];
+                if (dither) {
+                    color.r = ditherChannel(color.r, 4, threshold);
+                    color.g = ditherChannel(color.g, 4, threshold);
+                    color.b = ditherChannel(color.b, 4, threshold);
+                }
+                break;
+            }
+            
+            case QUANT_HSV: {
+                const uint8_t* hue = HUE_TABLE[data[i] & 0x3F];
+                uint8_t level = INTENSITY_LEVELS[data[i] >> 6];
+                color.r = (hue[0] * level + 127) / 255;
+                color.g = (hue[1] * level + 127) / 255;
+                color.b = (hue[2] * level + 127) / 255;
+                break;
+            }
+            
+            default:
+                return false;
+        }
+    }
+    
+    return true;
+}
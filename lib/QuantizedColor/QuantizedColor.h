@@ -0,0 +1,50 @@
+/**
+ * QuantizedColor.h - Reduced-precision color encodings for dense downlinks
+ * 
+ * Expands per-fixture colors sent in reduced precision back to RGBW with
+ * lookup tables:
+ * - RGB565: 2 bytes per fixture, little endian, red in the top 5 bits
+ * - RGB444: 12 bits per fixture as red, green, blue nibbles packed LSB first
+ * - HSV: 1 byte per fixture, hue in bits 0-5 (64 steps), intensity in bits 6-7
+ * 
+ * RGB formats can be expanded with ordered dithering across fixtures, which
+ * spreads the quantisation error so gradients across a rig look smoother.
+ */
+
+#ifndef QUANTIZED_COLOR_H
+#define QUANTIZED_COLOR_H
+
+#include <Arduino.h>
+#include "DmxController.h"
+
+// Encoding of the packed colors
+enum QuantFormat {
+  QUANT_RGB565 = 0,
+  QUANT_RGB444 = 1,
+  QUANT_HSV = 2
+};
+
+/**
+ * Get the number of bytes a run of packed colors occupies
+ * 
+ * @param format Color encoding
+ * @param count Number of colors
+ * @return Size in bytes, 0 for an unknown format
+ */
+size_t quantPackedSize(uint8_t format, uint32_t count);
+
+/**
+ * Expand a run of packed colors
+ * 
+ * @param format Color encoding
+ * @param data Packed colors
+ * @param count Number of colors
+ * @param dither Apply ordered dithering (RGB formats only)
+ * @param ditherPhase Position of the first color in the dither pattern,
+ *                    normally the fixture index, so the pattern stays fixed to the rig
+ * @param colors Output array with count entries
+ * @return false for an unknown format
+ */
+bool quantDecode(uint8_t format, const uint8_t* data, uint32_t count, bool dither, uint32_t ditherPhase, RgbwColor* colors);
+
+#endif // QUANTIZED_COLOR_H
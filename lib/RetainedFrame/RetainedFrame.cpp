@@ -0,0 +1,129 @@
+/**
+ * RetainedFrame.cpp - Live DMX frame kept in RTC memory across warm resets
+ */
+
+#include "RetainedFrame.h"
+#include <rom/crc.h>
+
+#define RETAINED_MAGIC 0x4E544552UL  // "RETN"
+#define RETAINED_LAYOUT 1            // Changes whenever RetainedSlot does
+
+struct RetainedSlot {
+    uint32_t magic;
+    uint16_t layout;
+    uint16_t effectLength;
+    uint32_t sequence;
+    uint8_t frame[RETAINED_FRAME_SIZE];
+    uint8_t effect[RETAINED_EFFECT_MAX];
+    uint32_t crc;                    // CRC32 of the fields above
+};
+
+// Not cleared by the boot code; only meaningful after a warm reset
+static RTC_NOINIT_ATTR RetainedSlot retainedSlots[2];
+
+static uint32_t slotCrc(const RetainedSlot& slot) {
+    return crc32_le(0, (const uint8_t*)&slot, offsetof(RetainedSlot, crc));
+}
+
+static bool isWarmReset(esp_reset_reason_t reason) {
+    switch (reason) {
+        case ESP_RST_SW:
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            return true;
+        default:
+            return false;            // Power-on, brownout, reset pin, deep sleep
+    }
+}
+
+RetainedFrame::RetainedFrame()
+    : _resetReason(ESP_RST_UNKNOWN), _slot(-1), _sequence(0), _writes(0), _skipped(0) {
+}
+
+bool RetainedFrame::begin() {
+    _resetReason = esp_reset_reason();
+    _slot = -1;
+
+    if (isWarmReset(_resetReason)) {
+        for (int i = 0; i < 2; i++) {
+            const RetainedSlot& slot = retainedSlots[i];
+            if (slot.magic != RETAINED_MAGIC || slot.layout != RETAINED_LAYOUT ||
+                slot.effectLength > RETAINED_EFFECT_MAX || slotCrc(slot) != slot.crc) {
+                continue;
+            }
+            if (_slot < 0 || (int32_t)(slot.sequence - _sequence) > 0) {
+                _slot = i;
+                _sequence = slot.sequence;
+            }
+        }
+    }
+
+    if (_slot < 0) {
+        // Whatever RTC memory holds after a cold boot is not a frame
+        memset(retainedSlots, 0, sizeof(retainedSlots));
+        _sequence = 0;
+    }
+    return _slot >= 0;
+}
+
+const uint8_t* RetainedFrame::getFrame() const {
+    return _slot >= 0 ? retainedSlots[_slot].frame : NULL;
+}
+
+size_t RetainedFrame::getEffect(void* effect, size_t capacity) const {
+    if (_slot < 0 || retainedSlots[_slot].effectLength > capacity) {
+        return 0;
+    }
+    memcpy(effect, retainedSlots[_slot].effect, retainedSlots[_slot].effectLength);
+    return retainedSlots[_slot].effectLength;
+}
+
+void RetainedFrame::update(const uint8_t* frame, const void* effect, size_t effectLength) {
+    if (effectLength > RETAINED_EFFECT_MAX) {
+        effectLength = 0;
+    }
+
+    if (_slot >= 0) {
+        const RetainedSlot& current = retainedSlots[_slot];
+        if (current.effectLength == effectLength &&
+            memcmp(current.frame, frame, RETAINED_FRAME_SIZE) == 0 &&
+            memcmp(current.effect, effect, effectLength) == 0) {
+            _skipped++;
+            return;
+        }
+    }
+
+    // Write the older copy; the newer one stays valid until this one is
+    int next = _slot >= 0 ? 1 - _slot : 0;
+    RetainedSlot& slot = retainedSlots[next];
+    slot.magic = RETAINED_MAGIC;
+    slot.layout = RETAINED_LAYOUT;
+    slot.effectLength = effectLength;
+    slot.sequence = _sequence + 1;
+    memcpy(slot.frame, frame, RETAINED_FRAME_SIZE);
+    memcpy(slot.effect, effect, effectLength);
+    memset(slot.effect + effectLength, 0, RETAINED_EFFECT_MAX - effectLength);
+    slot.crc = slotCrc(slot);
+
+    _slot = next;
+    _sequence = slot.sequence;
+    _writes++;
+}
+
+const char* RetainedFrame::resetReasonName(esp_reset_reason_t reason) {
+    switch (reason) {
+        case ESP_RST_POWERON: return "power_on";
+        case ESP_RST_EXT: return "ext";
+        case ESP_RST_SW: return "sw";
+        case ESP_RST_PANIC: return "panic";
+        case ESP_RST_INT_WDT: return "int_wdt";
+        case ESP_RST_TASK_WDT: return "task_wdt";
+        case ESP_RST_WDT: return "wdt";
+        case ESP_RST_DEEPSLEEP: return "deep_sleep";
+        case ESP_RST_BROWNOUT: return "brownout";
+        case ESP_RST_SDIO: return "sdio";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * RetainedFrame.h - Live DMX frame kept in RTC memory across warm resets
+ *
+ * The frame being output, and a small opaque record of the running effect
+ * and its phase, are copied into RTC memory that the boot code leaves
+ * untouched (RTC_NOINIT_ATTR). After a watchdog reset, a panic or a
+ * software restart the node sends the same frame again within
+ * milliseconds, without waiting for flash and without a blackout. After a
+ * power-on or any other reset the copies are discarded and the state
+ * saved in flash is used instead.
+ *
+ * There are two copies, written in turn, each with a sequence number and
+ * a CRC32. A reset in the middle of an update leaves the other copy
+ * intact, so the newest valid copy is never more than one frame old.
+ * Updates that change nothing are skipped, so a static look costs one
+ * compare per frame.
+ */
+
+#ifndef RETAINED_FRAME_H
+#define RETAINED_FRAME_H
+
+#include <Arduino.h>
+#include <esp_system.h>
+
+#define RETAINED_FRAME_SIZE 512      // DMX channels, without the start code
+#define RETAINED_EFFECT_MAX 64       // Largest effect record
+
+class RetainedFrame {
+public:
+    RetainedFrame();
+
+    /**
+     * Check the reset reason and find the newest valid copy
+     * Call once at boot, before the first update()
+     *
+     * @return true if a frame survived a warm reset
+     */
+    bool begin();
+
+    /**
+     * Check whether begin() found a retained frame
+     */
+    bool isRestored() const { return _slot >= 0; }
+
+    /**
+     * Get the retained frame
+     *
+     * @return RETAINED_FRAME_SIZE channel values, or NULL if none was restored
+     */
+    const uint8_t* getFrame() const;
+
+    /**
+     * Copy the retained effect record
+     *
+     * @return Length of the record, 0 if none was restored or it does not fit
+     */
+    size_t getEffect(void* effect, size_t capacity) const;
+
+    /**
+     * Retain the current frame and effect
+     * Called by the DMX task after each frame is sent
+     *
+     * @param frame RETAINED_FRAME_SIZE channel values
+     * @param effect Effect record, up to RETAINED_EFFECT_MAX bytes
+     */
+    void update(const uint8_t* frame, const void* effect, size_t effectLength);
+
+    /**
+     * Get the reason for the last reset
+     */
+    esp_reset_reason_t getResetReason() const { return _resetReason; }
+
+    /**
+     * Get a short name for a reset reason, such as "task_wdt"
+     */
+    static const char* resetReasonName(esp_reset_reason_t reason);
+
+    /**
+     * Get the updates written and the unchanged ones skipped
+     */
+    uint32_t getWrites() const { return _writes; }
+    uint32_t getSkipped() const { return _skipped; }
+
+private:
+    esp_reset_reason_t _resetReason;
+    int _slot;                       // Newest valid copy, -1 if none
+    uint32_t _sequence;              // Sequence number of that copy
+    uint32_t _writes;
+    uint32_t _skipped;
+};
+
+#endif // RETAINED_FRAME_H
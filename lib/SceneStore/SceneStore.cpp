@@ -0,0 +1,430 @@
+/**
+ * SceneStore.cpp - Library of stored looks in a raw flash partition
+ */
+
+#include "SceneStore.h"
+#include <rom/crc.h>
+
+#define SCENE_INDEX_MAGIC 0x584E4353UL  // "SCNX"
+
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t sequence;
+    uint16_t count;
+    uint16_t reserved;
+    uint32_t headSector;
+    uint32_t headUsed;
+    uint32_t tailSector;
+    uint32_t erases;
+    uint32_t crc;                   // CRC32 of the fields above and the entries
+};
+
+static size_t paddedSize(size_t length) {
+    return (length + 3) & ~3;
+}
+
+static uint32_t indexCrc(const IndexHeader& header, const SceneEntry* entries) {
+    uint32_t crc = crc32_le(0, (const uint8_t*)&header, offsetof(IndexHeader, crc));
+    return crc32_le(crc, (const uint8_t*)entries, header.count * sizeof(SceneEntry));
+}
+
+SceneStore::SceneStore()
+    : _partition(NULL), _map(NULL), _mapHandle(0), _lock(NULL), _dataSectors(0), _count(0),
+      _publishedCount(0), _generation(0), _publishLock(portMUX_INITIALIZER_UNLOCKED), _sequence(0), _indexSector(SCENE_INDEX_SECTORS - 1), _indexUsed(SCENE_SECTOR_SIZE), _headSector(0), _headUsed(0),
+      _tailSector(0), _erases(0) {
+}
+
+bool SceneStore::begin() {
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)SCENE_PARTITION_SUBTYPE, "scenes");
+    if (_partition == NULL) {
+        return false;
+    }
+    uint32_t sectors = _partition->size / SCENE_SECTOR_SIZE;
+    _dataSectors = sectors > SCENE_INDEX_SECTORS ? min(sectors - SCENE_INDEX_SECTORS, (uint32_t)SCENE_MAX_DATA_SECTORS) : 0;
+    if (_dataSectors < 4) {
+        return false;
+    }
+
+    const void* map;
+    if (esp_partition_mmap(_partition, 0, sectorOffset(_dataSectors), SPI_FLASH_MMAP_DATA, &map, &_mapHandle) != ESP_OK) {
+        Serial.println("Failed to map the scenes partition");
+        return false;
+    }
+    _map = (const uint8_t*)map;
+    _lock = xSemaphoreCreateMutex();
+
+    if (loadIndex()) {
+        // Data written after the last index write is dead; start afresh in the next sector
+        if (!isErased(sectorOffset(_headSector) + _headUsed, SCENE_SECTOR_SIZE - _headUsed)) {
+            _headUsed = SCENE_SECTOR_SIZE;
+        }
+        // Likewise an index copy cut short by a reset
+        if (!isErased(_indexSector * SCENE_SECTOR_SIZE + _indexUsed, SCENE_SECTOR_SIZE - _indexUsed)) {
+            _indexUsed = SCENE_SECTOR_SIZE;
+        }
+        publish();
+        return true;
+    }
+
+    // New library
+    _count = 0;
+    _tailSector = 0;
+    if (!eraseHead(0) || !writeIndex()) {
+        Serial.println("Failed to create the scene index");
+        spi_flash_munmap(_mapHandle);
+        _map = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool SceneStore::loadIndex() {
+    bool found = false;
+    for (uint8_t sector = 0; sector < SCENE_INDEX_SECTORS; sector++) {
+        // Copies follow each other from the start of the sector up to the
+        // first one that is missing or damaged
+        uint32_t offset = 0;
+        while (offset + sizeof(IndexHeader) <= SCENE_SECTOR_SIZE) {
+            const uint8_t* record = _map + sector * SCENE_SECTOR_SIZE + offset;
+            IndexHeader header;
+            memcpy(&header, record, sizeof(header));
+            uint32_t size = sizeof(header) + header.count * sizeof(SceneEntry);
+            if (header.magic != SCENE_INDEX_MAGIC || header.count > SCENE_MAX_SCENES ||
+                offset + size > SCENE_SECTOR_SIZE || header.headSector >= _dataSectors ||
+                header.tailSector >= _dataSectors || header.headUsed > SCENE_SECTOR_SIZE) {
+                break;
+            }
+            const SceneEntry* entries = (const SceneEntry*)(record + sizeof(header));
+            if (indexCrc(header, entries) != header.crc) {
+                break;
+            }
+            offset += size;
+            if (found && (int32_t)(header.sequence - _sequence) <= 0) {
+                continue;
+            }
+
+            found = true;
+            _indexSector = sector;
+            _indexUsed = offset;
+            _sequence = header.sequence;
+            _count = header.count;
+            _headSector = header.headSector;
+            _headUsed = header.headUsed;
+            _tailSector = header.tailSector;
+            _erases = header.erases;
+            memcpy(_entries, entries, _count * sizeof(SceneEntry));
+        }
+    }
+    return found;
+}
+
+/**
+ * Append the index behind the last copy, or start the other sector once
+ * this one is full; entries first, header last
+ */
+bool SceneStore::writeIndex() {
+    uint32_t size = sizeof(IndexHeader) + _count * sizeof(SceneEntry);
+    uint8_t sector = _indexSector;
+    uint32_t used = _indexUsed;
+    if (used + size > SCENE_SECTOR_SIZE) {
+        sector = (_indexSector + 1) % SCENE_INDEX_SECTORS;
+        used = 0;
+        if (esp_partition_erase_range(_partition, sector * SCENE_SECTOR_SIZE, SCENE_SECTOR_SIZE) != ESP_OK) {
+            return false;
+        }
+        _erases++;
+    }
+
+    uint32_t base = sector * SCENE_SECTOR_SIZE + used;
+    IndexHeader header = {SCENE_INDEX_MAGIC, _sequence + 1, _count, 0xFFFF,
+                          _headSector, _headUsed, _tailSector, _erases, 0};
+    header.crc = indexCrc(header, _entries);
+    if ((_count > 0 && esp_partition_write(_partition, base + sizeof(header), _entries, _count * sizeof(SceneEntry)) != ESP_OK) ||
+        esp_partition_write(_partition, base, &header, sizeof(header)) != ESP_OK) {
+        // What was written is no longer erased; the next copy goes to the other sector
+        if (sector == _indexSector) {
+            _indexUsed = SCENE_SECTOR_SIZE;
+        }
+        return false;
+    }
+    _indexSector = sector;
+    _indexUsed = used + size;
+    _sequence = header.sequence;
+    publish();
+    return true;
+}
+
+// Hand the stored index to recall()
+void SceneStore::publish() {
+    portENTER_CRITICAL(&_publishLock);
+    memcpy(_published, _entries, _count * sizeof(SceneEntry));
+    _publishedCount = _count;
+    _generation++;
+    portEXIT_CRITICAL(&_publishLock);
+}
+
+int SceneStore::find(const SceneEntry* entries, uint16_t count, uint16_t id) {
+    int low = 0;
+    int high = count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (entries[middle].id == id) {
+            return middle;
+        }
+        if (entries[middle].id < id) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+uint32_t SceneStore::sectorOffset(uint32_t sector) const {
+    return (SCENE_INDEX_SECTORS + sector) * SCENE_SECTOR_SIZE;
+}
+
+/**
+ * Live bytes the store accepts. Packed full, a sector holds more than
+ * SCENE_SECTOR_SIZE - SCENE_MAX_SIZE bytes, so at this size collecting
+ * always frees a sector, even with a replaced scene's old copy still live
+ */
+uint32_t SceneStore::capacity() const {
+    return (_dataSectors - 2) * (SCENE_SECTOR_SIZE - SCENE_MAX_SIZE) - SCENE_MAX_SIZE;
+}
+
+uint32_t SceneStore::usedSectors() const {
+    return (_headSector + _dataSectors - _tailSector) % _dataSectors + 1;
+}
+
+uint32_t SceneStore::liveBytes(int skip) const {
+    uint32_t bytes = 0;
+    for (int i = 0; i < _count; i++) {
+        if (i != skip) {
+            bytes += paddedSize(_entries[i].length);
+        }
+    }
+    return bytes;
+}
+
+bool SceneStore::isErased(uint32_t offset, uint32_t length) const {
+    for (uint32_t i = 0; i < length; i++) {
+        if (_map[offset + i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SceneStore::eraseHead(uint32_t sector) {
+    if (esp_partition_erase_range(_partition, sectorOffset(sector), SCENE_SECTOR_SIZE) != ESP_OK) {
+        Serial.println("Failed to erase scene sector");
+        return false;
+    }
+    _erases++;
+    _headSector = sector;
+    _headUsed = 0;
+    return true;
+}
+
+/**
+ * Reserve space at the head, moving to the next sector if needed
+ *
+ * @param collect Reclaim old sectors first so that one free sector is
+ *                always left for collectTail() to copy into
+ */
+bool SceneStore::allocate(size_t length, uint32_t& offset, bool collect) {
+    size_t size = paddedSize(length);
+    if (_headUsed + size > SCENE_SECTOR_SIZE) {
+        if (collect) {
+            // Every pass compacts one sector; a full turn packs all live scenes
+            for (uint32_t pass = 0; pass < 2 * _dataSectors && usedSectors() + 1 >= _dataSectors; pass++) {
+                if (!collectTail()) {
+                    return false;
+                }
+            }
+            if (usedSectors() + 1 >= _dataSectors) {
+                return false;
+            }
+        }
+        uint32_t next = (_headSector + 1) % _dataSectors;
+        if (next == _tailSector || !eraseHead(next)) {
+            return false;
+        }
+    }
+    offset = sectorOffset(_headSector) + _headUsed;
+    _headUsed += size;
+    return true;
+}
+
+// Copy the live scenes out of the oldest sector so it can be reused
+bool SceneStore::collectTail() {
+    if (_tailSector == _headSector) {
+        return false;
+    }
+    uint32_t start = sectorOffset(_tailSector);
+    for (int i = 0; i < _count; i++) {
+        SceneEntry& entry = _entries[i];
+        if (entry.length == 0 || entry.offset < start || entry.offset >= start + SCENE_SECTOR_SIZE) {
+            continue;
+        }
+        uint32_t offset;
+        memcpy(_buffer, _map + entry.offset, entry.length);
+        if (!allocate(entry.length, offset, false) || !writeData(offset, _buffer, entry.length)) {
+            return false;
+        }
+        entry.offset = offset;
+    }
+    _tailSector = (_tailSector + 1) % _dataSectors;
+
+    // The old copies may be erased by the next allocation; point at the new ones first
+    return writeIndex();
+}
+
+bool SceneStore::writeData(uint32_t offset, const uint8_t* data, size_t length) {
+    if (esp_partition_write(_partition, offset, data, length) != ESP_OK) {
+        Serial.println("Failed to write scene data");
+        return false;
+    }
+    return true;
+}
+
+bool SceneStore::save(uint16_t id, const uint8_t* data, size_t length) {
+    if (_map == NULL || length > SCENE_MAX_SIZE) {
+        return false;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    int existing = find(_entries, _count, id);
+    if ((existing < 0 && _count >= SCENE_MAX_SCENES) || liveBytes(existing) + paddedSize(length) > capacity()) {
+        xSemaphoreGive(_lock);
+        Serial.println("Scene store full");
+        return false;
+    }
+
+    // Zero-length scenes (all channels off) take no data space
+    SceneEntry entry = {id, (uint16_t)length, 0, crc32_le(0, data, length)};
+    if (length > 0 && (!allocate(length, entry.offset, true) || !writeData(entry.offset, data, length))) {
+        xSemaphoreGive(_lock);
+        return false;
+    }
+
+    // Collecting the tail moves scenes, never reorders them
+    SceneEntry previous;
+    int position = existing;
+    if (existing >= 0) {
+        previous = _entries[existing];
+        _entries[existing] = entry;
+    } else {
+        position = _count;
+        while (position > 0 && _entries[position - 1].id > id) {
+            _entries[position] = _entries[position - 1];
+            position--;
+        }
+        _entries[position] = entry;
+        _count++;
+    }
+
+    bool saved = writeIndex();
+    if (!saved) {
+        // Keep the library as stored
+        if (existing >= 0) {
+            _entries[existing] = previous;
+        } else {
+            memmove(&_entries[position], &_entries[position + 1], (_count - position - 1) * sizeof(SceneEntry));
+            _count--;
+        }
+        Serial.println("Failed to write the scene index");
+    }
+    xSemaphoreGive(_lock);
+    return saved;
+}
+
+bool SceneStore::recall(uint16_t id, uint8_t* out, size_t& length) {
+    if (_map == NULL) {
+        return false;
+    }
+
+    // A save only erases data after publishing an index that no longer
+    // points at it; if the index changed while the scene was read and the
+    // read failed its CRC, the scene moved and is read from its new place
+    for (int attempt = 0; attempt < 2; attempt++) {
+        portENTER_CRITICAL(&_publishLock);
+        uint32_t generation = _generation;
+        int index = find(_published, _publishedCount, id);
+        SceneEntry entry;
+        if (index >= 0) {
+            entry = _published[index];
+        }
+        portEXIT_CRITICAL(&_publishLock);
+        if (index < 0 || entry.length > SCENE_MAX_SIZE) {
+            return false;
+        }
+
+        const uint8_t* data = _map + entry.offset;
+        if (crc32_le(0, data, entry.length) == entry.crc) {
+            memcpy(out, data, entry.length);
+            if (generation == _generation || crc32_le(0, out, entry.length) == entry.crc) {
+                length = entry.length;
+                return true;
+            }
+        } else if (generation == _generation) {
+            break;
+        }
+    }
+    return false;
+}
+
+bool SceneStore::remove(uint16_t id) {
+    if (_map == NULL) {
+        return false;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    int index = find(_entries, _count, id);
+    bool removed = false;
+    if (index >= 0) {
+        SceneEntry entry = _entries[index];
+        memmove(&_entries[index], &_entries[index + 1], (_count - index - 1) * sizeof(SceneEntry));
+        _count--;
+        removed = writeIndex();
+        if (!removed) {
+            memmove(&_entries[index + 1], &_entries[index], (_count - index) * sizeof(SceneEntry));
+            _entries[index] = entry;
+            _count++;
+        }
+    }
+
+    xSemaphoreGive(_lock);
+    return removed;
+}
+
+bool SceneStore::contains(uint16_t id) {
+    if (_map == NULL) {
+        return false;
+    }
+    portENTER_CRITICAL(&_publishLock);
+    bool found = find(_published, _publishedCount, id) >= 0;
+    portEXIT_CRITICAL(&_publishLock);
+    return found;
+}
+
+void SceneStore::getStats(SceneStats& stats) {
+    memset(&stats, 0, sizeof(stats));
+    stats.maxScenes = SCENE_MAX_SCENES;
+    if (_map == NULL) {
+        return;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    uint32_t used = (usedSectors() - 1) * SCENE_SECTOR_SIZE + _headUsed;
+    stats.scenes = _count;
+    stats.capacity = capacity();
+    stats.liveBytes = liveBytes(-1);
+    stats.deadBytes = used - stats.liveBytes;
+    stats.freeBytes = (_dataSectors - usedSectors()) * SCENE_SECTOR_SIZE + SCENE_SECTOR_SIZE - _headUsed;
+    stats.erases = _erases;
+    stats.fragmentation = used > 0 ? (uint64_t)stats.deadBytes * 100 / used : 0;
+
+    xSemaphoreGive(_lock);
+}
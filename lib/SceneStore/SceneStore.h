@@ -0,0 +1,150 @@
+/**
+ * SceneStore.h - Library of stored looks in a raw flash partition
+ *
+ * Each scene is a DMX frame, stored without its trailing unused channels,
+ * under a 16-bit ID. The "scenes" partition is memory-mapped once at boot;
+ * recalling a scene is a binary search of the index held in RAM, a CRC
+ * check and one copy from flash into the caller's buffer. Its cost does
+ * not depend on how many scenes are stored.
+ *
+ * The first two sectors hold the index. Every change appends a new copy,
+ * with a sequence number and a CRC32, behind the last one in the sector in
+ * use; only when that sector is full is the other one erased and filled
+ * from its start, so the last stored copy survives until then. The rest of
+ * the partition is a ring of
+ * data sectors filled like a log: a saved scene is appended at the head,
+ * and the copy it replaces, like a deleted scene, is left in place as
+ * dead bytes. When the ring runs short of free sectors, the live scenes in
+ * the oldest sector are copied to the head and that sector is reused.
+ * The index is written after the data it points to, so a reset during a
+ * save leaves the previous library intact.
+ *
+ * Saves and deletes work on their own copy of the index and publish it
+ * once it is stored. Recalls read the published copy under a short
+ * spinlock and never wait for a save's erases and writes.
+ *
+ * Index:  [magic 4] [sequence 4] [count 2] [reserved 2] [head sector 4]
+ *         [head used 4] [tail sector 4] [erases 4] [CRC32 4] entries...
+ * Entry:  [id 2] [length 2] [partition offset 4] [CRC32 of the data 4]
+ */
+
+#ifndef SCENE_STORE_H
+#define SCENE_STORE_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#define SCENE_PARTITION_SUBTYPE 0x41  // Data subtype of the "scenes" partition
+#define SCENE_SECTOR_SIZE 4096
+#define SCENE_INDEX_SECTORS 2
+#define SCENE_MAX_DATA_SECTORS 64
+#define SCENE_MAX_SCENES 64
+#define SCENE_MAX_SIZE 512            // A full DMX frame
+
+struct SceneEntry {
+    uint16_t id;
+    uint16_t length;
+    uint32_t offset;                  // From the start of the partition
+    uint32_t crc;
+};
+
+struct SceneStats {
+    uint16_t scenes;
+    uint16_t maxScenes;
+    uint32_t capacity;                // Bytes of scene data the store accepts
+    uint32_t liveBytes;               // Stored scenes
+    uint32_t deadBytes;               // Replaced or deleted scenes not yet reclaimed
+    uint32_t freeBytes;               // Erased space ready for new scenes
+    uint32_t erases;                  // Data and index sector erases
+    uint8_t fragmentation;            // Dead bytes as a percentage of used bytes
+};
+
+class SceneStore {
+public:
+    SceneStore();
+
+    /**
+     * Find and map the scenes partition and load the newest index
+     *
+     * @return true if the store is usable
+     */
+    bool begin();
+
+    /**
+     * Check whether the scenes partition is available
+     */
+    bool isReady() const { return _map != NULL; }
+
+    /**
+     * Store a scene, replacing any scene with the same ID
+     *
+     * @param data Scene data, up to SCENE_MAX_SIZE bytes
+     * @return false if the store is full or the write failed
+     */
+    bool save(uint16_t id, const uint8_t* data, size_t length);
+
+    /**
+     * Copy a scene out of flash
+     *
+     * Never waits for a save or delete in progress
+     *
+     * @param out Buffer of at least SCENE_MAX_SIZE bytes
+     * @param length Set to the scene length
+     * @return false if there is no such scene or it fails its CRC
+     */
+    bool recall(uint16_t id, uint8_t* out, size_t& length);
+
+    /**
+     * Delete a scene
+     *
+     * @return false if there is no such scene or the index write failed
+     */
+    bool remove(uint16_t id);
+
+    /**
+     * Check whether a scene is stored
+     */
+    bool contains(uint16_t id);
+
+    /**
+     * Get capacity, usage and fragmentation
+     */
+    void getStats(SceneStats& stats);
+
+private:
+    const esp_partition_t* _partition;
+    const uint8_t* _map;              // The whole partition, memory-mapped
+    spi_flash_mmap_handle_t _mapHandle;
+    SemaphoreHandle_t _lock;          // Held by saves and deletes
+    uint32_t _dataSectors;
+    SceneEntry _entries[SCENE_MAX_SCENES];  // Sorted by ID
+    uint16_t _count;
+    SceneEntry _published[SCENE_MAX_SCENES];  // Stored index, read by recall()
+    uint16_t _publishedCount;
+    volatile uint32_t _generation;    // Counts publishes
+    portMUX_TYPE _publishLock;
+    uint32_t _sequence;               // Sequence number of the stored index
+    uint8_t _indexSector;             // Index sector written last
+    uint32_t _indexUsed;              // Bytes of index copies in it
+    uint32_t _headSector;             // Data sector being filled
+    uint32_t _headUsed;               // Bytes used in it
+    uint32_t _tailSector;             // Oldest data sector in use
+    uint32_t _erases;
+    uint8_t _buffer[SCENE_MAX_SIZE];  // Flash cannot be written from mapped flash
+
+    static int find(const SceneEntry* entries, uint16_t count, uint16_t id);
+    void publish();
+    uint32_t capacity() const;
+    uint32_t sectorOffset(uint32_t sector) const;
+    uint32_t usedSectors() const;
+    uint32_t liveBytes(int skip) const;
+    bool isErased(uint32_t offset, uint32_t length) const;
+    bool eraseHead(uint32_t sector);
+    bool allocate(size_t length, uint32_t& offset, bool collect);
+    bool collectTail();
+    bool writeData(uint32_t offset, const uint8_t* data, size_t length);
+    bool writeIndex();
+    bool loadIndex();
+};
+
+#endif // SCENE_STORE_H
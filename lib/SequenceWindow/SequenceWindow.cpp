@@ -0,0 +1,34 @@
+/**
+ * SequenceWindow.cpp - Duplicate suppression for sequence-numbered commands
+ */
+
+#include "SequenceWindow.h"
+
+SequenceWindow::SequenceWindow()
+    : _next(0), _count(0), _duplicates(0) {
+}
+
+bool SequenceWindow::isRepeat(uint16_t seq) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_recent[i] == seq) {
+            _duplicates++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SequenceWindow::record(uint16_t seq) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_recent[i] == seq) {
+            return;
+        }
+    }
+
+    // The oldest number is overwritten once the ring is full
+    if (_count < SEQUENCE_WINDOW_SIZE) {
+        _count++;
+    }
+    _recent[_next] = seq;
+    _next = (_next + 1) % SEQUENCE_WINDOW_SIZE;
+}
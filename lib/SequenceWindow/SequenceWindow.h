@@ -0,0 +1,52 @@
+/**
+ * SequenceWindow.h - Duplicate suppression for sequence-numbered commands
+ * 
+ * Downlinks may carry an optional 16-bit sequence number. LoRaWAN
+ * retransmissions and server retries deliver the same command more than
+ * once; the window remembers the most recent sequence numbers so a repeat
+ * is recognised and skipped instead of applied again. A number is only
+ * recorded once its command has been applied, so a command that failed
+ * is applied when the server retries it.
+ * 
+ * The recent numbers are kept in a ring of SEQUENCE_WINDOW_SIZE entries,
+ * the oldest overwritten first. Checking a number is a scan of the ring:
+ * at most 64 compares, once per downlink, in 128 bytes of RAM.
+ */
+
+#ifndef SEQUENCE_WINDOW_H
+#define SEQUENCE_WINDOW_H
+
+#include <Arduino.h>
+
+#define SEQUENCE_WINDOW_SIZE 64    // Recent sequence numbers remembered
+
+class SequenceWindow {
+public:
+    SequenceWindow();
+
+    /**
+     * Check whether a command was already applied
+     * 
+     * @param seq Sequence number of the received command
+     * @return true if it was recorded recently and must be skipped
+     */
+    bool isRepeat(uint16_t seq);
+
+    /**
+     * Record the sequence number of a command that was applied
+     */
+    void record(uint16_t seq);
+
+    /**
+     * Get the number of duplicates suppressed
+     */
+    uint32_t getDuplicates() const { return _duplicates; }
+
+private:
+    uint16_t _recent[SEQUENCE_WINDOW_SIZE];     // Ring of recent numbers, oldest at _next when full
+    uint8_t _next;
+    uint8_t _count;
+    uint32_t _duplicates;
+};
+
+#endif // SEQUENCE_WINDOW_H
@@ -0,0 +1,44 @@
+/**
+ * ShowClock.cpp - Implementation of the shared show wall-clock
+ */
+
+#include "ShowClock.h"
+
+// Constructor
+ShowClock::ShowClock() : _synced(false), _anchorUnixMs(0), _anchorLocalMs(0), _lastSyncLocalMs(0) {
+}
+
+// Record a new sync point
+void ShowClock::sync(uint64_t unixMs, uint32_t localMs) {
+    _anchorUnixMs = unixMs;
+    _anchorLocalMs = localMs;
+    _lastSyncLocalMs = localMs;
+    _synced = true;
+}
+
+// Keep the anchor recent
+void ShowClock::advance(uint32_t localMs) {
+    uint32_t elapsed = localMs - _anchorLocalMs;
+    if (_synced && elapsed >= SHOW_CLOCK_REANCHOR_MS && elapsed < 0x80000000UL) {
+        _anchorUnixMs += elapsed;
+        _anchorLocalMs = localMs;
+    }
+}
+
+// Convert local millis() to Unix milliseconds
+uint64_t ShowClock::toUnixMs(uint32_t localMs) const {
+    if (!_synced) {
+        return 0;
+    }
+    
+    // The anchor is at most an hour old, so a signed difference is exact and
+    // handles millis() wrap-around and times just before the anchor
+    int32_t delta = (int32_t)(localMs - _anchorLocalMs);
+    return (uint64_t)((int64_t)_anchorUnixMs + delta);
+}
+
+// Convert Unix milliseconds to local millis()
+uint32_t ShowClock::toLocalMs(uint64_t unixMs) const {
+    int64_t delta = (int64_t)(unixMs - _anchorUnixMs);
+    return _anchorLocalMs + (uint32_t)delta;
+}
@@ -0,0 +1,69 @@
+/**
+ * ShowClock.h - Shared wall-clock for show timing
+ * 
+ * Maps network time (Unix epoch milliseconds) onto the local millis()
+ * timeline so that commands tagged with an absolute time fire at the same
+ * moment on every node, regardless of when the downlink was delivered.
+ *
+ * Conversions work from an anchor, a local time and the Unix time that
+ * matches it. The anchor is set by each sync and moved forward every hour
+ * by advance(), so the millis() difference stays small and exact even if
+ * the network time is not refreshed for weeks.
+ */
+
+#ifndef SHOW_CLOCK_H
+#define SHOW_CLOCK_H
+
+#include <stdint.h>
+
+// The anchor is moved forward once it is this old
+#define SHOW_CLOCK_REANCHOR_MS 3600000UL
+
+class ShowClock {
+public:
+    ShowClock();
+
+    /**
+     * Synchronise the clock to network time
+     * 
+     * @param unixMs Current Unix time in milliseconds
+     * @param localMs Local millis() value at the moment unixMs was valid
+     */
+    void sync(uint64_t unixMs, uint32_t localMs);
+
+    /**
+     * Move the anchor forward once it is SHOW_CLOCK_REANCHOR_MS old
+     * Call regularly (every frame is fine) from the task that converts times
+     */
+    void advance(uint32_t localMs);
+
+    /**
+     * Check if the clock has been synchronised at least once
+     */
+    bool isSynced() const { return _synced; }
+
+    /**
+     * Convert a local millis() value to Unix time in milliseconds
+     * Returns 0 if the clock has not been synchronised
+     */
+    uint64_t toUnixMs(uint32_t localMs) const;
+
+    /**
+     * Convert an absolute Unix time in milliseconds to the local millis() timeline
+     * Only meaningful if the clock is synchronised
+     */
+    uint32_t toLocalMs(uint64_t unixMs) const;
+
+    /**
+     * Get the time (ms) of the last synchronisation on the local timeline
+     */
+    uint32_t getLastSyncLocalMs() const { return _lastSyncLocalMs; }
+
+private:
+    bool _synced;
+    uint64_t _anchorUnixMs;     // Unix time at the anchor
+    uint32_t _anchorLocalMs;    // millis() at the anchor
+    uint32_t _lastSyncLocalMs;  // millis() at the last sync
+};
+
+#endif // SHOW_CLOCK_H
@@ -0,0 +1,131 @@
+/**
+ * SpatialMap.cpp - Implementation of the fixture position map
+ */
+
+#include "SpatialMap.h"
+#include <math.h>
+
+// Constructor
+SpatialMap::SpatialMap() : _built(false), _numFixtures(0) {
+}
+
+// Stretch values to the full 16-bit range
+void SpatialMap::normalise(const int32_t* values, int count, uint16_t* out) {
+    int32_t lo = values[0];
+    int32_t hi = values[0];
+    for (int i = 1; i < count; i++) {
+        if (values[i] < lo) lo = values[i];
+        if (values[i] > hi) hi = values[i];
+    }
+    
+    int32_t span = hi - lo;
+    for (int i = 0; i < count; i++) {
+        out[i] = span > 0 ? (uint16_t)(((int64_t)(values[i] - lo) * 65535) / span) : 0;
+    }
+}
+
+// Precompute normalised coordinates
+void SpatialMap::build(const FixtureConfig* fixtures, int numFixtures) {
+    if (numFixtures > SPATIAL_MAX_FIXTURES) {
+        numFixtures = SPATIAL_MAX_FIXTURES;
+    }
+    _numFixtures = numFixtures;
+    _built = true;
+    
+    if (fixtures == NULL || numFixtures <= 0) {
+        _numFixtures = 0;
+        return;
+    }
+    
+    // Find the bounding box of positioned fixtures
+    bool anyPosition = false;
+    int32_t lo[3] = {0, 0, 0};
+    int32_t hi[3] = {0, 0, 0};
+    for (int i = 0; i < numFixtures; i++) {
+        if (!fixtures[i].hasPosition) continue;
+        int32_t p[3] = {fixtures[i].x, fixtures[i].y, fixtures[i].z};
+        for (int a = 0; a < 3; a++) {
+            if (!anyPosition || p[a] < lo[a]) lo[a] = p[a];
+            if (!anyPosition || p[a] > hi[a]) hi[a] = p[a];
+        }
+        anyPosition = true;
+    }
+    
+    // Scale uniformly by the largest extent so the rig keeps its aspect ratio
+    int32_t extent = 1;
+    for (int a = 0; a < 3; a++) {
+        if (hi[a] - lo[a] > extent) extent = hi[a] - lo[a];
+    }
+    
+    for (int i = 0; i < numFixtures; i++) {
+        if (anyPosition && fixtures[i].hasPosition) {
+            int32_t p[3] = {fixtures[i].x, fixtures[i].y, fixtures[i].z};
+            for (int a = 0; a < 3; a++) {
+                _coords[i][a] = (uint16_t)(((int64_t)(p[a] - lo[a]) * 65535) / extent);
+            }
+        } else {
+            // No position: lay the fixture out along X in index order
+            _coords[i][0] = numFixtures > 1 ? (uint16_t)((int32_t)i * 65535 / (numFixtures - 1)) : 0;
+            _coords[i][1] = 0;
+            _coords[i][2] = 0;
+        }
+    }
+    
+    // Distance from the centre of the bounding box (of the normalised coords)
+    int32_t centre[3];
+    for (int a = 0; a < 3; a++) {
+        uint16_t cLo = _coords[0][a];
+        uint16_t cHi = _coords[0][a];
+        for (int i = 1; i < numFixtures; i++) {
+            if (_coords[i][a] < cLo) cLo = _coords[i][a];
+            if (_coords[i][a] > cHi) cHi = _coords[i][a];
+        }
+        centre[a] = ((int32_t)cLo + cHi) / 2;
+    }
+    
+    int32_t distances[SPATIAL_MAX_FIXTURES];
+    int32_t maxDistance = 0;
+    for (int i = 0; i < numFixtures; i++) {
+        float dx = (float)_coords[i][0] - centre[0];
+        float dy = (float)_coords[i][1] - centre[1];
+        float dz = (float)_coords[i][2] - centre[2];
+        distances[i] = (int32_t)sqrtf(dx * dx + dy * dy + dz * dz);
+        if (distances[i] > maxDistance) maxDistance = distances[i];
+    }
+    for (int i = 0; i < numFixtures; i++) {
+        _radius[i] = maxDistance > 0 ? (uint16_t)(((int64_t)distances[i] * 65535) / maxDistance) : 0;
+    }
+}
+
+// Project onto a direction in the XY plane
+void SpatialMap::projectLinear(float angleDeg, uint16_t* out) const {
+    if (_numFixtures <= 0) return;
+    
+    float rad = angleDeg * (float)M_PI / 180.0f;
+    int32_t c = (int32_t)(cosf(rad) * 1024);
+    int32_t s = (int32_t)(sinf(rad) * 1024);
+    
+    int32_t values[SPATIAL_MAX_FIXTURES];
+    for (int i = 0; i < _numFixtures; i++) {
+        values[i] = (int32_t)_coords[i][0] * c + (int32_t)_coords[i][1] * s;
+    }
+    normalise(values, _numFixtures, out);
+}
+
+// Distance from the rig centre
+void SpatialMap::projectRadial(uint16_t* out) const {
+    for (int i = 0; i < _numFixtures; i++) {
+        out[i] = _radius[i];
+    }
+}
+
+// Coordinate along one axis
+void SpatialMap::projectAxis(SpatialAxis axis, uint16_t* out) const {
+    if (_numFixtures <= 0) return;
+    
+    int32_t values[SPATIAL_MAX_FIXTURES];
+    for (int i = 0; i < _numFixtures; i++) {
+        values[i] = _coords[i][axis];
+    }
+    normalise(values, _numFixtures, out);
+}
@@ -0,0 +1,80 @@
+/**
+ * SpatialMap.h - Fixture position map for spatial effects
+ * 
+ * Normalises fixture positions into a 16-bit coordinate space when the
+ * patch loads, and projects them onto the direction an effect travels in
+ * when the effect starts. Rendering then only needs one add per fixture,
+ * regardless of rig geometry. Fixtures without a position are placed along
+ * the X axis in index order, so effects still work on unmapped rigs.
+ */
+
+#ifndef SPATIAL_MAP_H
+#define SPATIAL_MAP_H
+
+#include <stdint.h>
+#include "DmxController.h"
+
+#define SPATIAL_MAX_FIXTURES 32
+
+// Axis selection for sweeps
+enum SpatialAxis {
+  AXIS_X = 0,
+  AXIS_Y = 1,
+  AXIS_Z = 2
+};
+
+class SpatialMap {
+public:
+    SpatialMap();
+
+    /**
+     * Precompute normalised coordinates and radial distances
+     * Call whenever fixtures or their positions change
+     * 
+     * @param fixtures Fixture array
+     * @param numFixtures Number of fixtures
+     */
+    void build(const FixtureConfig* fixtures, int numFixtures);
+
+    /**
+     * Check if the map was built for this number of fixtures
+     */
+    bool isBuiltFor(int numFixtures) const { return _built && _numFixtures == numFixtures; }
+
+    /**
+     * Project fixtures onto a direction in the XY plane
+     * Results span 0-65535 across the rig
+     * 
+     * @param angleDeg Direction of travel in degrees (0 = +X, 90 = +Y)
+     * @param out Receives one value per fixture
+     */
+    void projectLinear(float angleDeg, uint16_t* out) const;
+
+    /**
+     * Distance of each fixture from the rig centre
+     * Results span 0 (centre) to 65535 (furthest fixture)
+     */
+    void projectRadial(uint16_t* out) const;
+
+    /**
+     * Normalised coordinate of each fixture along one axis
+     * Results span 0-65535 across the rig
+     */
+    void projectAxis(SpatialAxis axis, uint16_t* out) const;
+
+    /**
+     * Get the number of fixtures in the map
+     */
+    int getNumFixtures() const { return _numFixtures; }
+
+private:
+    bool _built;
+    int _numFixtures;
+    uint16_t _coords[SPATIAL_MAX_FIXTURES][3];  // Normalised X/Y/Z per fixture
+    uint16_t _radius[SPATIAL_MAX_FIXTURES];     // Normalised distance from centre
+
+    // Stretch a set of values to the full 0-65535 range
+    static void normalise(const int32_t* values, int count, uint16_t* out);
+};
+
+#endif // SPATIAL_MAP_H
@@ -0,0 +1,262 @@
+/**
+ * StateJournal.cpp - Wear-levelled, append-only journal of the state blob
+ */
+
+#include "StateJournal.h"
+#include <rom/crc.h>
+
+#define JOURNAL_MAGIC 0x4C4E524AUL  // "JRNL"
+#define SECTOR_HEADER_SIZE 16
+#define RECORD_HEADER_SIZE 8
+#define RUN_HEADER_SIZE 4
+#define RUN_MERGE_GAP 4             // Unchanged bytes cheaper to copy than to start a new run
+
+enum JournalRecord {
+    RECORD_SNAPSHOT = 1,            // The whole blob
+    RECORD_DELTA = 2                // Changed runs against the previous state
+};
+
+struct SectorHeader {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t reserved;
+    uint32_t crc;                   // CRC32 of the fields above
+};
+
+struct RecordHeader {
+    uint16_t length;                // Data length; 0xFFFF marks erased flash
+    uint8_t type;
+    uint8_t reserved;
+    uint32_t crc;                   // CRC32 of length, type and data
+};
+
+static uint32_t recordCrc(const RecordHeader& header, const uint8_t* data) {
+    return crc32_le(crc32_le(0, (const uint8_t*)&header, 4), data, header.length);
+}
+
+static size_t paddedSize(size_t length) {
+    return (RECORD_HEADER_SIZE + length + 3) & ~3;
+}
+
+StateJournal::StateJournal()
+    : _partition(NULL), _sectorCount(0), _hasSector(false), _sector(0), _sequence(0),
+      _writeOffset(0), _tailDirty(false), _currentLength(0),
+      _changedBytes(0), _flashBytes(0), _records(0), _erases(0) {
+}
+
+bool StateJournal::begin() {
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)JOURNAL_PARTITION_SUBTYPE, "journal");
+    if (_partition == NULL) {
+        return false;
+    }
+    _sectorCount = min((uint32_t)(_partition->size / JOURNAL_SECTOR_SIZE), (uint32_t)JOURNAL_MAX_SECTORS);
+    if (_sectorCount < 2) {
+        _partition = NULL;
+        return false;
+    }
+
+    // The newest sector has the highest sequence number (serial arithmetic)
+    for (uint32_t sector = 0; sector < _sectorCount; sector++) {
+        SectorHeader header;
+        if (esp_partition_read(_partition, sector * JOURNAL_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK ||
+            header.magic != JOURNAL_MAGIC || crc32_le(0, (const uint8_t*)&header, 12) != header.crc) {
+            continue;
+        }
+        if (!_hasSector || (int32_t)(header.sequence - _sequence) > 0) {
+            _hasSector = true;
+            _sector = sector;
+            _sequence = header.sequence;
+        }
+    }
+    return true;
+}
+
+bool StateJournal::load(uint8_t* blob, size_t& length) {
+    if (_partition == NULL || !_hasSector) {
+        return false;
+    }
+    if (!replay(_sector, blob, length)) {
+        // Unreadable snapshot: the next save starts the following sector
+        _tailDirty = true;
+        return false;
+    }
+    memcpy(_current, blob, length);
+    _currentLength = length;
+    return true;
+}
+
+// Apply a sector's snapshot and deltas; leaves _writeOffset after the last good record
+bool StateJournal::replay(uint32_t sector, uint8_t* blob, size_t& length) {
+    uint32_t base = sector * JOURNAL_SECTOR_SIZE;
+    uint32_t offset = SECTOR_HEADER_SIZE;
+    bool haveSnapshot = false;
+    _tailDirty = false;
+
+    while (offset + RECORD_HEADER_SIZE <= JOURNAL_SECTOR_SIZE) {
+        RecordHeader header;
+        if (esp_partition_read(_partition, base + offset, &header, sizeof(header)) != ESP_OK) {
+            break;
+        }
+        if (header.length == 0xFFFF) {
+            break;  // Erased flash: end of the journal
+        }
+        if (header.length > sizeof(_record) || offset + paddedSize(header.length) > JOURNAL_SECTOR_SIZE ||
+            esp_partition_read(_partition, base + offset + RECORD_HEADER_SIZE, _record, header.length) != ESP_OK ||
+            recordCrc(header, _record) != header.crc) {
+            _tailDirty = true;  // Torn record; never append after it
+            break;
+        }
+
+        if (header.type == RECORD_SNAPSHOT && header.length <= STATE_MAX_SIZE) {
+            memcpy(blob, _record, header.length);
+            length = header.length;
+            haveSnapshot = true;
+        } else if (header.type == RECORD_DELTA && haveSnapshot && header.length >= 2) {
+            size_t newLength = _record[0] | (_record[1] << 8);
+            if (newLength > STATE_MAX_SIZE) {
+                _tailDirty = true;
+                break;
+            }
+            if (newLength > length) {
+                memset(blob + length, 0, newLength - length);
+            }
+            size_t position = 2;
+            while (position + RUN_HEADER_SIZE <= header.length) {
+                size_t runOffset = _record[position] | (_record[position + 1] << 8);
+                size_t runLength = _record[position + 2] | (_record[position + 3] << 8);
+                position += RUN_HEADER_SIZE;
+                if (runOffset + runLength > newLength || position + runLength > header.length) {
+                    break;
+                }
+                memcpy(blob + runOffset, _record + position, runLength);
+                position += runLength;
+            }
+            length = newLength;
+        }
+        offset += paddedSize(header.length);
+    }
+
+    _writeOffset = offset;
+    return haveSnapshot;
+}
+
+// Encode the changed runs into _record; returns 0 if nothing changed
+size_t StateJournal::buildDelta(const uint8_t* blob, size_t length, uint32_t& changed) {
+    size_t size = 2;
+    _record[0] = length & 0xFF;
+    _record[1] = length >> 8;
+    changed = 0;
+
+    size_t i = 0;
+    while (i < length) {
+        if (i < _currentLength && blob[i] == _current[i]) {
+            i++;
+            continue;
+        }
+
+        // Extend the run over short unchanged gaps
+        size_t last = i;
+        for (size_t j = i + 1; j < length && j - last <= RUN_MERGE_GAP; j++) {
+            if (j >= _currentLength || blob[j] != _current[j]) {
+                last = j;
+            }
+        }
+        size_t runLength = last - i + 1;
+        if (size + RUN_HEADER_SIZE + runLength > length) {
+            return length + 1;  // No smaller than a snapshot
+        }
+        _record[size] = i & 0xFF;
+        _record[size + 1] = i >> 8;
+        _record[size + 2] = runLength & 0xFF;
+        _record[size + 3] = runLength >> 8;
+        memcpy(_record + size + RUN_HEADER_SIZE, blob + i, runLength);
+        size += RUN_HEADER_SIZE + runLength;
+        for (size_t k = i; k <= last; k++) {
+            changed += k >= _currentLength || blob[k] != _current[k];
+        }
+        i = last + 1;
+    }
+
+    return (size == 2 && length == _currentLength) ? 0 : size;
+}
+
+bool StateJournal::appendRecord(uint8_t type, const uint8_t* data, size_t length) {
+    RecordHeader header = {(uint16_t)length, type, 0xFF, 0};
+    header.crc = recordCrc(header, data);
+
+    uint32_t address = _sector * JOURNAL_SECTOR_SIZE + _writeOffset;
+    if (esp_partition_write(_partition, address, &header, sizeof(header)) != ESP_OK ||
+        esp_partition_write(_partition, address + RECORD_HEADER_SIZE, data, length) != ESP_OK) {
+        _tailDirty = true;
+        return false;
+    }
+    _writeOffset += paddedSize(length);
+    _flashBytes += paddedSize(length);
+    _records++;
+    return true;
+}
+
+// Compaction: erase the next sector and begin it with a snapshot
+bool StateJournal::startSector(const uint8_t* blob, size_t length) {
+    uint32_t sector = _hasSector ? (_sector + 1) % _sectorCount : 0;
+    uint32_t sequence = _hasSector ? _sequence + 1 : 1;
+
+    if (esp_partition_erase_range(_partition, sector * JOURNAL_SECTOR_SIZE, JOURNAL_SECTOR_SIZE) != ESP_OK) {
+        Serial.println("Failed to erase journal sector");
+        return false;
+    }
+    _erases++;
+
+    // Snapshot first, header last: a sector without a header is ignored
+    uint32_t previousSector = _sector;
+    _sector = sector;
+    _writeOffset = SECTOR_HEADER_SIZE;
+    _tailDirty = false;
+    if (!appendRecord(RECORD_SNAPSHOT, blob, length)) {
+        _sector = previousSector;
+        return false;
+    }
+
+    SectorHeader header = {JOURNAL_MAGIC, sequence, 0xFFFFFFFFUL, 0};
+    header.crc = crc32_le(0, (const uint8_t*)&header, 12);
+    if (esp_partition_write(_partition, sector * JOURNAL_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK) {
+        _sector = previousSector;
+        return false;
+    }
+    _flashBytes += SECTOR_HEADER_SIZE;
+    _hasSector = true;
+    _sequence = sequence;
+    return true;
+}
+
+bool StateJournal::save(const uint8_t* blob, size_t length) {
+    if (_partition == NULL || length > STATE_MAX_SIZE) {
+        return false;
+    }
+
+    uint32_t changed = length;
+    if (_hasSector && !_tailDirty) {
+        size_t deltaSize = buildDelta(blob, length, changed);
+        if (deltaSize == 0) {
+            return true;
+        }
+        if (deltaSize <= length && _writeOffset + paddedSize(deltaSize) <= JOURNAL_SECTOR_SIZE) {
+            if (!appendRecord(RECORD_DELTA, _record, deltaSize)) {
+                return false;
+            }
+            _changedBytes += changed;
+            memcpy(_current, blob, length);
+            _currentLength = length;
+            return true;
+        }
+    }
+
+    // Sector full, delta as large as the state, or nothing to build on
+    if (!startSector(blob, length)) {
+        return false;
+    }
+    _changedBytes += changed;
+    memcpy(_current, blob, length);
+    _currentLength = length;
+    return true;
+}
@@ -0,0 +1,108 @@
+/**
+ * StateJournal.h - Wear-levelled, append-only journal of the state blob
+ *
+ * The state blob (see StateStore.h) is kept in its own flash partition as
+ * a log instead of being rewritten in NVS. A save appends one small
+ * record holding only the bytes that changed since the previous save.
+ *
+ * The partition is used as a ring of 4 KB sectors. Each sector starts
+ * with a snapshot of the whole blob, followed by delta records. When a
+ * sector is full the next one is erased and begins with a new snapshot;
+ * that is the compaction, and everything in older sectors becomes
+ * garbage. Sectors are used in turn, so erases are spread evenly over
+ * the partition.
+ *
+ * At boot the sector with the highest sequence number is replayed: its
+ * snapshot, then each delta until the first record that is missing or
+ * fails its CRC. A save cut short by a reset is simply not replayed. A
+ * sector header is written only after its snapshot, so a half-started
+ * sector is ignored and the previous sector is still intact.
+ *
+ * Sector:  [magic 4] [sequence 4] [reserved 4] [header CRC 4] records...
+ * Record:  [data length 2] [type 1] [reserved 1] [CRC32 4] [data], padded to 4 bytes
+ * Delta:   [blob length 2] runs of [offset 2] [length 2] [bytes]
+ */
+
+#ifndef STATE_JOURNAL_H
+#define STATE_JOURNAL_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "StateStore.h"
+
+#define JOURNAL_PARTITION_SUBTYPE 0x40  // Data subtype of the "journal" partition
+#define JOURNAL_SECTOR_SIZE 4096
+#define JOURNAL_MAX_SECTORS 64
+
+class StateJournal {
+public:
+    StateJournal();
+
+    /**
+     * Find the journal partition and the newest sector
+     *
+     * @return true if the partition exists; the journal may still be empty
+     */
+    bool begin();
+
+    /**
+     * Check whether the journal partition is available
+     */
+    bool isReady() const { return _partition != NULL; }
+
+    /**
+     * Replay the newest sector
+     *
+     * @param blob Buffer of at least STATE_MAX_SIZE bytes
+     * @param length Set to the blob length
+     * @return true if a saved state was found
+     */
+    bool load(uint8_t* blob, size_t& length);
+
+    /**
+     * Append the changes since the last save or load
+     *
+     * @return true if the state is stored
+     */
+    bool save(const uint8_t* blob, size_t length);
+
+    /**
+     * Metrics
+     * Write amplification is flash bytes written per state byte changed;
+     * wear is the number of times each sector has been erased, since the
+     * sequence number advances by one per sector erase
+     */
+    uint32_t getChangedBytes() const { return _changedBytes; }
+    uint32_t getFlashBytes() const { return _flashBytes; }
+    uint32_t getRecords() const { return _records; }
+    uint32_t getErases() const { return _erases; }
+    uint32_t getSectorWear() const { return _sectorCount > 0 ? _sequence / _sectorCount : 0; }
+    uint32_t getSectorCount() const { return _sectorCount; }
+    float getWriteAmplification() const {
+        return _changedBytes > 0 ? (float)_flashBytes / _changedBytes : 0;
+    }
+
+private:
+    const esp_partition_t* _partition;
+    uint32_t _sectorCount;
+    bool _hasSector;                   // _sector holds the newest valid sector
+    uint32_t _sector;
+    uint32_t _sequence;                // Sequence number of _sector
+    uint32_t _writeOffset;             // Next record position in _sector
+    bool _tailDirty;                   // Bytes after the last record are not erased
+    uint8_t _current[STATE_MAX_SIZE];  // State as stored
+    size_t _currentLength;
+    uint8_t _record[STATE_MAX_SIZE + 8];
+
+    uint32_t _changedBytes;
+    uint32_t _flashBytes;
+    uint32_t _records;
+    uint32_t _erases;
+
+    size_t buildDelta(const uint8_t* blob, size_t length, uint32_t& changed);
+    bool appendRecord(uint8_t type, const uint8_t* data, size_t length);
+    bool startSector(const uint8_t* blob, size_t length);
+    bool replay(uint32_t sector, uint8_t* blob, size_t& length);
+};
+
+#endif // STATE_JOURNAL_H
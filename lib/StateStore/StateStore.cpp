@@ -0,0 +1,204 @@
+/**
+ * StateStore.cpp - Versioned, CRC-protected state blob in NVS
+ */
+
+#include "StateStore.h"
+#include <rom/crc.h>
+
+#define STATE_MAGIC 0x53584D44UL  // "DMXS"
+#define SECTION_HEADER_SIZE 3
+
+// Stored under each set's header key
+struct StateHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t pages;
+    uint16_t length;
+    uint32_t crc;        // CRC32 of the whole blob
+    uint32_t sequence;   // Newer saves count up; absent in older firmware's header
+};
+
+// Set A keeps older firmware's key names
+static const char* const headerKeys[2] = {"hdr", "hdr1"};
+
+static void pageKey(char* key, size_t size, uint8_t set, uint8_t page) {
+    snprintf(key, size, set == 0 ? "p%u" : "q%u", page);
+}
+
+StateWriter::StateWriter(uint8_t* buffer, size_t capacity)
+    : _buffer(buffer), _capacity(capacity), _length(0), _lastSection(0) {
+}
+
+uint8_t* StateWriter::addSection(uint8_t type, size_t length) {
+    if (length > 0xFFFF || _length + SECTION_HEADER_SIZE + length > _capacity) {
+        return NULL;
+    }
+    _lastSection = _length;
+    _buffer[_length] = type;
+    _buffer[_length + 1] = length & 0xFF;
+    _buffer[_length + 2] = length >> 8;
+    _length += SECTION_HEADER_SIZE + length;
+    return _buffer + _lastSection + SECTION_HEADER_SIZE;
+}
+
+void StateWriter::endSection(size_t length) {
+    size_t reserved = _length - _lastSection - SECTION_HEADER_SIZE;
+    if (length < reserved) {
+        _buffer[_lastSection + 1] = length & 0xFF;
+        _buffer[_lastSection + 2] = length >> 8;
+        _length = _lastSection + SECTION_HEADER_SIZE + length;
+    }
+}
+
+const uint8_t* stateFindSection(const uint8_t* blob, size_t blobLength, uint8_t type, size_t& length) {
+    size_t position = 0;
+    while (position + SECTION_HEADER_SIZE <= blobLength) {
+        size_t sectionLength = blob[position + 1] | (blob[position + 2] << 8);
+        const uint8_t* data = blob + position + SECTION_HEADER_SIZE;
+        if (sectionLength > blobLength - position - SECTION_HEADER_SIZE) {
+            return NULL;
+        }
+        if (blob[position] == type) {
+            length = sectionLength;
+            return data;
+        }
+        position += SECTION_HEADER_SIZE + sectionLength;
+    }
+    return NULL;
+}
+
+StateStore::StateStore(const char* name)
+    : _name(name), _hasCurrent(false), _current(0), _sequence(0), _storedLength(0),
+      _pagesWritten(0), _pagesSkipped(0) {
+    memset(_pageCrc, 0, sizeof(_pageCrc));
+    memset(_storedPages, 0, sizeof(_storedPages));
+}
+
+// Called with the preferences open
+bool StateStore::readHeader(uint8_t set, StateHeader& header) {
+    header.sequence = 0;
+    size_t size = _preferences.getBytes(headerKeys[set], &header, sizeof(header));
+    return (size == sizeof(header) || size == offsetof(StateHeader, sequence)) &&
+           header.magic == STATE_MAGIC && header.version <= STATE_VERSION &&
+           header.length <= STATE_MAX_SIZE &&
+           header.pages == (header.length + STATE_PAGE_SIZE - 1) / STATE_PAGE_SIZE;
+}
+
+/**
+ * Read one set into the blob, remembering the CRC of each page read
+ * Called with the preferences open
+ *
+ * @return true if the pages match the header's CRC
+ */
+bool StateStore::readSet(uint8_t set, const StateHeader& header, uint8_t* blob) {
+    _storedPages[set] = 0;
+    for (uint8_t page = 0; page < header.pages; page++) {
+        char key[8];
+        pageKey(key, sizeof(key), set, page);
+        size_t offset = page * STATE_PAGE_SIZE;
+        size_t size = min((size_t)STATE_PAGE_SIZE, (size_t)header.length - offset);
+        if (_preferences.getBytes(key, blob + offset, size) != size) {
+            return false;
+        }
+        _pageCrc[set][page] = crc32_le(0, blob + offset, size);
+        _storedPages[set] = page + 1;
+    }
+    return crc32_le(0, blob, header.length) == header.crc;
+}
+
+bool StateStore::load(uint8_t* blob, size_t& length) {
+    if (!_preferences.begin(_name, true)) {
+        return false;
+    }
+
+    // Newest set first; the other one is only read if that fails its CRC
+    StateHeader headers[2];
+    bool present[2] = {readHeader(0, headers[0]), readHeader(1, headers[1])};
+    uint8_t newest = present[1] && (!present[0] || (int32_t)(headers[1].sequence - headers[0].sequence) > 0) ? 1 : 0;
+    _hasCurrent = false;
+    for (uint8_t i = 0; i < 2 && !_hasCurrent; i++) {
+        uint8_t set = i == 0 ? newest : 1 - newest;
+        if (present[set] && readSet(set, headers[set], blob)) {
+            _hasCurrent = true;
+            _current = set;
+        }
+    }
+    _preferences.end();
+
+    if (!_hasCurrent) {
+        return false;
+    }
+    _sequence = headers[_current].sequence;
+    _storedLength = headers[_current].length;
+    length = _storedLength;
+    return true;
+}
+
+bool StateStore::save(const uint8_t* blob, size_t length) {
+    if (length > STATE_MAX_SIZE) {
+        return false;
+    }
+
+    uint8_t pages = (length + STATE_PAGE_SIZE - 1) / STATE_PAGE_SIZE;
+    uint32_t pageCrc[STATE_MAX_PAGES];
+    bool changed = !_hasCurrent || length != _storedLength || pages != _storedPages[_current];
+    for (uint8_t page = 0; page < pages; page++) {
+        size_t offset = page * STATE_PAGE_SIZE;
+        pageCrc[page] = crc32_le(0, blob + offset, min((size_t)STATE_PAGE_SIZE, length - offset));
+        changed |= page >= _storedPages[_current] || pageCrc[page] != _pageCrc[_current][page];
+    }
+    if (!changed) {
+        _pagesSkipped += pages;
+        return true;
+    }
+
+    if (!_preferences.begin(_name, false)) {
+        Serial.println("Failed to open state preferences");
+        return false;
+    }
+
+    // The last good blob stays untouched until this set's header commits
+    uint8_t set = _hasCurrent ? 1 - _current : 0;
+    bool saved = true;
+    for (uint8_t page = 0; page < pages && saved; page++) {
+        if (page < _storedPages[set] && pageCrc[page] == _pageCrc[set][page]) {
+            _pagesSkipped++;
+            continue;
+        }
+        char key[8];
+        pageKey(key, sizeof(key), set, page);
+        size_t offset = page * STATE_PAGE_SIZE;
+        size_t size = min((size_t)STATE_PAGE_SIZE, length - offset);
+        saved = _preferences.putBytes(key, blob + offset, size) == size;
+        _pagesWritten++;
+    }
+
+    // Pages past the new end are no longer part of the blob
+    for (uint8_t page = pages; page < _storedPages[set] && saved; page++) {
+        char key[8];
+        pageKey(key, sizeof(key), set, page);
+        _preferences.remove(key);
+    }
+
+    if (saved) {
+        StateHeader header = {STATE_MAGIC, STATE_VERSION, pages, (uint16_t)length,
+                              crc32_le(0, blob, length), _sequence + 1};
+        saved = _preferences.putBytes(headerKeys[set], &header, sizeof(header)) == sizeof(header);
+    }
+    _preferences.end();
+
+    if (!saved) {
+        // What this set holds is unknown now; write every page next time
+        _storedPages[set] = 0;
+        Serial.println("Failed to save state");
+        return false;
+    }
+
+    memcpy(_pageCrc[set], pageCrc, sizeof(uint32_t) * pages);
+    _storedPages[set] = pages;
+    _hasCurrent = true;
+    _current = set;
+    _sequence++;
+    _storedLength = length;
+    return true;
+}
@@ -0,0 +1,137 @@
+/**
+ * StateStore.h - Versioned, CRC-protected state blob in NVS
+ *
+ * Everything needed to restore the last look (frame, palette, patch) is
+ * kept as one binary blob of tagged sections instead of dozens of
+ * separate keys. Loading at boot is one header read, a read per page and
+ * a CRC check.
+ *
+ * The blob is stored in pages of STATE_PAGE_SIZE bytes, one NVS key each,
+ * plus a header with a sequence number, the length and the CRC32 of the
+ * whole blob. There are two such sets of keys, A and B. A save goes to the
+ * set that does not hold the last good blob and is committed by writing
+ * that set's header last; a save cut short by a reset fails the CRC check
+ * and the other set, still intact, is loaded instead. The CRC of every
+ * stored page is remembered, so a save only rewrites the pages of its set
+ * whose contents differ: a new color on one fixture costs a page write in
+ * each set, not the whole state. Set A uses the key names of the single
+ * set older firmware wrote, so its state still loads.
+ *
+ * Sections are [type] [length, 2 bytes LE] [data]; unknown types are
+ * skipped, so new sections can be added without a version change.
+ */
+
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#define STATE_VERSION 1          // Blob layout version; older layouts are migrated
+#define STATE_PAGE_SIZE 256      // Bytes per NVS key
+#define STATE_MAX_PAGES 8        // Largest blob: 2 KB
+#define STATE_MAX_SIZE (STATE_PAGE_SIZE * STATE_MAX_PAGES)
+
+// Section types
+enum StateSection {
+    STATE_SECTION_FRAME = 1,     // 512 DMX channel values
+    STATE_SECTION_PALETTE = 2,   // Palette entries, RGBW
+    STATE_SECTION_PATCH = 3,     // Fixture patch and groups (DmxController::exportPatch)
+    STATE_SECTION_SCENES = 4     // Reserved for stored scenes
+};
+
+/**
+ * Builds a blob section by section
+ */
+class StateWriter {
+public:
+    StateWriter(uint8_t* buffer, size_t capacity);
+
+    /**
+     * Add a section
+     *
+     * @param type Section type
+     * @param length Data length
+     * @return Where to write the data, or NULL if the blob is full
+     */
+    uint8_t* addSection(uint8_t type, size_t length);
+
+    /**
+     * Shorten the last section once its data is written
+     */
+    void endSection(size_t length);
+
+    size_t length() const { return _length; }
+
+    /**
+     * Get the largest section that still fits
+     */
+    size_t available() const {
+        return _capacity - _length > 3 ? _capacity - _length - 3 : 0;
+    }
+
+private:
+    uint8_t* _buffer;
+    size_t _capacity;
+    size_t _length;
+    size_t _lastSection;
+};
+
+/**
+ * Find a section in a blob
+ *
+ * @param length Set to the section length
+ * @return Section data, or NULL if the blob has no such section
+ */
+const uint8_t* stateFindSection(const uint8_t* blob, size_t blobLength, uint8_t type, size_t& length);
+
+struct StateHeader;
+
+class StateStore {
+public:
+    /**
+     * Constructor
+     *
+     * @param name NVS namespace
+     */
+    StateStore(const char* name);
+
+    /**
+     * Load the blob and check its CRC
+     *
+     * @param blob Buffer of at least STATE_MAX_SIZE bytes
+     * @param length Set to the blob length
+     * @return true if a valid blob was found
+     */
+    bool load(uint8_t* blob, size_t& length);
+
+    /**
+     * Save the blob, writing only the pages that changed
+     *
+     * @return true if the blob is stored
+     */
+    bool save(const uint8_t* blob, size_t length);
+
+    /**
+     * Get the page writes carried out and avoided
+     */
+    uint32_t getPagesWritten() const { return _pagesWritten; }
+    uint32_t getPagesSkipped() const { return _pagesSkipped; }
+
+private:
+    const char* _name;
+    Preferences _preferences;
+    uint32_t _pageCrc[2][STATE_MAX_PAGES];  // CRC of each page stored in each set
+    uint8_t _storedPages[2];             // Pages known to be stored in each set, 0 if unknown
+    bool _hasCurrent;
+    uint8_t _current;                    // Set holding the last good blob
+    uint32_t _sequence;                  // Its sequence number
+    size_t _storedLength;                // Its length
+    uint32_t _pagesWritten;
+    uint32_t _pagesSkipped;
+
+    bool readHeader(uint8_t set, StateHeader& header);
+    bool readSet(uint8_t set, const StateHeader& header, uint8_t* blob);
+};
+
+#endif // STATE_STORE_H
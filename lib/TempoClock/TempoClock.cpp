@@ -0,0 +1,121 @@
+/**
+ * TempoClock.cpp - Implementation of the tempo clock
+ */
+
+#include "TempoClock.h"
+
+// Taps further apart than this start a new tap sequence
+#define TAP_RESET_MS 2000
+
+// Constructor
+TempoClock::TempoClock() :
+    _centiBpm(TEMPO_DEFAULT_CBPM),
+    _beatsPerBar(4),
+    _anchorMs(0),
+    _anchorPos(0),
+    _lastTapMs(0),
+    _tapCount(0) {
+}
+
+// Beat position at the given time
+uint64_t TempoClock::getPosition(uint32_t nowMs) const {
+    // Beats per ms = centiBpm / 6,000,000. The anchor is at most an hour
+    // old, so a signed difference is exact and a time just before the
+    // anchor reads as slightly negative
+    int64_t elapsed = (int32_t)(nowMs - _anchorMs);
+    int64_t delta = (elapsed * (int64_t)_centiBpm * TEMPO_BEAT_ONE) / 6000000LL;
+    
+    if (delta < 0 && (uint64_t)(-delta) > _anchorPos) {
+        return 0;
+    }
+    return _anchorPos + delta;
+}
+
+// Ticks elapsed for a subdivision
+uint32_t TempoClock::getTicks(uint32_t nowMs, uint32_t ticksPerBeatQ8) const {
+    return (uint32_t)((getPosition(nowMs) * ticksPerBeatQ8) >> 24);
+}
+
+// Move the anchor to the current time
+void TempoClock::reanchor(uint32_t nowMs) {
+    _anchorPos = getPosition(nowMs);
+    _anchorMs = nowMs;
+}
+
+// Set the tempo, keeping phase
+void TempoClock::setTempo(uint32_t centiBpm, uint32_t nowMs) {
+    if (centiBpm < TEMPO_MIN_CBPM) centiBpm = TEMPO_MIN_CBPM;
+    if (centiBpm > TEMPO_MAX_CBPM) centiBpm = TEMPO_MAX_CBPM;
+    
+    reanchor(nowMs);
+    _centiBpm = centiBpm;
+}
+
+// Register a tap
+void TempoClock::tap(uint32_t nowMs) {
+    uint32_t interval = nowMs - _lastTapMs;
+    _lastTapMs = nowMs;
+    
+    if (_tapCount == 0 || interval > TAP_RESET_MS) {
+        // First tap of a sequence only aligns the phase
+        _tapCount = 1;
+    } else {
+        // Shift the interval history and average it
+        for (int i = 3; i > 0; i--) {
+            _tapIntervals[i] = _tapIntervals[i - 1];
+        }
+        _tapIntervals[0] = interval;
+        if (_tapCount < 5) {
+            _tapCount++;
+        }
+        
+        uint32_t sum = 0;
+        uint8_t intervals = _tapCount - 1;
+        for (int i = 0; i < intervals; i++) {
+            sum += _tapIntervals[i];
+        }
+        if (sum > 0) {
+            setTempo((6000000UL * intervals) / sum, nowMs);
+        }
+    }
+    
+    // Round up to the next whole beat so running effects never jump backwards
+    uint64_t pos = getPosition(nowMs);
+    _anchorPos = (pos + TEMPO_BEAT_ONE - 1) & ~(uint64_t)(TEMPO_BEAT_ONE - 1);
+    _anchorMs = nowMs;
+}
+
+// Shift the phase by some milliseconds
+void TempoClock::nudge(int32_t ms, uint32_t nowMs) {
+    reanchor(nowMs);
+    int64_t delta = ((int64_t)ms * (int64_t)_centiBpm * TEMPO_BEAT_ONE) / 6000000LL;
+    
+    if (delta < 0 && (uint64_t)(-delta) > _anchorPos) {
+        _anchorPos = 0;
+    } else {
+        _anchorPos += delta;
+    }
+}
+
+// Declare now to be the start of a bar
+void TempoClock::downbeat(uint32_t nowMs) {
+    // Round up to the next bar so running effects never jump backwards
+    uint64_t barLength = (uint64_t)_beatsPerBar * TEMPO_BEAT_ONE;
+    uint64_t pos = getPosition(nowMs);
+    _anchorPos = ((pos + barLength - 1) / barLength) * barLength;
+    _anchorMs = nowMs;
+}
+
+// Keep the anchor recent
+void TempoClock::advance(uint32_t nowMs) {
+    if (nowMs - _anchorMs >= TEMPO_REANCHOR_MS && nowMs - _anchorMs < 0x80000000UL) {
+        reanchor(nowMs);
+    }
+}
+
+// Set the number of beats per bar
+void TempoClock::setBeatsPerBar(uint8_t beatsPerBar) {
+    if (beatsPerBar < 1) beatsPerBar = 1;
+    if (beatsPerBar > 16) beatsPerBar = 16;
+    _beatsPerBar = beatsPerBar;
+}
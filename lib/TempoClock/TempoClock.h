@@ -0,0 +1,135 @@
+/**
+ * TempoClock.h - Musical time base for tempo-locked effects
+ * 
+ * Tracks a BPM tempo and a continuous beat position so that effects can
+ * derive their timing from beats instead of raw millisecond intervals.
+ * The beat position is kept in fixed point (1/65536 beat) and re-anchored
+ * whenever the tempo changes, so running effects keep their phase and simply
+ * speed up or slow down. It is also re-anchored every hour by advance(),
+ * so the time since the anchor never nears the 32-bit millis() limits.
+ */
+
+#ifndef TEMPO_CLOCK_H
+#define TEMPO_CLOCK_H
+
+#include <stdint.h>
+
+// Tempo limits in centi-BPM (BPM * 100)
+#define TEMPO_MIN_CBPM 2000    // 20 BPM
+#define TEMPO_MAX_CBPM 30000   // 300 BPM
+#define TEMPO_DEFAULT_CBPM 12000
+
+// Fixed point scale of the beat position (1.0 beat)
+#define TEMPO_BEAT_ONE 65536
+
+// The anchor is moved forward once it is this old
+#define TEMPO_REANCHOR_MS 3600000UL
+
+class TempoClock {
+public:
+    TempoClock();
+
+    /**
+     * Set the tempo, keeping the current beat phase
+     * 
+     * @param centiBpm Tempo in BPM * 100 (e.g. 12800 = 128 BPM)
+     * @param nowMs Current millis()
+     */
+    void setTempo(uint32_t centiBpm, uint32_t nowMs);
+
+    /**
+     * Register a tap for tap-tempo
+     * Consecutive taps less than 2 seconds apart set the tempo from their
+     * average interval, and each tap moves the phase forward to a whole beat
+     * 
+     * @param nowMs Time of the tap
+     */
+    void tap(uint32_t nowMs);
+
+    /**
+     * Shift the beat phase by a number of milliseconds
+     * Positive values move the clock ahead, negative values hold it back
+     */
+    void nudge(int32_t ms, uint32_t nowMs);
+
+    /**
+     * Declare the current moment as the start of a bar
+     * The position moves on to the next bar boundary, never back
+     */
+    void downbeat(uint32_t nowMs);
+
+    /**
+     * Re-anchor once the anchor is TEMPO_REANCHOR_MS old
+     * Call regularly (every frame is fine) from the task that reads the clock
+     */
+    void advance(uint32_t nowMs);
+
+    /**
+     * Set the number of beats per bar (1-16)
+     */
+    void setBeatsPerBar(uint8_t beatsPerBar);
+
+    /**
+     * Get the beat position in 1/65536 beats since the last downbeat reset
+     */
+    uint64_t getPosition(uint32_t nowMs) const;
+
+    /**
+     * Get the number of whole ticks elapsed for a given subdivision
+     * 
+     * @param nowMs Current millis()
+     * @param ticksPerBeatQ8 Ticks per beat * 256 (256 = one tick per beat)
+     */
+    uint32_t getTicks(uint32_t nowMs, uint32_t ticksPerBeatQ8) const;
+
+    /**
+     * Get the phase within the current beat (0-65535)
+     */
+    uint16_t getBeatPhase(uint32_t nowMs) const { return (uint16_t)getPosition(nowMs); }
+
+    /**
+     * Get the whole beat counter
+     */
+    uint32_t getBeat(uint32_t nowMs) const { return (uint32_t)(getPosition(nowMs) >> 16); }
+
+    /**
+     * Get the bar counter
+     */
+    uint32_t getBar(uint32_t nowMs) const { return getBeat(nowMs) / _beatsPerBar; }
+
+    /**
+     * Get the beat within the current bar (0-based)
+     */
+    uint8_t getBeatInBar(uint32_t nowMs) const { return getBeat(nowMs) % _beatsPerBar; }
+
+    /**
+     * Get the current tempo in BPM * 100
+     */
+    uint32_t getTempo() const { return _centiBpm; }
+
+    /**
+     * Get the length of one beat in milliseconds
+     */
+    uint32_t getBeatMs() const { return 6000000UL / _centiBpm; }
+
+    /**
+     * Get the number of beats per bar
+     */
+    uint8_t getBeatsPerBar() const { return _beatsPerBar; }
+
+private:
+    uint32_t _centiBpm;      // Tempo in BPM * 100
+    uint8_t _beatsPerBar;
+    uint32_t _anchorMs;      // millis() of the anchor point
+    uint64_t _anchorPos;     // Beat position at the anchor point (1/65536 beat)
+
+    // Tap tempo state
+    uint32_t _lastTapMs;
+    uint32_t _tapIntervals[4];
+    uint8_t _tapCount;
+
+    // Move the anchor to now so that tempo changes keep the phase
+    void reanchor(uint32_t nowMs);
+};
+
+#endif // TEMPO_CLOCK_H
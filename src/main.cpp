@@ -62,10 +62,132 @@
  *   }
  * }
  * 
+ * 6. Time Sync (sets the show clock used by scheduled commands):
+ * {
+ *   "time": {
+ *     "unix": 1700000000, // Unix time in seconds
+ *     "ms": 250           // Optional: milliseconds part
+ *   }
+ * }
+ * 
+ * 7. Scheduled Command (executes any other command at an absolute time):
+ * {
+ *   "schedule": {
+ *     "at": 1700000120,   // Unix time in seconds (requires time sync), or
+ *     "in": 5000,         // delay in ms from reception
+ *     "ms": 500,          // Optional: milliseconds part of "at"
+ *     "id": 7,            // Optional: ID for cancellation
+ *     "cmd": {"pattern": "rainbow"}
+ *   }
+ * }
+ * Cancel with {"schedule": {"cancel": 7}} or {"schedule": {"clear": true}}
+ * 
+ * 8. Tempo Clock (time base for tempo-locked patterns):
+ * {
+ *   "tempo": {
+ *     "bpm": 128,         // Optional: tempo in BPM (20-300)
+ *     "beatsPerBar": 4,   // Optional: beats per bar (1-16)
+ *     "tap": true,        // Optional: register a tap-tempo tap
+ *     "nudge": -20,       // Optional: shift the beat phase in ms
+ *     "downbeat": true    // Optional: the current moment starts a bar
+ *   }
+ * }
+ * Patterns follow the tempo when started with "division" (steps per beat):
+ * {"pattern": {"type": "strobe", "division": 2, "cycles": 0}}
+ * 
+ * 9. Fixture Positions (for spatial patterns "wave", "radial" and "sweep"):
+ * {
+ *   "positions": [[0, 0], [100, 0], [200, 50, 30]]   // x, y(, z) per fixture in order
+ * }
+ * or {"positions": [{"fixture": 2, "x": 100, "y": 0, "z": 0}]}
+ * Spatial patterns: {"pattern": {"type": "wave", "angle": 90}},
+ * {"pattern": {"type": "sweep", "axis": "y"}}, {"pattern": "radial"}
+ * 
+ * 10. Fixture Groups (1-based fixture numbers, group IDs 0-7):
+ * {
+ *   "groups": [{"id": 1, "fixtures": [1, 3]}, {"id": 2, "fixtures": [2, 4]}]
+ * }
+ * 
+ * 11. LFO Modulation (replaces the whole modulation setup):
+ * {
+ *   "mod": {
+ *     "lfos": [
+ *       {"shape": "sine", "rate": 0.2},           // rate in Hz, or
+ *       {"shape": "random", "beats": 4, "seed": 7} // period in beats of the tempo clock
+ *     ],
+ *     "routes": [
+ *       {"lfo": 0, "target": "hue", "depth": 255},
+ *       {"lfo": 1, "target": "intensity", "group": 1, "depth": -180},
+ *       {"lfo": 0, "target": "speed", "depth": 100}
+ *     ]
+ *   }
+ * }
+ * Shapes: sine, triangle, square, saw, random. {"mod": {}} removes all modulation
+ * 
+ * 12. Daily Schedule (runs every day without downlinks, stored on the device):
+ * {
+ *   "daily": {
+ *     "lat": 40.71, "lon": -74.01, // Location for sunrise/sunset
+ *     "tz": -300,                  // Local UTC offset in minutes
+ *     "clear": true,               // Optional: replace the existing entries
+ *     "events": [
+ *       {"at": "sunset", "offset": -15, "cmd": {"pattern": "rainbow"}},
+ *       {"at": "23:30", "days": [1, 2, 3, 4, 5], "cmd": {"lights": [...]}}
+ *     ]
+ *   }
+ * }
+ * "at" is "HH:MM", "sunrise" or "sunset"; "days" are 0 (Sunday) to 6.
+ * The clock is kept in sync with the network via DeviceTimeReq.
+ * 
+ * 13. Scenes (up to 64 stored looks, kept in their own flash partition):
+ * {"scene": {"save": 3}}       // Store the current frame as scene 3
+ * {"scene": {"recall": 3}}     // Output scene 3
+ * {"scene": {"delete": 3}}     // Delete scene 3
+ * {"scene": {"report": true}}  // Uplink capacity, usage and fragmentation
+ * 
+ * Binary Commands (fPort 2):
+ * Compact alternative to JSON for DMX data and patterns: a version byte
+ * followed by opcode-prefixed commands with varint addresses and counts
+ * (see BinaryProtocol.h). ttn_payload_formatter.js encodes them from
+ * {"binary": [{"op": "fixtures", "first": 1, "colors": [[255, 0, 0, 0]]}]}
+ * 
+ * Fragmented Transfers (fPort 3):
+ * Binary or JSON command files too large for one downlink are sent as
+ * numbered fragments plus XOR parity fragments, reassembled in flash by a
+ * worker task and run once complete (see FragmentTransfer.h)
+ * 
+ * Downlinks are queued by the radio callback and applied by the DMX task at
+ * the next frame boundary, the same task that runs scheduled and daily
+ * commands and steps patterns, so effects never race a command; LED feedback is carried out afterwards by
+ * loop(), and the changed settings are written to flash by the persist
+ * task once they settle (see PersistService.h). Command results and pings are answered by the
+ * batched status report on fPort 2 (see CommandReport.h).
+ * 
+ * At boot the DMX output and the saved look come up first; the LoRaWAN
+ * join runs in its own task and hands the radio to loop() when it is done.
+ * After a watchdog reset or a crash the frame that was being output is
+ * sent again from RTC memory before anything is read from flash.
+ * 
  * Libraries:
  * - LoRaManager: Custom LoRaWAN communication via RadioLib
  * - ArduinoJson: JSON parsing
  * - DmxController: DMX output control
+ * - ShowClock / CommandScheduler: Time-synchronised command execution
+ * - DailySchedule: Autonomous time-of-day and sunrise/sunset events
+ * - BinaryProtocol: Compact binary downlink commands
+ * - ColorPalette: Persisted color table for palette-indexed commands
+ * - QuantizedColor: RGB565 / RGB444 / HSV color expansion for dense commands
+ * - CommandRegistry: Hashed lookup tables for JSON keys and ports
+ * - CommandDecoder: Hardware-independent downlink decoding into a CommandSink
+ * - PersistService: Debounced write-behind of settings to flash
+ * - StateStore: Frame, palette and patch as one CRC-checked blob
+ * - StateJournal: Append-only, wear-levelled log of that blob in its own partition
+ * - RetainedFrame: Live frame and effect kept in RTC memory across warm resets
+ * - SceneStore: Indexed library of stored looks in a memory-mapped partition
+ * - CommandQueue: Lock-free hand-off of downlinks from the radio to the DMX task
+ * - SequenceWindow: Duplicate suppression for sequence-numbered downlinks
+ * - FragmentTransfer: Reassembly of multi-downlink payloads with parity recovery
+ * - CommandReport: Batched command acknowledgements for the status uplink
  */
 
 #include <Arduino.h>
@@ -73,6 +195,29 @@
 #include <SPI.h>  // Include SPI library explicitly
 #include "LoRaManager.h"
 #include "DmxController.h"
+#include "ShowClock.h"
+#include "CommandScheduler.h"
+#include "TempoClock.h"
+#include "FxGenerators.h"
+#include "SpatialMap.h"
+#include "ModMatrix.h"
+#include "DailySchedule.h"
+#include "FrameCache.h"
+#include "BinaryProtocol.h"
+#include "CommandDecoder.h"
+#include "PersistService.h"
+#include "StateStore.h"
+#include "StateJournal.h"
+#include "RetainedFrame.h"
+#include "SceneStore.h"
+#include "ColorPalette.h"
+#include "QuantizedColor.h"
+#include "CommandRegistry.h"
+#include "CommandQueue.h"
+#include "SequenceWindow.h"
+#include "FragmentTransfer.h"
+#include "CommandReport.h"
+#include "JsonCapacity.h"
 #include <esp_task_wdt.h>  // Watchdog
 
 // Debug output
@@ -109,9 +254,18 @@ uint8_t nwkKey[] = {0x45, 0xD3, 0x7B, 0xF3, 0x77, 0x61, 0xA6, 0x1F, 0x9F, 0x07,
 #define MAX_CHANNELS_PER_FIXTURE 16 // Maximum channels per fixture
 #define MAX_JSON_SIZE 1024        // Maximum size of JSON document
 
+// Raw downlink and channel dumps; these print from the DMX task and stall
+// its frames while the UART drains, so they are off unless debugging
+#ifndef DOWNLINK_DEBUG
+#define DOWNLINK_DEBUG 0
+#endif
+
+// Network time is requested again after this long without a sync
+#define NETWORK_TIME_RESYNC_MS (6UL * 60UL * 60UL * 1000UL)
+
 // Global variables
 bool dmxInitialized = false;
-bool loraInitialized = false;
+volatile bool loraInitialized = false;  // Set by the join task once loop() may use the radio
 DmxController* dmx = NULL;
 LoRaManager* lora = NULL;
 
@@ -127,29 +281,311 @@ bool keepDmxDuringRx = true;
 // Forward declaration of the callback function
 void handleDownlinkCallback(uint8_t* payload, size_t size, uint8_t port);
 
-// Placeholder for the received data
-uint8_t receivedData[MAX_JSON_SIZE];
-size_t receivedDataSize = 0;
-uint8_t receivedPort = 0;
-bool dataReceived = false;  // Legacy flag - using direct callback processing now
+// Downlinks waiting for the DMX task; the callback only copies them in
+CommandQueue commandQueue;
+
+// Recent downlink sequence numbers; repeats are skipped
+SequenceWindow commandSequence;
+
+// Command results, sent unconfirmed with the heartbeat or soon after a burst
+CommandReport commandReport;
+#define HEARTBEAT_INTERVAL_MS 60000UL
+#define REPORT_HOLD_MS 10000UL  // Results wait this long for others to share their uplink
+
+// Payload being reassembled from fragments. Erasing and writing flash is
+// left to the fragment worker task; the DMX task only queues the messages
+// and replays the completed payload
+FragmentTransfer fragmentTransfer;
+volatile bool fragmentStatusPending = false;  // Report the transfer state in an uplink
+#define FRAGMENT_QUEUE_DEPTH 8             // Fragment messages waiting for the worker
+#define FRAGMENT_REPLAY_BUDGET_US 4000     // JSON replay time per DMX frame
+QueueHandle_t fragmentQueue = NULL;
+TaskHandle_t fragmentTaskHandle = NULL;
+
+// A completed payload, mapped by the worker and replayed by the DMX task
+struct FragmentReplay {
+  const uint8_t* data;
+  uint32_t size;
+  uint32_t offset;                         // Next byte to replay
+  uint8_t content;                         // FragmentContent
+  bool success;
+};
+FragmentReplay fragmentReplay;
+volatile bool fragmentReplayReady = false;
+
+// State written to flash behind the commands that change it
+enum PersistTarget {
+  PERSIST_STATE,         // Frame, palette and patch (see persistState)
+  PERSIST_DAILY,         // Daily schedule
+  PERSIST_SCENES         // Scene saves and deletes (see persistScenes)
+};
+PersistService persistService;
+StateJournal stateJournal;            // Where the state is kept
+StateStore stateStore("dmx_state");   // NVS copy, used without the journal partition
+
+// Running effect and its phase, retained with the frame (see RetainedFrame.h)
+#define RETAINED_EFFECT_VERSION 1
+struct RetainedEffect {
+  uint8_t version;           // RETAINED_EFFECT_VERSION
+  uint8_t patternType;       // DmxPattern::PatternType, 0 if no pattern runs
+  uint8_t axis;              // Sweep axis
+  uint8_t rainbow;           // Rainbow demo: bit 0 running, bit 1 staggered
+  int32_t speed;             // Pattern step time in ms
+  int32_t step;              // Pattern phase
+  int32_t cycleCount;
+  int32_t maxCycles;
+  uint32_t divisionQ8;       // Tempo lock, 0 for ms timing
+  uint32_t seed;
+  float angle;               // Wave direction
+  uint32_t rainbowStep;      // Rainbow demo phase
+  uint32_t rainbowStepsLeft;
+  int32_t rainbowStepDelay;
+};
+RetainedFrame retainedFrame;
+
+// Stored looks; saves and deletes wait in pendingScenes for the persist task
+#define SCENE_PENDING_MAX 4
+struct PendingScene {
+  uint16_t id;
+  int16_t length;            // -1 deletes the scene
+  uint32_t revision;         // Tells a change replaced mid-write from the one written
+  uint8_t data[SCENE_MAX_SIZE];
+};
+SceneStore sceneStore;
+PendingScene pendingScenes[SCENE_PENDING_MAX];
+uint8_t pendingSceneCount = 0;
+uint32_t pendingSceneRevision = 0;
+portMUX_TYPE pendingSceneLock = portMUX_INITIALIZER_UNLOCKED;
+volatile bool sceneReportPending = false;  // Report the store in an uplink
+
+// Boot pipeline: DMX output and the saved look come up first, the network
+// is joined in the background. Each phase records millis() when it ends
+enum BootPhase {
+  BOOT_SERIAL,           // Console up
+  BOOT_DMX_DRIVER,       // UART and fixture patch ready
+  BOOT_LOOK_RESTORED,    // Saved state loaded (or default white)
+  BOOT_OUTPUT_LIVE,      // First frame sent, DMX task running
+  BOOT_SERVICES,         // Persist task and daily schedule ready
+  BOOT_RADIO,            // LoRa radio initialised
+  BOOT_JOINED,           // Join finished (joined or given up)
+  BOOT_PHASE_COUNT
+};
+const char* const bootPhaseNames[BOOT_PHASE_COUNT] = {
+  "serial", "dmx driver", "look restored", "output live", "services", "radio", "join"
+};
+uint32_t bootPhaseMs[BOOT_PHASE_COUNT];
+TaskHandle_t loraJoinTaskHandle = NULL;
+volatile bool onlineStatusPending = false;  // Send the online uplink from loop()
+
+// Work requested by commands in the DMX task and carried out by loop()
+volatile uint8_t ledBlinksPending = 0;      // LED confirmation blinks left
+volatile uint16_t ledBlinkMs = 200;         // LED on/off time for those blinks
 
-// Global variables for continuous rainbow effect
+// Continuous rainbow effect, stepped by the DMX task
 bool runningRainbowDemo = false;  // Controls continuous rainbow effect
 unsigned long lastRainbowStep = 0; // Timestamp for last rainbow step
 uint32_t rainbowStepCounter = 0;  // Step counter for rainbow effect
 int rainbowStepDelay = 30;        // Delay between steps in milliseconds
 bool rainbowStaggered = true;     // Whether to stagger colors across fixtures
+uint32_t rainbowStepsLeft = 0;    // Steps until the rainbow stops, 0 = run until disabled
+
+// Strobe test, stepped by the DMX task one phase at a time
+struct StrobeTest {
+  bool active;
+  uint8_t color;
+  bool alternate;
+  bool on;
+  int flash;
+  int count;
+  uint16_t onTime;
+  uint16_t offTime;
+  unsigned long lastChange;
+};
+StrobeTest strobeTest = {};
 
 // Add timing variables for various operations
 unsigned long lastHeartbeat = 0;  // Timestamp for heartbeat messages
 unsigned long lastStatusUpdate = 0; // Timestamp for status updates
 
-// Always process in callback for maximum reliability
-bool processInCallback = true; // Set to true to process commands immediately in callback
+// Show clock and queue of commands waiting for their execution time
+ShowClock showClock;
+CommandScheduler commandScheduler;
+
+// Musical time base shared by all tempo-locked patterns
+TempoClock tempoClock;
+
+// Fixture positions for spatial patterns, rebuilt when the patch changes
+SpatialMap spatialMap;
+
+// LFO modulation of pattern speed, hue and group intensity, evaluated once per frame
+ModMatrix modMatrix;
+
+// Pre-rendered period of the running periodic effect
+FrameCache frameCache;
+
+// Color table for palette-indexed binary commands
+ColorPalette colorPalette;
+
+// Day-to-day events resolved against the show clock; catch-up runs after each sync
+DailySchedule dailySchedule;
+bool dailyResyncPending = true;
+
+// millis() when the command being applied arrived: set by applyQueuedCommand
+// for downlinks and to the current time for stored and replayed commands
+uint32_t commandReceivedMs = 0;
+
+// Downlink port for JSON and single-byte commands; ports without a route
+// of their own are treated the same (binary commands use BINARY_PROTOCOL_PORT)
+#define JSON_COMMAND_PORT 1
+
+// Queue entries that carry network time from loop() to the DMX task, which
+// owns the show clock. fPort 0 only carries MAC commands, so no application
+// downlink arrives on it
+#define NETWORK_TIME_PORT 0
+
+/**
+ * Payload of a NETWORK_TIME_PORT queue entry; its receivedMs is the
+ * local time the network time refers to
+ */
+struct NetworkTime {
+  uint32_t unixSeconds;
+  uint16_t milliseconds;
+};
+
+// JSON document capacities (see JsonCapacity.h): commands with a fixed
+// shape get a small document, array commands one sized for the largest
+// downlink, and lines replayed from a fragmented payload, which may be
+// up to MAX_JSON_SIZE long, one sized for that
+#define MAX_DOWNLINK_SIZE 242
+#define DOWNLINK_JSON_CAPACITY JSON_CAPACITY_FOR(MAX_DOWNLINK_SIZE)
+#define FRAGMENT_JSON_CAPACITY JSON_CAPACITY_FOR(MAX_JSON_SIZE)
 
 // Set watchdog timeout to 30 seconds
 #define WDT_TIMEOUT 30
 
+/**
+ * Mark the frame, palette and patch for saving
+ * Commands run in the DMX task, which must not stall on flash writes;
+ * the persist task writes the state once the changes settle
+ */
+void requestSettingsSave() {
+  persistService.markDirty(PERSIST_STATE);
+}
+
+/**
+ * Save the frame, palette and patch as one blob
+ * The journal appends only the bytes that changed (see StateJournal.h);
+ * without a journal partition the blob goes to NVS. The frame comes first
+ * so its offsets stay put when the patch grows
+ * 
+ * @return true if the state is stored
+ */
+bool persistState() {
+  if (!dmxInitialized || dmx == NULL) {
+    return true;
+  }
+  
+  static uint8_t blob[STATE_MAX_SIZE];
+  StateWriter writer(blob, sizeof(blob));
+  bool built = false;
+  
+  // Copy under the mutex; the flash write happens without it
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+    uint8_t* frame = writer.addSection(STATE_SECTION_FRAME, DMX_PACKET_SIZE - 1);
+    uint8_t* palette = writer.addSection(STATE_SECTION_PALETTE, PALETTE_SIZE * 4);
+    if (frame != NULL && palette != NULL) {
+      memcpy(frame, dmx->getDmxData() + 1, DMX_PACKET_SIZE - 1);
+      for (int i = 0; i < PALETTE_SIZE; i++) {
+        RgbwColor color = colorPalette.get(i);
+        memcpy(palette + i * 4, &color, 4);
+      }
+      size_t patchCapacity = writer.available();
+      uint8_t* patch = writer.addSection(STATE_SECTION_PATCH, patchCapacity);
+      size_t patchSize = patch != NULL ? dmx->exportPatch(patch, patchCapacity) : 0;
+      writer.endSection(patchSize);
+      built = patchSize > 0;
+    }
+    xSemaphoreGive(dmxMutex);
+  }
+  
+  if (!built) {
+    Serial.println("State does not fit in the state blob");
+    return false;
+  }
+  if (stateJournal.isReady()) {
+    return stateJournal.save(blob, writer.length());
+  }
+  return stateStore.save(blob, writer.length());
+}
+
+/**
+ * Restore the frame, palette and patch saved by persistState
+ * The journal is replayed first. State kept in NVS by older firmware, as a
+ * blob or as separate keys, is moved into the journal
+ * 
+ * @param restoreFrame false to keep the frame being output (a warm reset
+ *                     has already restored a newer one) and load the rest
+ * @return true if a saved state was found
+ */
+bool loadState(bool restoreFrame) {
+  static uint8_t blob[STATE_MAX_SIZE];
+  size_t length;
+  
+  bool fromJournal = stateJournal.isReady() && stateJournal.load(blob, length);
+  if (fromJournal || stateStore.load(blob, length)) {
+    size_t size;
+    const uint8_t* data;
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      if ((data = stateFindSection(blob, length, STATE_SECTION_PATCH, size)) != NULL) {
+        dmx->importPatch(data, size);
+      }
+      if (restoreFrame && (data = stateFindSection(blob, length, STATE_SECTION_FRAME, size)) != NULL && size == DMX_PACKET_SIZE - 1) {
+        memcpy(dmx->getDmxData() + 1, data, size);
+      }
+      xSemaphoreGive(dmxMutex);
+    }
+    if ((data = stateFindSection(blob, length, STATE_SECTION_PALETTE, size)) != NULL) {
+      for (size_t i = 0; i < size / 4 && i < PALETTE_SIZE; i++) {
+        colorPalette.set(i, RgbwColor{data[i * 4], data[i * 4 + 1], data[i * 4 + 2], data[i * 4 + 3]});
+      }
+    }
+    if (!fromJournal && stateJournal.isReady() && stateJournal.save(blob, length)) {
+      Serial.println("State moved from NVS to the journal");
+    }
+    return true;
+  }
+  
+  bool migrated = false;
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+    if (restoreFrame) {
+      migrated = dmx->loadLegacySettings();
+    } else {
+      memcpy(blob, dmx->getDmxData() + 1, DMX_PACKET_SIZE - 1);
+      migrated = dmx->loadLegacySettings();
+      memcpy(dmx->getDmxData() + 1, blob, DMX_PACKET_SIZE - 1);
+    }
+    xSemaphoreGive(dmxMutex);
+  }
+  migrated |= colorPalette.loadLegacy();
+  if (migrated && persistState()) {
+    dmx->clearLegacySettings();
+    colorPalette.clearLegacy();
+    Serial.println("Settings from older firmware moved to the saved state");
+  }
+  return migrated;
+}
+
+/**
+ * Ask loop() to blink the LED without blocking the caller
+ * 
+ * @param times Number of blinks
+ * @param delayMs On and off time of each blink
+ */
+void requestLedBlinks(uint8_t times, uint16_t delayMs) {
+  ledBlinkMs = delayMs;
+  ledBlinksPending = times;
+}
+
 // Add DMX diagnostic function
 void printDmxValues(int startAddr, int numChannels) {
   if (!dmxInitialized || dmx == NULL) {
@@ -182,9 +618,31 @@ bool processLightsJson(JsonArray lightsArray) {
   }
   
   Serial.println("\n===== PROCESSING DOWNLINK LIGHTS COMMAND =====");
+  
+  // Lights whose address is a patched fixture number and that carry RGB(W)
+  // values set that fixture's color, whatever its DMX address
+  bool anyFixture = false;
+  for (JsonObject light : lightsArray) {
+    int address = light["address"] | 0;
+    JsonArray channels = light["channels"];
+    if (address > 0 && address <= dmx->getNumFixtures() && channels.size() >= 3) {
+      int w = (channels.size() >= 4) ? channels[3].as<int>() : 0;
+      dmx->setFixtureColor(address - 1, channels[0], channels[1], channels[2], w);
+      anyFixture = true;
+    }
+  }
+  if (anyFixture) {
+    dmx->sendData();
+    requestSettingsSave();
+    Serial.println("Fixture colors set");
+    return true;
+  }
+  
+#if DOWNLINK_DEBUG
   Serial.println("Starting DMX values:");
   // Print current values for first 20 channels
   printDmxValues(1, 20);
+#endif
   
   bool atLeastOneValid = false;
   
@@ -221,11 +679,13 @@ bool processLightsJson(JsonArray lightsArray) {
       continue;
     }
     
+#if DOWNLINK_DEBUG
     Serial.print("Setting light at address ");
     Serial.print(address);
     Serial.print(" with ");
     Serial.print(channelsArray.size());
     Serial.println(" channels:");
+#endif
     
     // Set the channels
     int channelIndex = 0;
@@ -238,11 +698,13 @@ bool processLightsJson(JsonArray lightsArray) {
       // DMX channels are 1-based
       int dmxChannel = address + channelIndex;
       
+#if DOWNLINK_DEBUG
       // Log the channel being set
       Serial.print("  Channel ");
       Serial.print(dmxChannel);
       Serial.print(" = ");
       Serial.println(value);
+#endif
       
       // Don't exceed DMX_PACKET_SIZE
       if (dmxChannel < DMX_PACKET_SIZE) {
@@ -258,6 +720,7 @@ bool processLightsJson(JsonArray lightsArray) {
     // At least one light was processed successfully
     atLeastOneValid = true;
     
+#if DOWNLINK_DEBUG
     // Print debug info
     Serial.print("Set DMX address ");
     Serial.print(address);
@@ -267,21 +730,23 @@ bool processLightsJson(JsonArray lightsArray) {
       Serial.print(dmx->getDmxData()[address + i]);
     }
     Serial.println("]");
+#endif
   }
   
   // Send data if at least one light was valid
   if (atLeastOneValid) {
     Serial.println("Sending updated DMX values to fixtures...");
     
+#if DOWNLINK_DEBUG
     // Print final values for verification
     Serial.println("Final DMX values being sent:");
     printDmxValues(1, 20);
+#endif
     
     dmx->sendData();
     
     // Save settings to persistent storage
-    dmx->saveSettings();
-    Serial.println("DMX settings saved to persistent storage");
+    requestSettingsSave();
     
     return true;
   }
@@ -298,12 +763,25 @@ public:
     RAINBOW,
     STROBE,
     CHASE,
-    ALTERNATE
+    ALTERNATE,
+    NOISE,
+    WAVE,
+    RADIAL,
+    SWEEP
   };
 
-  DmxPattern() : active(false), patternType(NONE), speed(50), step(0), lastUpdate(0), cycleCount(0), maxCycles(5) {}
+  DmxPattern() : active(false), patternType(NONE), speed(50), step(0), lastUpdate(0), cycleCount(0), maxCycles(5),
+                 divisionQ8(0), lastTick(0), seed(1), angle(0), axis(AXIS_X), hueModulation(true) {}
 
-  void start(PatternType type, int patternSpeed, int cycles = 5) {
+  /**
+   * Start a pattern
+   * 
+   * @param type Pattern to run
+   * @param patternSpeed Time in ms between steps (ignored when tempo-locked)
+   * @param cycles Number of cycles before stopping (0 = infinite)
+   * @param stepsPerBeatQ8 Steps per beat * 256 to lock to the tempo clock, 0 for ms timing
+   */
+  void start(PatternType type, int patternSpeed, int cycles = 5, uint32_t stepsPerBeatQ8 = 0) {
     active = true;
     patternType = type;
     speed = patternSpeed;
@@ -311,6 +789,10 @@ public:
     cycleCount = 0;
     maxCycles = cycles;
     lastUpdate = millis();
+    divisionQ8 = stepsPerBeatQ8;
+    lastTick = tempoClock.getTicks(lastUpdate, divisionQ8);
+    refreshSpatial();
+    prepareFrameCache();
     
     Serial.print("Pattern started: ");
     switch (patternType) {
@@ -319,6 +801,10 @@ public:
       case STROBE: Serial.println("STROBE"); break;
       case CHASE: Serial.println("CHASE"); break;
       case ALTERNATE: Serial.println("ALTERNATE"); break;
+      case NOISE: Serial.println("NOISE"); break;
+      case WAVE: Serial.println("WAVE"); break;
+      case RADIAL: Serial.println("RADIAL"); break;
+      case SWEEP: Serial.println("SWEEP"); break;
       default: Serial.println("UNKNOWN");
     }
   }
@@ -333,18 +819,108 @@ public:
     return active;
   }
   
+  /**
+   * Copy the running pattern and its phase into a retained effect
+   */
+  void exportRetained(RetainedEffect& effect) {
+    if (!active) {
+      return;
+    }
+    effect.patternType = patternType;
+    effect.axis = axis;
+    effect.speed = speed;
+    effect.step = step;
+    effect.cycleCount = cycleCount;
+    effect.maxCycles = maxCycles;
+    effect.divisionQ8 = divisionQ8;
+    effect.seed = seed;
+    effect.angle = angle;
+  }
+  
+  /**
+   * Resume a pattern from a retained effect at the phase it had reached
+   */
+  void resumeRetained(const RetainedEffect& effect) {
+    if (effect.patternType == NONE || effect.patternType > SWEEP) {
+      return;
+    }
+    seed = effect.seed;
+    angle = effect.angle;
+    axis = effect.axis <= AXIS_Z ? (SpatialAxis)effect.axis : AXIS_X;
+    start((PatternType)effect.patternType, effect.speed, effect.maxCycles, effect.divisionQ8);
+    step = effect.step;
+    cycleCount = effect.cycleCount;
+  }
+  
+  /**
+   * Set the seed used by generator-based patterns
+   * Nodes using the same seed render identical output
+   */
+  void setSeed(uint32_t newSeed) {
+    seed = newSeed;
+  }
+  
+  /**
+   * Set the direction of travel for spatial patterns
+   * 
+   * @param angleDeg Direction in the XY plane for waves (0 = +X)
+   * @param sweepAxis Axis that sweeps travel along
+   */
+  void setDirection(float angleDeg, SpatialAxis sweepAxis) {
+    angle = angleDeg;
+    axis = sweepAxis;
+  }
+  
+  /**
+   * Recompute the per-fixture projections of a spatial pattern
+   * Called on start and whenever fixture positions change, so that
+   * rendering only adds the precomputed offset per fixture
+   */
+  void refreshSpatial() {
+    if (patternType != WAVE && patternType != RADIAL && patternType != SWEEP) {
+      return;
+    }
+    if (!dmxInitialized || dmx == NULL) {
+      return;
+    }
+    
+    int numFixtures = min(dmx->getNumFixtures(), MAX_FIXTURES);
+    if (!spatialMap.isBuiltFor(numFixtures)) {
+      spatialMap.build(dmx->getAllFixtures(), numFixtures);
+    }
+    
+    switch (patternType) {
+      case WAVE: spatialMap.projectLinear(angle, spatialOffset); break;
+      case RADIAL: spatialMap.projectRadial(spatialOffset); break;
+      case SWEEP: spatialMap.projectAxis(axis, spatialOffset); break;
+      default: break;
+    }
+  }
+  
   void update() {
     if (!active || !dmxInitialized || dmx == NULL) {
       return;
     }
     
     unsigned long now = millis();
-    if (now - lastUpdate < speed) {
-      return;
+    if (divisionQ8 > 0) {
+      // Tempo-locked: step whenever the clock crosses a subdivision, so a
+      // tempo change re-times the pattern without restarting it
+      uint32_t tick = tempoClock.getTicks(now, divisionQ8);
+      if (tick == lastTick) {
+        return;
+      }
+      lastTick = tick;
+    } else {
+      unsigned long interval = modulatedSpeed();
+      if (now - lastUpdate < interval) {
+        return;
+      }
+      // Steps land on 20 ms DMX frames; advance by the interval so the
+      // average rate holds, unless the pattern has fallen well behind
+      lastUpdate = (now - lastUpdate < 2 * interval) ? lastUpdate + interval : now;
     }
     
-    lastUpdate = now;
-    
     switch (patternType) {
       case COLOR_FADE:
         updateColorFade();
@@ -361,12 +937,21 @@ public:
       case ALTERNATE:
         updateAlternate();
         break;
+      case NOISE:
+        updateNoise();
+        break;
+      case WAVE:
+        updateWave();
+        break;
+      case RADIAL:
+        updateRadial();
+        break;
+      case SWEEP:
+        updateSweep();
+        break;
       default:
         break;
     }
-    
-    // Send the DMX data
-    dmx->sendData();
   }
 
 private:
@@ -377,9 +962,29 @@ private:
   unsigned long lastUpdate;
   int cycleCount;
   int maxCycles;
+  uint32_t divisionQ8;  // Steps per beat * 256, 0 = use speed in ms
+  uint32_t lastTick;    // Last tempo clock tick a step was taken on
+  uint32_t seed;        // Seed for generator-based patterns
+  float angle;          // Direction of travel for waves
+  SpatialAxis axis;     // Axis for sweeps
+  uint16_t spatialOffset[MAX_FIXTURES];  // Precomputed per-fixture projection (0-65535)
+  bool hueModulation;                    // False while rendering frames for the cache
+  RgbwColor liveFrame[MAX_FIXTURES];     // Frame buffer when rendering live
+  
+  // Step interval after speed modulation (0.5x to 1.5x of the base speed)
+  unsigned long modulatedSpeed() {
+    int32_t mod = modMatrix.getSpeedMod();
+    int32_t interval = (speed * (512 - mod)) / 512;
+    return max(interval, (int32_t)5);
+  }
   
   // HSV to RGB conversion for color effects
   void hsvToRgb(float h, float s, float v, uint8_t& r, uint8_t& g, uint8_t& b) {
+    // Apply the modulated hue offset
+    if (hueModulation) {
+      h = fmod(h + modMatrix.getHueOffset() + 360, 360);
+    }
+    
     float c = v * s;
     float x = c * (1 - abs(fmod(h / 60.0, 2) - 1));
     float m = v - c;
@@ -404,20 +1009,101 @@ private:
     b = (b1 + m) * 255;
   }
   
-  // Color fade pattern (gradually cycles through colors)
-  void updateColorFade() {
-    float hue = (step % 360);
-    step = (step + 2) % 360;
-    
+  // Number of frames in one period of a periodic pattern, 0 if not periodic
+  int framePeriod(int numFixtures) {
+    switch (patternType) {
+      case COLOR_FADE: return 180;               // 2 degrees per step
+      case RAINBOW: return 72;                   // 5 degrees per step
+      case CHASE: return 12 * numFixtures;       // Hue moves 30 degrees per chase
+      default: return 0;
+    }
+  }
+  
+  // Render one frame of a periodic pattern
+  void renderFrame(int frame, RgbwColor* colors, int numFixtures) {
     uint8_t r, g, b;
-    hsvToRgb(hue, 1.0, 1.0, r, g, b);
     
-    // Set all fixtures to the same color
-    int numFixtures = dmx->getNumFixtures();
-    for (int i = 0; i < numFixtures; i++) {
-      dmx->setFixtureColor(i, r, g, b, 0);
+    switch (patternType) {
+      case COLOR_FADE:
+        // All fixtures share the same color
+        hsvToRgb(frame * 2, 1.0, 1.0, r, g, b);
+        for (int i = 0; i < numFixtures; i++) {
+          colors[i] = {r, g, b, 0};
+        }
+        break;
+      
+      case RAINBOW:
+        // Distribute colors across fixtures
+        for (int i = 0; i < numFixtures; i++) {
+          float hue = fmod(frame * 5 + (360.0 * i / numFixtures), 360);
+          hsvToRgb(hue, 1.0, 1.0, r, g, b);
+          colors[i] = {r, g, b, 0};
+        }
+        break;
+      
+      case CHASE: {
+        // One fixture lit, with a hue that changes every full chase
+        int activeFixture = frame % numFixtures;
+        hsvToRgb(((frame / numFixtures) * 30) % 360, 1.0, 1.0, r, g, b);
+        for (int i = 0; i < numFixtures; i++) {
+          colors[i] = (i == activeFixture) ? RgbwColor{r, g, b, 0} : RgbwColor{0, 0, 0, 0};
+        }
+        break;
+      }
+      
+      default:
+        break;
+    }
+  }
+  
+  // Pre-render one period of a periodic pattern into the frame cache
+  void prepareFrameCache() {
+    if (!dmxInitialized || dmx == NULL) {
+      return;
+    }
+    
+    int numFixtures = min(dmx->getNumFixtures(), MAX_FIXTURES);
+    int frames = framePeriod(numFixtures);
+    if (frames == 0 || numFixtures == 0) {
+      return;
+    }
+    
+    uint32_t key = frameCacheKey(patternType, numFixtures);
+    if (frameCache.isValid(key) || !frameCache.begin(key, frames, numFixtures)) {
+      return;
     }
     
+    // Cached frames hold the unmodulated colors
+    hueModulation = false;
+    for (int frame = 0; frame < frames; frame++) {
+      renderFrame(frame, frameCache.editFrame(frame), numFixtures);
+    }
+    hueModulation = true;
+    frameCache.commit();
+  }
+  
+  // Write a frame of a periodic pattern, from the cache when possible
+  void showFrame(int frame) {
+    int numFixtures = min(dmx->getNumFixtures(), MAX_FIXTURES);
+    const RgbwColor* colors = NULL;
+    
+    // Hue modulation changes every frame, so it is always rendered live
+    if (modMatrix.getHueOffset() == 0 && frameCache.isValid(frameCacheKey(patternType, numFixtures))) {
+      colors = frameCache.getFrame(frame);
+    }
+    if (colors == NULL) {
+      renderFrame(frame, liveFrame, numFixtures);
+      colors = liveFrame;
+    }
+    
+    dmx->setFixtureColors(colors, numFixtures);
+  }
+  
+  // Color fade pattern (gradually cycles through colors)
+  void updateColorFade() {
+    showFrame(step / 2);
+    step = (step + 2) % 360;
+    
     // Check if we've completed a cycle
     if (step == 0) {
       cycleCount++;
@@ -432,20 +1118,9 @@ private:
     int numFixtures = dmx->getNumFixtures();
     if (numFixtures == 0) return;
     
-    // Calculate hue offset for this step
-    int baseHue = step % 360;
+    showFrame(step / 5);
     step = (step + 5) % 360;
     
-    // Distribute colors across fixtures
-    for (int i = 0; i < numFixtures; i++) {
-      float hue = fmod(baseHue + (360.0 * i / numFixtures), 360);
-      
-      uint8_t r, g, b;
-      hsvToRgb(hue, 1.0, 1.0, r, g, b);
-      
-      dmx->setFixtureColor(i, r, g, b, 0);
-    }
-    
     // Check if we've completed a cycle
     if (step == 0) {
       cycleCount++;
@@ -480,25 +1155,14 @@ private:
   
   // Chase pattern (one light at a time)
   void updateChase() {
-    int numFixtures = dmx->getNumFixtures();
+    int numFixtures = min(dmx->getNumFixtures(), MAX_FIXTURES);
     if (numFixtures == 0) return;
     
     int activeFixture = step % numFixtures;
     step = (step + 1) % numFixtures;
     
-    // Turn all fixtures off first
-    for (int i = 0; i < numFixtures; i++) {
-      if (i == activeFixture) {
-        // This fixture gets the color - use a rotating hue
-        uint8_t r, g, b;
-        float hue = (cycleCount * 30) % 360;  // Change color every full chase cycle
-        hsvToRgb(hue, 1.0, 1.0, r, g, b);
-        
-        dmx->setFixtureColor(i, r, g, b, 0);
-      } else {
-        dmx->setFixtureColor(i, 0, 0, 0, 0);
-      }
-    }
+    // Change color every full chase cycle
+    showFrame((cycleCount % 12) * numFixtures + activeFixture);
     
     // Count a full chase sequence as one complete cycle
     if (step == 0) {
@@ -537,40 +1201,972 @@ private:
       }
     }
   }
-};
-
-// Create a global pattern handler
-DmxPattern patternHandler;
-
-/**
- * Process JSON payload and control DMX fixtures
- * 
- * Expected JSON format:
- * {
- *   "lights": [
- *     {
- *       "address": 1,
- *       "channels": [255, 0, 128, 0]
- *     },
- *     {
- *       "address": 5,
- *       "channels": [255, 255, 100, 0]
- *     }
- *   ]
- * }
- * 
- * Or for test patterns:
- * {
- *   "test": {
- *     "pattern": "rainbow",
- *     "cycles": 3,
- *     "speed": 50,
- *     "staggered": true
- *   }
- * }
- * 
- * Or:
- * {
+  
+  // Noise pattern (organic hue drift and flicker sampled per fixture)
+  void updateNoise() {
+    int numFixtures = dmx->getNumFixtures();
+    if (numFixtures == 0) return;
+    
+    // Time axis of the noise field advances a fraction of a cell per step
+    int32_t t = step * 6;
+    step++;
+    
+    for (int i = 0; i < numFixtures; i++) {
+      // Neighbouring fixtures sample nearby points so colours stay related
+      int32_t x = i * 96;
+      uint8_t hueNoise = fxSimplex2D(x, t, seed);
+      uint8_t level = fxValueNoise2D(x, t * 2, seed + 1);
+      
+      float hue = fmod((step / 2) + hueNoise * 1.5, 360);
+      float value = (160 + (level * 95) / 255) / 255.0;
+      
+      uint8_t r, g, b;
+      hsvToRgb(hue, 1.0, value, r, g, b);
+      dmx->setFixtureColor(i, r, g, b, 0);
+    }
+    
+    // Count every 256 steps as one cycle
+    if (step % 256 == 0) {
+      cycleCount++;
+      if (cycleCount >= maxCycles && maxCycles > 0) {
+        stop();
+      }
+    }
+  }
+  
+  // Advance the 64-step period shared by the spatial patterns
+  uint16_t advanceSpatialPhase() {
+    uint16_t phase = step * 1024;
+    step = (step + 1) % 64;
+    return phase;
+  }
+  
+  // Count a full spatial period as one cycle
+  void finishSpatialStep() {
+    if (step == 0) {
+      cycleCount++;
+      if (cycleCount >= maxCycles && maxCycles > 0) {
+        stop();
+      }
+    }
+  }
+  
+  // Wave pattern (rainbow travelling across the rig in one direction)
+  void updateWave() {
+    int numFixtures = min(dmx->getNumFixtures(), MAX_FIXTURES);
+    if (numFixtures == 0) return;
+    
+    uint16_t phase = advanceSpatialPhase();
+    for (int i = 0; i < numFixtures; i++) {
+      uint16_t local = phase - spatialOffset[i];
+      float hue = local * (360.0 / 65536);
+      
+      uint8_t r, g, b;
+      hsvToRgb(hue, 1.0, 1.0, r, g, b);
+      dmx->setFixtureColor(i, r, g, b, 0);
+    }
+    
+    finishSpatialStep();
+  }
+  
+  // Radial pattern (rings of light bursting out from the rig centre)
+  void updateRadial() {
+    int numFixtures = min(dmx->getNumFixtures(), MAX_FIXTURES);
+    if (numFixtures == 0) return;
+    
+    uint16_t phase = advanceSpatialPhase();
+    float hue = (cycleCount * 45) % 360;  // Change color every burst
+    for (int i = 0; i < numFixtures; i++) {
+      uint8_t level = fxSine8(phase - spatialOffset[i]);
+      
+      uint8_t r, g, b;
+      hsvToRgb(hue, 1.0, level / 255.0, r, g, b);
+      dmx->setFixtureColor(i, r, g, b, 0);
+    }
+    
+    finishSpatialStep();
+  }
+  
+  // Sweep pattern (a bar of light moving along one axis)
+  void updateSweep() {
+    int numFixtures = min(dmx->getNumFixtures(), MAX_FIXTURES);
+    if (numFixtures == 0) return;
+    
+    uint16_t phase = advanceSpatialPhase();
+    float hue = (cycleCount * 30) % 360;  // Change color every sweep
+    for (int i = 0; i < numFixtures; i++) {
+      // Bar is a quarter of the rig wide, fading out towards its edges
+      int32_t distance = abs((int32_t)spatialOffset[i] - (int32_t)phase);
+      uint8_t level = distance < 16384 ? 255 - (distance * 255) / 16384 : 0;
+      
+      uint8_t r, g, b;
+      hsvToRgb(hue, 1.0, level / 255.0, r, g, b);
+      dmx->setFixtureColor(i, r, g, b, 0);
+    }
+    
+    finishSpatialStep();
+  }
+};
+
+// Create a global pattern handler
+DmxPattern patternHandler;
+
+/**
+ * Process a time sync command
+ * 
+ * Expected JSON format:
+ * {"time": {"unix": 1700000000, "ms": 250}}
+ * 
+ * @param timeObj The "time" object
+ * @return true if the clock was synchronised
+ */
+bool processTimeJson(JsonObject timeObj) {
+  if (!timeObj.containsKey("unix")) {
+    Serial.println("JSON format error: 'unix' field not found in time object");
+    return false;
+  }
+  
+  uint64_t unixMs = (uint64_t)timeObj["unix"].as<uint32_t>() * 1000ULL;
+  unixMs += timeObj["ms"] | 0;
+  showClock.sync(unixMs, millis());
+  dailyResyncPending = true;
+  
+  Serial.print("Show clock synchronised to Unix time ");
+  Serial.println(timeObj["unix"].as<uint32_t>());
+  return true;
+}
+
+/**
+ * Process a schedule command
+ * 
+ * Expected JSON format:
+ * {"schedule": {"at": 1700000120, "ms": 0, "id": 7, "cmd": {...}}}
+ * {"schedule": {"in": 5000, "cmd": {...}}}
+ * {"schedule": {"cancel": 7}}
+ * {"schedule": {"clear": true}}
+ * 
+ * "in" counts from the command's arrival, not from when it is applied.
+ * Times further ahead than SCHEDULER_MAX_DELAY_MS are rejected, since
+ * the local timeline wraps and they would otherwise fire at once
+ * 
+ * @param scheduleObj The "schedule" object
+ * @return true if the command was queued, cancelled or cleared
+ */
+bool processScheduleJson(JsonObject scheduleObj) {
+  // Queue maintenance commands
+  if (scheduleObj.containsKey("cancel") || scheduleObj.containsKey("clear")) {
+    int removed = 0;
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      if (scheduleObj["clear"] | false) {
+        removed = commandScheduler.size();
+        commandScheduler.clear();
+      } else {
+        removed = commandScheduler.cancel(scheduleObj["cancel"].as<uint16_t>());
+      }
+      xSemaphoreGive(dmxMutex);
+    }
+    Serial.print("Scheduled commands removed: ");
+    Serial.println(removed);
+    return true;
+  }
+  
+  if (!scheduleObj.containsKey("cmd")) {
+    Serial.println("JSON format error: 'cmd' field not found in schedule object");
+    return false;
+  }
+  
+  // Work out the execution time on the local timeline; a time already
+  // passed runs at once
+  uint32_t executeAt;
+  int64_t aheadMs;
+  if (scheduleObj.containsKey("at")) {
+    if (!showClock.isSynced()) {
+      Serial.println("Cannot schedule at absolute time: show clock not synchronised");
+      return false;
+    }
+    uint64_t unixMs = (uint64_t)scheduleObj["at"].as<uint32_t>() * 1000ULL;
+    unixMs += scheduleObj["ms"] | 0;
+    aheadMs = (int64_t)(unixMs - showClock.toUnixMs(millis()));
+    executeAt = showClock.toLocalMs(unixMs);
+  } else {
+    aheadMs = scheduleObj["in"].as<uint32_t>();
+    executeAt = commandReceivedMs + (uint32_t)aheadMs;
+  }
+  
+  if (aheadMs > (int64_t)SCHEDULER_MAX_DELAY_MS) {
+    Serial.println("Cannot schedule more than 24 days ahead");
+    return false;
+  }
+  
+  // Store the inner command in its serialized form
+  JsonVariant cmd = scheduleObj["cmd"];
+  size_t cmdSize = measureJson(cmd);
+  if (cmdSize > SCHEDULER_MAX_PAYLOAD) {
+    Serial.print("Scheduled command too large: ");
+    Serial.println(cmdSize);
+    return false;
+  }
+  
+  char cmdBuffer[SCHEDULER_MAX_PAYLOAD + 1];
+  serializeJson(cmd, cmdBuffer, sizeof(cmdBuffer));
+  
+  bool queued = false;
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+    queued = commandScheduler.schedule(executeAt, (uint8_t*)cmdBuffer, cmdSize, 0, scheduleObj["id"] | 0);
+    xSemaphoreGive(dmxMutex);
+  }
+  
+  if (!queued) {
+    Serial.println("Command scheduler is full, command dropped");
+    return false;
+  }
+  
+  Serial.print("Command scheduled in ");
+  Serial.print((int32_t)(executeAt - now));
+  Serial.print("ms (");
+  Serial.print(commandScheduler.size());
+  Serial.println(" pending)");
+  return true;
+}
+
+/**
+ * Process a tempo command
+ * 
+ * Expected JSON format:
+ * {"tempo": {"bpm": 128, "beatsPerBar": 4, "tap": true, "nudge": -20, "downbeat": true}}
+ * All fields are optional and applied in the order listed
+ * 
+ * @param tempoObj The "tempo" object
+ * @return true if the command was applied
+ */
+bool processTempoJson(JsonObject tempoObj) {
+  uint32_t now = millis();
+  
+  if (tempoObj.containsKey("bpm")) {
+    float bpm = tempoObj["bpm"].as<float>();
+    tempoClock.setTempo((uint32_t)(bpm * 100), now);
+  }
+  if (tempoObj.containsKey("beatsPerBar")) {
+    tempoClock.setBeatsPerBar(tempoObj["beatsPerBar"].as<uint8_t>());
+  }
+  if (tempoObj["tap"] | false) {
+    tempoClock.tap(now);
+  }
+  if (tempoObj.containsKey("nudge")) {
+    tempoClock.nudge(tempoObj["nudge"].as<int32_t>(), now);
+  }
+  if (tempoObj["downbeat"] | false) {
+    tempoClock.downbeat(now);
+  }
+  
+  Serial.print("Tempo: ");
+  Serial.print(tempoClock.getTempo() / 100.0);
+  Serial.print(" BPM, bar ");
+  Serial.print(tempoClock.getBar(now));
+  Serial.print(", beat ");
+  Serial.println(tempoClock.getBeatInBar(now) + 1);
+  return true;
+}
+
+/**
+ * Process a fixture positions command
+ * 
+ * Expected JSON format (x, y and optional z per fixture, in fixture order):
+ * {"positions": [[0, 0], [100, 0], [200, 50, 30]]}
+ * Or with explicit 1-based fixture numbers:
+ * {"positions": [{"fixture": 2, "x": 100, "y": 0, "z": 0}]}
+ * 
+ * @param positions The "positions" array
+ * @return true if at least one position was set
+ */
+bool processPositionsJson(JsonArray positions) {
+  if (!dmxInitialized || dmx == NULL) {
+    Serial.println("DMX not initialized, cannot set positions");
+    return false;
+  }
+  
+  int updated = 0;
+  int index = 0;
+  for (JsonVariant entry : positions) {
+    int fixture = index++;
+    int16_t x, y, z;
+    
+    if (entry.is<JsonArray>()) {
+      JsonArray coords = entry.as<JsonArray>();
+      if (coords.size() < 2) continue;
+      x = coords[0];
+      y = coords[1];
+      z = coords.size() >= 3 ? coords[2].as<int16_t>() : 0;
+    } else if (entry.is<JsonObject>()) {
+      JsonObject coords = entry.as<JsonObject>();
+      fixture = (coords["fixture"] | (fixture + 1)) - 1;
+      x = coords["x"] | 0;
+      y = coords["y"] | 0;
+      z = coords["z"] | 0;
+    } else {
+      continue;
+    }
+    
+    if (fixture < 0 || fixture >= dmx->getNumFixtures()) {
+      Serial.print("Position for unknown fixture ");
+      Serial.print(fixture + 1);
+      Serial.println(", skipping");
+      continue;
+    }
+    
+    dmx->setFixturePosition(fixture, x, y, z);
+    updated++;
+  }
+  
+  // Precompute the normalised map now, not while rendering
+  spatialMap.build(dmx->getAllFixtures(), min(dmx->getNumFixtures(), MAX_FIXTURES));
+  patternHandler.refreshSpatial();
+  requestSettingsSave();
+  
+  Serial.print("Fixture positions updated: ");
+  Serial.println(updated);
+  return updated > 0;
+}
+
+/**
+ * Convert a JSON array of 1-based fixture numbers to a fixture bitmask
+ */
+uint32_t fixtureMaskFromJson(JsonArray fixtures) {
+  uint32_t mask = 0;
+  for (JsonVariant fixture : fixtures) {
+    int index = fixture.as<int>() - 1;
+    if (index >= 0 && index < MAX_FIXTURES) {
+      mask |= 1UL << index;
+    }
+  }
+  return mask;
+}
+
+/**
+ * Process a fixture groups command
+ * 
+ * Expected JSON format:
+ * {"groups": [{"id": 1, "fixtures": [1, 3, 5]}]}
+ * 
+ * @param groups The "groups" array
+ * @return true if at least one group was defined
+ */
+bool processGroupsJson(JsonArray groups) {
+  if (!dmxInitialized || dmx == NULL) {
+    Serial.println("DMX not initialized, cannot define groups");
+    return false;
+  }
+  
+  int defined = 0;
+  for (JsonObject group : groups) {
+    int id = group["id"] | -1;
+    if (id < 0 || id >= DMX_MAX_GROUPS || !group.containsKey("fixtures")) {
+      Serial.println("Invalid group definition, skipping");
+      continue;
+    }
+    
+    uint32_t mask = fixtureMaskFromJson(group["fixtures"]);
+    dmx->setGroupMask(id, mask);
+    defined++;
+    
+    Serial.print("Group ");
+    Serial.print(id);
+    Serial.print(" = fixture mask 0x");
+    Serial.println(mask, HEX);
+  }
+  if (defined > 0) {
+    requestSettingsSave();
+  }
+  return defined > 0;
+}
+
+/**
+ * Process an LFO modulation command
+ * The command replaces the whole modulation setup
+ * 
+ * Expected JSON format:
+ * {"mod": {"lfos": [{"shape": "sine", "rate": 0.2}],
+ *          "routes": [{"lfo": 0, "target": "hue", "depth": 255}]}}
+ * 
+ * @param modObj The "mod" object
+ * @return true if the configuration was applied
+ */
+bool processModJson(JsonObject modObj) {
+  if (!dmxInitialized || dmx == NULL) {
+    Serial.println("DMX not initialized, cannot configure modulation");
+    return false;
+  }
+  
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) != pdTRUE) {
+    return false;
+  }
+  
+  modMatrix.clear();
+  dmx->clearFixtureIntensity();
+  
+  // Oscillators, indexed by their position in the array
+  int lfoIndex = 0;
+  for (JsonObject lfo : modObj["lfos"].as<JsonArray>()) {
+    String shapeName = lfo["shape"] | "sine";
+    LfoShape shape = LFO_SINE;
+    if (shapeName == "triangle") shape = LFO_TRIANGLE;
+    else if (shapeName == "square") shape = LFO_SQUARE;
+    else if (shapeName == "saw") shape = LFO_SAW;
+    else if (shapeName == "random") shape = LFO_RANDOM;
+    
+    float rate = lfo["rate"] | 1.0f;
+    float beats = lfo["beats"] | 0.0f;
+    modMatrix.setLfo(lfoIndex++, shape, (uint32_t)(rate * 1000), (uint32_t)(beats * 256), lfo["seed"] | 1);
+  }
+  
+  // Routes
+  int routeCount = 0;
+  for (JsonObject route : modObj["routes"].as<JsonArray>()) {
+    String targetName = route["target"] | "";
+    ModTarget target = MOD_TARGET_NONE;
+    if (targetName == "speed") target = MOD_TARGET_SPEED;
+    else if (targetName == "hue") target = MOD_TARGET_HUE;
+    else if (targetName == "intensity") target = MOD_TARGET_INTENSITY;
+    
+    uint32_t mask = dmx->getGroupMask(route["group"] | DMX_GROUP_ALL);
+    if (modMatrix.addRoute(route["lfo"] | 0, target, route["depth"] | 255, mask)) {
+      routeCount++;
+    } else {
+      Serial.print("Invalid modulation route: ");
+      Serial.println(targetName);
+    }
+  }
+  
+  xSemaphoreGive(dmxMutex);
+  
+  Serial.print("Modulation configured: ");
+  Serial.print(lfoIndex);
+  Serial.print(" LFOs, ");
+  Serial.print(routeCount);
+  Serial.println(" routes");
+  return true;
+}
+
+/**
+ * Process a daily schedule command
+ * 
+ * Expected JSON format:
+ * {"daily": {"lat": 40.71, "lon": -74.01, "tz": -300, "clear": true,
+ *            "events": [{"at": "sunset", "offset": -15, "days": [1, 2], "cmd": {...}}]}}
+ * 
+ * @param dailyObj The "daily" object
+ * @return true if the schedule was updated and saved
+ */
+bool processDailyJson(JsonObject dailyObj) {
+  if (dailyObj.containsKey("lat") || dailyObj.containsKey("lon") || dailyObj.containsKey("tz")) {
+    dailySchedule.setLocation(dailyObj["lat"] | 0.0f, dailyObj["lon"] | 0.0f, dailyObj["tz"] | 0);
+  }
+  
+  if (dailyObj["clear"] | false) {
+    dailySchedule.clear();
+  }
+  
+  int added = 0;
+  for (JsonObject event : dailyObj["events"].as<JsonArray>()) {
+    String at = event["at"] | "";
+    DailyAnchor anchor = DAILY_AT_TIME;
+    int minutes = event["offset"] | 0;
+    
+    if (at == "sunrise") {
+      anchor = DAILY_AT_SUNRISE;
+    } else if (at == "sunset") {
+      anchor = DAILY_AT_SUNSET;
+    } else {
+      int separator = at.indexOf(':');
+      if (separator < 1) {
+        Serial.print("Invalid daily event time: ");
+        Serial.println(at);
+        continue;
+      }
+      minutes += at.substring(0, separator).toInt() * 60 + at.substring(separator + 1).toInt();
+    }
+    
+    uint8_t daysMask = DAILY_ALL_DAYS;
+    if (event.containsKey("days")) {
+      daysMask = 0;
+      for (int day : event["days"].as<JsonArray>()) {
+        if (day >= 0 && day <= 6) {
+          daysMask |= 1 << day;
+        }
+      }
+    }
+    
+    char cmdBuffer[DAILY_MAX_PAYLOAD];
+    size_t cmdLength = measureJson(event["cmd"]);
+    if (event["cmd"].isNull() || cmdLength > sizeof(cmdBuffer)) {
+      Serial.println("Daily event command missing or too large");
+      continue;
+    }
+    serializeJson(event["cmd"], cmdBuffer, sizeof(cmdBuffer));
+    
+    if (dailySchedule.addEntry(anchor, minutes, daysMask, (const uint8_t*)cmdBuffer, cmdLength)) {
+      added++;
+    } else {
+      Serial.println("Daily schedule full");
+      break;
+    }
+  }
+  
+  persistService.markDirty(PERSIST_DAILY);
+  dailyResyncPending = true;
+  
+  Serial.print("Daily schedule updated: ");
+  Serial.print(added);
+  Serial.print(" added, ");
+  Serial.print(dailySchedule.size());
+  Serial.println(" total");
+  return true;
+}
+
+/**
+ * Queue a scene save or delete for the persist task
+ * A newer change to the same scene replaces one still waiting
+ * 
+ * @param length Scene length, -1 to delete the scene
+ * @return false if too many changes are waiting
+ */
+bool queueSceneChange(uint16_t id, const uint8_t* data, int16_t length) {
+  bool queued = false;
+  portENTER_CRITICAL(&pendingSceneLock);
+  int slot = 0;
+  while (slot < pendingSceneCount && pendingScenes[slot].id != id) {
+    slot++;
+  }
+  if (slot < SCENE_PENDING_MAX) {
+    pendingScenes[slot].id = id;
+    pendingScenes[slot].length = length;
+    pendingScenes[slot].revision = ++pendingSceneRevision;
+    if (length > 0) {
+      memcpy(pendingScenes[slot].data, data, length);
+    }
+    pendingSceneCount = max(pendingSceneCount, (uint8_t)(slot + 1));
+    queued = true;
+  }
+  portEXIT_CRITICAL(&pendingSceneLock);
+  
+  if (queued) {
+    persistService.markDirty(PERSIST_SCENES);
+  }
+  return queued;
+}
+
+/**
+ * Write the queued scene changes to the scene store
+ * Runs in the persist task. A change stays queued, and recallable, until
+ * the store has it; one the store rejects (library full) is dropped rather
+ * than retried
+ * 
+ * @return true once the queue is empty
+ */
+bool persistScenes() {
+  static PendingScene scene;
+  for (;;) {
+    portENTER_CRITICAL(&pendingSceneLock);
+    bool empty = pendingSceneCount == 0;
+    if (!empty) {
+      scene = pendingScenes[0];
+    }
+    portEXIT_CRITICAL(&pendingSceneLock);
+    if (empty) {
+      return true;
+    }
+    
+    bool stored = scene.length < 0 ? sceneStore.remove(scene.id) : sceneStore.save(scene.id, scene.data, scene.length);
+    if (!stored) {
+      Serial.print("Failed to store scene ");
+      Serial.println(scene.id);
+    }
+    
+    // A newer change to the same scene replaced the entry meanwhile; keep
+    // it for the next pass
+    portENTER_CRITICAL(&pendingSceneLock);
+    if (pendingScenes[0].revision == scene.revision) {
+      pendingSceneCount--;
+      memmove(&pendingScenes[0], &pendingScenes[1], pendingSceneCount * sizeof(PendingScene));
+    }
+    portEXIT_CRITICAL(&pendingSceneLock);
+  }
+}
+
+/**
+ * Copy a scene into the DMX buffer: a change still waiting for the persist
+ * task, otherwise straight from the mapped scene partition
+ * Called with the DMX mutex held
+ * 
+ * @return false if there is no such scene
+ */
+bool recallScene(uint16_t id) {
+  uint8_t* frame = dmx->getDmxData() + 1;
+  bool found = false;
+  bool pending = false;
+  size_t length = 0;
+  
+  portENTER_CRITICAL(&pendingSceneLock);
+  for (int i = 0; i < pendingSceneCount; i++) {
+    if (pendingScenes[i].id == id) {
+      pending = true;
+      found = pendingScenes[i].length >= 0;
+      if (found) {
+        length = pendingScenes[i].length;
+        memcpy(frame, pendingScenes[i].data, length);
+      }
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&pendingSceneLock);
+  
+  if (!pending) {
+    found = sceneStore.recall(id, frame, length);
+  }
+  if (found) {
+    memset(frame + length, 0, DMX_PACKET_SIZE - 1 - length);
+  }
+  return found;
+}
+
+/**
+ * Process a scene command
+ * 
+ * Expected JSON format:
+ * {"scene": {"save": 3}}      Store the current frame as scene 3
+ * {"scene": {"recall": 3}}    Output scene 3, stopping any running pattern
+ * {"scene": {"delete": 3}}    Delete scene 3
+ * {"scene": {"report": true}} Send the store's capacity and fragmentation
+ * 
+ * @param sceneObj The "scene" object
+ * @return true if the command was applied
+ */
+bool processSceneJson(JsonObject sceneObj) {
+  if (!dmxInitialized || dmx == NULL) {
+    return false;
+  }
+  if (!sceneStore.isReady()) {
+    Serial.println("No scenes partition, scenes are not available");
+    return false;
+  }
+  
+  bool applied = false;
+  if (sceneObj.containsKey("save")) {
+    uint16_t id = sceneObj["save"].as<uint16_t>();
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      // Channels after the last one in use are not stored
+      const uint8_t* frame = dmx->getDmxData() + 1;
+      int16_t length = DMX_PACKET_SIZE - 1;
+      while (length > 0 && frame[length - 1] == 0) {
+        length--;
+      }
+      applied = queueSceneChange(id, frame, length);
+      xSemaphoreGive(dmxMutex);
+    }
+    Serial.print(applied ? "Scene saved: " : "Scene not saved, too many changes waiting: ");
+    Serial.println(id);
+  }
+  
+  if (sceneObj.containsKey("recall")) {
+    uint16_t id = sceneObj["recall"].as<uint16_t>();
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      applied = recallScene(id);
+      xSemaphoreGive(dmxMutex);
+    }
+    if (applied) {
+      if (patternHandler.isActive()) {
+        patternHandler.stop();
+      }
+      runningRainbowDemo = false;
+      requestSettingsSave();
+      Serial.print("Scene recalled: ");
+    } else {
+      Serial.print("Scene not found: ");
+    }
+    Serial.println(id);
+  }
+  
+  if (sceneObj.containsKey("delete")) {
+    uint16_t id = sceneObj["delete"].as<uint16_t>();
+    applied = queueSceneChange(id, NULL, -1);
+    Serial.print("Scene deleted: ");
+    Serial.println(id);
+  }
+  
+  if (sceneObj["report"] | false) {
+    sceneReportPending = true;
+    applied = true;
+  }
+  return applied;
+}
+
+/**
+ * Pattern commands, shared by the object and string forms of "pattern"
+ * Speed and cycles are the defaults for fields the command leaves out
+ */
+struct PatternCommand {
+  uint32_t key;                     // commandHash() of the name
+  const char* name;
+  DmxPattern::PatternType type;     // NONE stops the running pattern
+  uint16_t speed;                   // Default step time in ms
+  uint8_t cycles;                   // Default cycles, 0 = run until stopped
+};
+
+static const PatternCommand patternCommands[] = {
+  {commandHash("stop"),      "stop",      DmxPattern::NONE,       0,   0},
+  {commandHash("colorFade"), "colorFade", DmxPattern::COLOR_FADE, 50,  5},
+  {commandHash("rainbow"),   "rainbow",   DmxPattern::RAINBOW,    50,  3},
+  {commandHash("strobe"),    "strobe",    DmxPattern::STROBE,     100, 10},
+  {commandHash("chase"),     "chase",     DmxPattern::CHASE,      200, 3},
+  {commandHash("alternate"), "alternate", DmxPattern::ALTERNATE,  300, 5},
+  {commandHash("noise"),     "noise",     DmxPattern::NOISE,      40,  0},
+  {commandHash("wave"),      "wave",      DmxPattern::WAVE,       40,  5},
+  {commandHash("radial"),    "radial",    DmxPattern::RADIAL,     40,  5},
+  {commandHash("sweep"),     "sweep",     DmxPattern::SWEEP,      40,  5},
+};
+
+CommandRegistry<PatternCommand> patternRegistry;
+
+/**
+ * Process a pattern command
+ * 
+ * Expected JSON format:
+ * {"pattern": "rainbow"}
+ * 
+ * Or with parameters:
+ * {"pattern": {"type": "rainbow", "speed": 50, "cycles": 3, "division": 1}}
+ * 
+ * Noise also takes "seed"; wave, radial and sweep take "angle" and "axis"
+ * 
+ * @param value Pattern name or object
+ * @return true if the pattern was started or stopped
+ */
+bool processPatternJson(JsonVariant value) {
+  JsonObject pattern = value.as<JsonObject>();
+  const char* name = pattern.isNull() ? value.as<const char*>() : pattern["type"].as<const char*>();
+  if (name == NULL) {
+    Serial.println("JSON format error: pattern has no type");
+    return false;
+  }
+  
+  const PatternCommand* command = patternRegistry.find(commandHash(name, strlen(name), false));
+  if (command == NULL || strcmp(command->name, name) != 0) {
+    Serial.print("Unknown pattern: ");
+    Serial.println(name);
+    return false;
+  }
+  
+  if (command->type == DmxPattern::NONE) {
+    patternHandler.stop();
+    return true;
+  }
+  
+  // Missing fields read as null, so the string form takes every default
+  int speed = pattern["speed"] | (int)command->speed;
+  int cycles = pattern["cycles"] | (int)command->cycles;
+  float division = pattern["division"] | 0.0f;  // Steps per beat, 0 = use speed
+  uint32_t divisionQ8 = division > 0 ? (uint32_t)(min(division, 64.0f) * 256) : 0;
+  
+  if (command->type == DmxPattern::NOISE) {
+    patternHandler.setSeed(pattern["seed"] | 1);
+  } else if (command->type >= DmxPattern::WAVE) {
+    const char* axisName = pattern["axis"] | "x";
+    SpatialAxis axis = axisName[0] == 'z' ? AXIS_Z : (axisName[0] == 'y' ? AXIS_Y : AXIS_X);
+    patternHandler.setDirection(pattern["angle"] | 0.0f, axis);
+  }
+  
+  Serial.print("Starting pattern: ");
+  Serial.println(command->name);
+  patternHandler.start(command->type, speed, cycles, divisionQ8);
+  return true;
+}
+
+/**
+ * Set up four RGBW test fixtures if none are configured
+ * 
+ * @param purpose What the fixtures are for, for the log
+ */
+void ensureTestFixtures(const char* purpose) {
+  if (dmx->getNumFixtures() > 0) {
+    return;
+  }
+  
+  Serial.print("Setting up default test fixtures for ");
+  Serial.println(purpose);
+  
+  // The DMX task may be stepping a pattern over the fixtures
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+    // Initialize 4 test fixtures with 4 channels each (RGBW)
+    dmx->initializeFixtures(4, 4);
+    
+    // Configure fixtures with sequential DMX addresses
+    dmx->setFixtureConfig(0, "Fixture 1", 1, 1, 2, 3, 4);
+    dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
+    dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
+    dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+    xSemaphoreGive(dmxMutex);
+  }
+}
+
+/**
+ * Start the rainbow chase test
+ * Runs as the continuous rainbow with a step budget, so it does not block
+ */
+bool runRainbowTest(JsonObject testObj) {
+  // Get parameters with defaults if not specified
+  int cycles = testObj["cycles"] | 3;
+  int speed = testObj["speed"] | 50;
+  bool staggered = testObj["staggered"] | true;
+  
+  // Validate parameters
+  cycles = max(1, min(cycles, 10)); // Limit cycles between 1 and 10
+  speed = max(10, min(speed, 500)); // Limit speed between 10ms and 500ms
+  
+  Serial.println("Executing rainbow chase pattern via downlink command");
+  Serial.print("Cycles: ");
+  Serial.print(cycles);
+  Serial.print(", Speed: ");
+  Serial.print(speed);
+  Serial.print("ms, Staggered: ");
+  Serial.println(staggered ? "Yes" : "No");
+  
+  ensureTestFixtures("rainbow pattern");
+  
+  // Same steps as DmxController::runRainbowChase; the DMX task clears and saves when done
+  rainbowStepsLeft = cycles * 6 * 255;
+  rainbowStepDelay = speed;
+  rainbowStaggered = staggered;
+  runningRainbowDemo = true;
+  return true;
+}
+
+/**
+ * Start the strobe test
+ * loop() steps it one on or off phase at a time
+ */
+bool runStrobeTest(JsonObject testObj) {
+  // Get parameters with defaults if not specified
+  int color = testObj["color"] | 0;
+  int count = testObj["count"] | 20;
+  int onTime = testObj["onTime"] | 50;
+  int offTime = testObj["offTime"] | 50;
+  bool alternate = testObj["alternate"] | false;
+  
+  // Validate parameters
+  color = max(0, min(color, 3)); // Limit color between 0 and 3
+  count = max(1, min(count, 100)); // Limit count between 1 and 100
+  onTime = max(10, min(onTime, 1000)); // Limit onTime between 10ms and 1000ms
+  offTime = max(10, min(offTime, 1000)); // Limit offTime between 10ms and 1000ms
+  
+  Serial.println("Executing strobe test pattern via downlink command");
+  Serial.print("Color: ");
+  Serial.print(color);
+  Serial.print(", Count: ");
+  Serial.print(count);
+  Serial.print(", On Time: ");
+  Serial.print(onTime);
+  Serial.print("ms, Off Time: ");
+  Serial.print(offTime);
+  Serial.print(", Alternate: ");
+  Serial.println(alternate ? "Yes" : "No");
+  
+  ensureTestFixtures("strobe pattern");
+  
+  strobeTest.active = false;
+  strobeTest.color = color;
+  strobeTest.alternate = alternate;
+  strobeTest.on = false;
+  strobeTest.flash = -1;
+  strobeTest.count = count;
+  strobeTest.onTime = onTime;
+  strobeTest.offTime = offTime;
+  strobeTest.lastChange = millis() - offTime;  // First flash on the next step
+  strobeTest.active = true;
+  return true;
+}
+
+/**
+ * Turn the continuous rainbow in the main loop on or off
+ */
+bool runContinuousTest(JsonObject testObj) {
+  // Get parameters with defaults if not specified
+  bool enabled = testObj["enabled"] | false;
+  int speed = testObj["speed"] | 30;
+  bool staggered = testObj["staggered"] | true;
+  
+  // Validate parameters
+  speed = max(5, min(speed, 500)); // Limit speed between 5ms and 500ms
+  
+  // Set the continuous rainbow mode
+  rainbowStepsLeft = 0;
+  runningRainbowDemo = enabled;
+  rainbowStepDelay = speed;
+  rainbowStaggered = staggered;
+  
+  Serial.print("Continuous rainbow mode: ");
+  Serial.print(enabled ? "ENABLED" : "DISABLED");
+  Serial.print(", Speed: ");
+  Serial.print(speed);
+  Serial.print("ms, Staggered: ");
+  Serial.println(staggered ? "Yes" : "No");
+  
+  ensureTestFixtures("continuous rainbow");
+  
+  // Settings change continuously while enabled; save when the mode is disabled
+  if (!enabled) {
+    requestSettingsSave();
+  }
+  return true;
+}
+
+/**
+ * Confirm downlink connectivity with an LED pattern and the next status report
+ */
+bool runPingTest(JsonObject testObj) {
+  Serial.println("=== PING RECEIVED ===");
+  Serial.println("Downlink communication is working!");
+  
+  // Blink the LED in a distinctive pattern to indicate ping received
+  requestLedBlinks(9, 100);
+  
+  // Answered by the ping flag of the next status report
+  commandReport.recordPing();
+  return true;
+}
+
+/**
+ * Test commands, looked up by lower-case name
+ */
+struct TestCommand {
+  uint32_t key;                     // commandHash() of the lower-case name
+  const char* name;
+  bool (*handler)(JsonObject testObj);
+};
+
+static const TestCommand testCommands[] = {
+  {commandHash("rainbow"),    "rainbow",    runRainbowTest},
+  {commandHash("strobe"),     "strobe",     runStrobeTest},
+  {commandHash("continuous"), "continuous", runContinuousTest},
+  {commandHash("ping"),       "ping",       runPingTest},
+};
+
+CommandRegistry<TestCommand> testRegistry;
+
+/**
+ * Process a test command
+ * 
+ * Expected JSON format:
+ * {
+ *   "test": {
+ *     "pattern": "rainbow",
+ *     "cycles": 3,
+ *     "speed": 50,
+ *     "staggered": true
+ *   }
+ * }
+ * 
+ * Or:
+ * {
  *   "test": {
  *     "pattern": "strobe",
  *     "color": 1,
@@ -581,299 +2177,447 @@ DmxPattern patternHandler;
  *   }
  * }
  * 
- * @param jsonString The JSON string to process
+ * @param testObj The test object
+ * @return true if the test ran
+ */
+bool processTestJson(JsonObject testObj) {
+  const char* pattern = testObj["pattern"];
+  if (pattern == NULL) {
+    Serial.println("JSON format error: 'pattern' field not found in test object");
+    return false;
+  }
+  
+  Serial.print("Processing test pattern: ");
+  Serial.println(pattern);
+  
+  // Test names are case-insensitive
+  const TestCommand* command = testRegistry.find(commandHash(pattern, strlen(pattern), true));
+  if (command == NULL || strcasecmp(command->name, pattern) != 0) {
+    Serial.print("Unknown test pattern: ");
+    Serial.println(pattern);
+    return false;
+  }
+  return command->handler(testObj);
+}
+
+/**
+ * How much document a JSON command needs and which of its fields to keep
+ */
+enum JsonCommandShape {
+  JSON_SHAPE_SMALL,   // Fixed shape, fits SMALL_JSON_CAPACITY
+  JSON_SHAPE_ARRAY,   // Arrays or nested commands, DOWNLINK_JSON_CAPACITY
+  JSON_SHAPE_LIGHTS   // Light list, filtered down to address and channels
+};
+
+/**
+ * Top-level JSON commands, dispatched on their key
+ */
+struct JsonCommand {
+  uint32_t key;                     // commandHash() of the key
+  const char* name;
+  bool (*handler)(JsonVariant value);
+  JsonCommandShape shape;
+};
+
+static const JsonCommand jsonCommands[] = {
+  {commandHash("lights"),    "lights",    [](JsonVariant v) { return processLightsJson(v.as<JsonArray>()); },    JSON_SHAPE_LIGHTS},
+  {commandHash("pattern"),   "pattern",   processPatternJson,                                                    JSON_SHAPE_SMALL},
+  {commandHash("test"),      "test",      [](JsonVariant v) { return processTestJson(v.as<JsonObject>()); },     JSON_SHAPE_SMALL},
+  {commandHash("time"),      "time",      [](JsonVariant v) { return processTimeJson(v.as<JsonObject>()); },     JSON_SHAPE_SMALL},
+  {commandHash("tempo"),     "tempo",     [](JsonVariant v) { return processTempoJson(v.as<JsonObject>()); },    JSON_SHAPE_SMALL},
+  {commandHash("schedule"),  "schedule",  [](JsonVariant v) { return processScheduleJson(v.as<JsonObject>()); }, JSON_SHAPE_ARRAY},
+  {commandHash("positions"), "positions", [](JsonVariant v) { return processPositionsJson(v.as<JsonArray>()); }, JSON_SHAPE_ARRAY},
+  {commandHash("groups"),    "groups",    [](JsonVariant v) { return processGroupsJson(v.as<JsonArray>()); },    JSON_SHAPE_ARRAY},
+  {commandHash("mod"),       "mod",       [](JsonVariant v) { return processModJson(v.as<JsonObject>()); },      JSON_SHAPE_ARRAY},
+  {commandHash("daily"),     "daily",     [](JsonVariant v) { return processDailyJson(v.as<JsonObject>()); },    JSON_SHAPE_ARRAY},
+  {commandHash("scene"),     "scene",     [](JsonVariant v) { return processSceneJson(v.as<JsonObject>()); },    JSON_SHAPE_SMALL},
+};
+
+CommandRegistry<JsonCommand> jsonRegistry;
+
+/**
+ * Find the JSON command for a key
+ * 
+ * @param key The key, not necessarily null-terminated
+ * @param length Length of the key
+ * @return The command, or NULL if the key is not a command
+ */
+const JsonCommand* findJsonCommand(const char* key, size_t length) {
+  const JsonCommand* command = jsonRegistry.find(commandHash(key, length, false));
+  if (command == NULL || strncmp(command->name, key, length) != 0 || command->name[length] != '\0') {
+    return NULL;
+  }
+  return command;
+}
+
+/**
+ * Execute a parsed JSON command
+ * 
+ * The first key that names a command is executed; see jsonCommands for
+ * the commands and their handlers for the formats, e.g.
+ * {
+ *   "lights": [
+ *     {
+ *       "address": 1,
+ *       "channels": [255, 0, 128, 0]
+ *     }
+ *   ]
+ * }
+ * 
+ * A downlink may add "seq" (0-65535); a sequence number recently applied
+ * is a retransmission and is acknowledged without being applied again.
+ * A command that fails does not record its number, so a retry is applied.
+ * The result of a sequenced command goes into the next status report
+ * 
+ * @param doc The parsed command
+ * @param fromDownlink Check the sequence number (scheduled and daily commands are run as often as due)
  * @return true if processing was successful, false otherwise
  */
-bool processJsonPayload(const String& jsonString) {
-  StaticJsonDocument<MAX_JSON_SIZE> doc;
-  DeserializationError error = deserializeJson(doc, jsonString);
+bool dispatchJsonCommand(JsonDocument& doc, bool fromDownlink) {
+  bool sequenced = fromDownlink && !doc["seq"].isNull();
+  uint16_t seq = doc["seq"].as<uint32_t>() & 0xFFFF;
+  
+  const JsonCommand* command = NULL;
+  JsonVariant args;
+  for (JsonPair pair : doc.as<JsonObject>()) {
+    const char* key = pair.key().c_str();
+    command = findJsonCommand(key, strlen(key));
+    if (command != NULL) {
+      args = pair.value();
+      break;
+    }
+  }
+  
+  // Without a known command the sequence number stays unused for a retry
+  if (command == NULL) {
+    Serial.println("JSON format error: no known command key");
+    if (sequenced) {
+      commandReport.recordSequenced(seq, false);
+    }
+    return false;
+  }
+  
+  if (sequenced && commandSequence.isRepeat(seq)) {
+    Serial.print("Duplicate command, seq ");
+    Serial.print(seq);
+    Serial.println(" already applied");
+    commandReport.recordSequenced(seq, true);
+    return true;
+  }
+  
+  // A failed command leaves its number free, so the server's retry is applied
+  bool success = command->handler(args);
+  if (sequenced) {
+    if (success) {
+      commandSequence.record(seq);
+    }
+    commandReport.recordSequenced(seq, success);
+  }
+  return success;
+}
+
+/**
+ * Get the first key of a JSON object without parsing it
+ * 
+ * @param json The JSON text
+ * @param length Length of the JSON text
+ * @param key Output buffer for the key
+ * @param keySize Size of the output buffer
+ * @return true if the text starts with an object and a key that fits
+ */
+bool peekFirstJsonKey(const char* json, size_t length, char* key, size_t keySize) {
+  size_t i = 0;
+  while (i < length && isspace((unsigned char)json[i])) i++;
+  if (i >= length || json[i++] != '{') return false;
+  while (i < length && isspace((unsigned char)json[i])) i++;
+  if (i >= length || json[i++] != '"') return false;
+  
+  size_t n = 0;
+  while (i < length && json[i] != '"') {
+    if (n + 1 >= keySize) return false;
+    key[n++] = json[i++];
+  }
+  key[n] = '\0';
+  return i < length;
+}
 
+/**
+ * Parse a JSON command into a document and execute it
+ * 
+ * @param doc Document to parse into
+ * @param json The JSON text, parsed in place
+ * @param length Length of the JSON text
+ * @param filter Filter document, or NULL to keep every key
+ * @param fromDownlink Check the sequence number
+ */
+bool parseAndDispatchJson(JsonDocument& doc, char* json, size_t length, const JsonDocument* filter, bool fromDownlink) {
+  DeserializationError error = filter != NULL
+      ? deserializeJson(doc, json, length, DeserializationOption::Filter(*filter))
+      : deserializeJson(doc, json, length);
+  
   if (error) {
     Serial.print("JSON parsing error: ");
     Serial.println(error.c_str());
     return false;
   }
+  return dispatchJsonCommand(doc, fromDownlink);
+}
+
+/**
+ * Parse a JSON command into a stack document of a fixed capacity and execute it
+ */
+template <size_t CAPACITY>
+bool parseAndDispatchJson(char* json, size_t length, const JsonDocument* filter, bool fromDownlink) {
+  StaticJsonDocument<CAPACITY> doc;
+  return parseAndDispatchJson(doc, json, length, filter, fromDownlink);
+}
+
+/**
+ * Parse an array-shaped JSON command and execute it
+ * Uses the caller's document if given, else a stack one sized for a downlink
+ */
+bool parseAndDispatchArrayJson(JsonDocument* arrayDoc, char* json, size_t length, const JsonDocument* filter, bool fromDownlink) {
+  if (arrayDoc != NULL) {
+    return parseAndDispatchJson(*arrayDoc, json, length, filter, fromDownlink);
+  }
+  return parseAndDispatchJson<DOWNLINK_JSON_CAPACITY>(json, length, filter, fromDownlink);
+}
+
+/**
+ * Process JSON payload and control DMX fixtures
+ * 
+ * The first key selects the document capacity and a filter that drops
+ * everything the command does not read. The buffer is parsed in place
+ * (ArduinoJson zero-copy mode), so its contents are modified
+ * 
+ * @param json The JSON text, not necessarily null-terminated
+ * @param length Length of the JSON text in bytes
+ * @param fromDownlink true for a received downlink, false for a stored command
+ * @param arrayDoc Document for array commands when the text can be longer
+ *                 than a downlink, or NULL for one sized for a downlink
+ * @return true if processing was successful, false otherwise
+ */
+bool processJsonPayload(char* json, size_t length, bool fromDownlink, JsonDocument* arrayDoc = NULL) {
+  Serial.print("Processing JSON payload: ");
+  Serial.write((const uint8_t*)json, length);
+  Serial.println();
+  
+  char key[16];
+  if (!peekFirstJsonKey(json, length, key, sizeof(key))) {
+    return parseAndDispatchArrayJson(arrayDoc, json, length, NULL, fromDownlink);
+  }
+  
+  // Unknown first key: parse everything and let the dispatcher decide
+  const JsonCommand* command = findJsonCommand(key, strlen(key));
+  if (command == NULL) {
+    return parseAndDispatchArrayJson(arrayDoc, json, length, NULL, fromDownlink);
+  }
+  
+  // Lights keep only the fields each light is read for
+  if (command->shape == JSON_SHAPE_LIGHTS) {
+    StaticJsonDocument<JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(2)> lightsFilter;
+    lightsFilter["seq"] = true;
+    JsonObject light = lightsFilter[command->name].createNestedObject();
+    light["address"] = true;
+    light["channels"] = true;
+    return parseAndDispatchArrayJson(arrayDoc, json, length, &lightsFilter, fromDownlink);
+  }
+  
+  // Other commands keep their own subtree and the sequence number only
+  StaticJsonDocument<JSON_OBJECT_SIZE(2)> commandFilter;
+  commandFilter["seq"] = true;
+  commandFilter[command->name] = true;
+  if (command->shape == JSON_SHAPE_SMALL) {
+    return parseAndDispatchJson<SMALL_JSON_CAPACITY>(json, length, &commandFilter, fromDownlink);
+  }
+  return parseAndDispatchArrayJson(arrayDoc, json, length, &commandFilter, fromDownlink);
+}
 
-  Serial.print("Processing JSON payload: ");
-  Serial.println(jsonString);
-
-  // First, check for pattern commands
-  if (doc.containsKey("pattern")) {
-    // Handle both object and string pattern formats
-    if (doc["pattern"].is<JsonObject>()) {
-      // Object format - {"pattern": {"type": "rainbow", "speed": 50}}
-      JsonObject pattern = doc["pattern"];
-      if (pattern.containsKey("type")) {
-        String type = pattern["type"];
-        int speed = pattern["speed"] | 50;  // Default 50ms
-        int cycles = pattern["cycles"] | 5;  // Default 5 cycles
-        
-        DmxPattern::PatternType patternType = DmxPattern::NONE;
-        
-        if (type == "colorFade") {
-          patternType = DmxPattern::COLOR_FADE;
-        } else if (type == "rainbow") {
-          patternType = DmxPattern::RAINBOW;
-        } else if (type == "strobe") {
-          patternType = DmxPattern::STROBE;
-          speed = pattern["speed"] | 100;  // Slower default for strobe
-        } else if (type == "chase") {
-          patternType = DmxPattern::CHASE;
-        } else if (type == "alternate") {
-          patternType = DmxPattern::ALTERNATE;
-        } else if (type == "stop") {
-          patternHandler.stop();
-          return true;
-        }
-        
-        if (patternType != DmxPattern::NONE) {
-          patternHandler.start(patternType, speed, cycles);
-          return true;
-        }
-      }
-    } else if (doc["pattern"].is<String>()) {
-      // String format - {"pattern": "rainbow"}
-      String patternType = doc["pattern"].as<String>();
-      Serial.print("Simple pattern format detected: ");
-      Serial.println(patternType);
-      
-      // Default values for each pattern
-      int speed = 50;
-      int cycles = 5;
-      DmxPattern::PatternType type = DmxPattern::NONE;
-      
-      if (patternType == "colorFade") {
-        type = DmxPattern::COLOR_FADE;
-      } else if (patternType == "rainbow") {
-        type = DmxPattern::RAINBOW;
-        cycles = 3;
-      } else if (patternType == "strobe") {
-        type = DmxPattern::STROBE;
-        speed = 100;
-        cycles = 10;
-      } else if (patternType == "chase") {
-        type = DmxPattern::CHASE;
-        speed = 200;
-        cycles = 3;
-      } else if (patternType == "alternate") {
-        type = DmxPattern::ALTERNATE;
-        speed = 300;
-        cycles = 5;
-      } else if (patternType == "stop") {
-        patternHandler.stop();
-        return true;
-      }
-      
-      if (type != DmxPattern::NONE) {
-        Serial.println("Starting pattern...");
-        patternHandler.start(type, speed, cycles);
-        return true;
-      }
+/**
+ * Applies decoded downlink commands to the DMX controller
+ * 
+ * The decoder (CommandDecoder) has checked every field; these only take the
+ * mutex and write. Runs in the DMX task, like the rest of the command path
+ */
+class DmxCommandSink : public CommandSink {
+public:
+  bool frameChanged = false;  // Set when a command changed the DMX frame
+  
+  bool isRepeat(uint16_t seq) override {
+    return commandSequence.isRepeat(seq);
+  }
+  
+  void recordSequence(uint16_t seq) override {
+    commandSequence.record(seq);
+  }
+  
+  // Single-byte commands: save the new look and confirm with the LED
+  void setAllFixtures(uint8_t r, uint8_t g, uint8_t b, uint8_t w, bool testTrigger) override {
+    if (testTrigger) {
+      Serial.println("DIRECT TEST TRIGGER DETECTED - Setting all fixtures to GREEN");
+    } else {
+      Serial.printf("COMMAND: Set all fixtures to R=%d G=%d B=%d W=%d\n", r, g, b, w);
+    }
+    for (int i = 0; i < dmx->getNumFixtures(); i++) {
+      dmx->setFixtureColor(i, r, g, b, w);
     }
+    dmx->sendData();
+    requestSettingsSave();
+    requestLedBlinks(testTrigger ? 5 : 2, 200);
   }
-
-  // Then check for test commands
-  if (doc.containsKey("test")) {
-    // Get the test object
-    JsonObject testObj = doc["test"];
-    
-    // Check if the test object has a pattern field
-    if (!testObj.containsKey("pattern")) {
-      Serial.println("JSON format error: 'pattern' field not found in test object");
-      return false;
+  
+  bool applyJson(char* json, size_t length) override {
+    return processJsonPayload(json, length, true);
+  }
+  
+  void setChannels(uint16_t first, const uint8_t* values, size_t count) override {
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      memcpy(dmx->getDmxData() + first, values, count);
+      xSemaphoreGive(dmxMutex);
     }
-    
-    // Get the pattern type
-    String pattern = testObj["pattern"].as<String>();
-    pattern.toLowerCase(); // Convert to lowercase for case-insensitive comparison
-    
-    Serial.print("Processing test pattern: ");
-    Serial.println(pattern);
-    
-    // Process based on pattern type
-    if (pattern == "rainbow") {
-      // Get parameters with defaults if not specified
-      int cycles = testObj.containsKey("cycles") ? testObj["cycles"].as<int>() : 3;
-      int speed = testObj.containsKey("speed") ? testObj["speed"].as<int>() : 50;
-      bool staggered = testObj.containsKey("staggered") ? testObj["staggered"].as<bool>() : true;
-      
-      // Validate parameters
-      cycles = max(1, min(cycles, 10)); // Limit cycles between 1 and 10
-      speed = max(10, min(speed, 500)); // Limit speed between 10ms and 500ms
-      
-      Serial.println("Executing rainbow chase pattern via downlink command");
-      Serial.print("Cycles: ");
-      Serial.print(cycles);
-      Serial.print(", Speed: ");
-      Serial.print(speed);
-      Serial.print("ms, Staggered: ");
-      Serial.println(staggered ? "Yes" : "No");
-      
-      // Configure test fixtures if none exist
-      if (dmx->getNumFixtures() == 0) {
-        Serial.println("Setting up default test fixtures for rainbow pattern");
-        // Initialize 4 test fixtures with 4 channels each (RGBW)
-        dmx->initializeFixtures(4, 4);
-        
-        // Configure fixtures with sequential DMX addresses
-        dmx->setFixtureConfig(0, "Fixture 1", 1, 1, 2, 3, 4);
-        dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
-        dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
-        dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
-      }
-      
-      // Run the rainbow chase pattern
-      dmx->runRainbowChase(cycles, speed, staggered);
-      
-      // Save the final state after the pattern completes
-      dmx->saveSettings();
-      
-      return true;
-    } 
-    else if (pattern == "strobe") {
-      // Get parameters with defaults if not specified
-      int color = testObj.containsKey("color") ? testObj["color"].as<int>() : 0;
-      int count = testObj.containsKey("count") ? testObj["count"].as<int>() : 20;
-      int onTime = testObj.containsKey("onTime") ? testObj["onTime"].as<int>() : 50;
-      int offTime = testObj.containsKey("offTime") ? testObj["offTime"].as<int>() : 50;
-      bool alternate = testObj.containsKey("alternate") ? testObj["alternate"].as<bool>() : false;
-      
-      // Validate parameters
-      color = max(0, min(color, 3)); // Limit color between 0 and 3
-      count = max(1, min(count, 100)); // Limit count between 1 and 100
-      onTime = max(10, min(onTime, 1000)); // Limit onTime between 10ms and 1000ms
-      offTime = max(10, min(offTime, 1000)); // Limit offTime between 10ms and 1000ms
-      
-      Serial.println("Executing strobe test pattern via downlink command");
-      Serial.print("Color: ");
-      Serial.print(color);
-      Serial.print(", Count: ");
-      Serial.print(count);
-      Serial.print(", On Time: ");
-      Serial.print(onTime);
-      Serial.print("ms, Off Time: ");
-      Serial.print(offTime);
-      Serial.print(", Alternate: ");
-      Serial.println(alternate ? "Yes" : "No");
-      
-      // Configure test fixtures if none exist
-      if (dmx->getNumFixtures() == 0) {
-        Serial.println("Setting up default test fixtures for strobe pattern");
-        // Initialize 4 test fixtures with 4 channels each (RGBW)
-        dmx->initializeFixtures(4, 4);
-        
-        // Configure fixtures with sequential DMX addresses
-        dmx->setFixtureConfig(0, "Fixture 1", 1, 1, 2, 3, 4);
-        dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
-        dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
-        dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+    frameChanged = true;
+  }
+  
+  void setFixtures(uint32_t first, uint32_t count, const uint8_t* colors, uint8_t stride) override {
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* c = colors + i * stride;
+        dmx->setFixtureColor(first + i, c[0], c[1], c[2], stride == 4 ? c[3] : 0);
       }
-      
-      // Run the strobe test pattern
-      dmx->runStrobeTest(color, count, onTime, offTime, alternate);
-      
-      // Save the final state after the pattern completes
-      dmx->saveSettings();
-      
-      return true;
+      xSemaphoreGive(dmxMutex);
     }
-    else if (pattern == "continuous") {
-      // This pattern controls the continuous rainbow effect in the main loop
-      
-      // Get parameters with defaults if not specified
-      bool enabled = testObj.containsKey("enabled") ? testObj["enabled"].as<bool>() : false;
-      int speed = testObj.containsKey("speed") ? testObj["speed"].as<int>() : 30;
-      bool staggered = testObj.containsKey("staggered") ? testObj["staggered"].as<bool>() : true;
-      
-      // Validate parameters
-      speed = max(5, min(speed, 500)); // Limit speed between 5ms and 500ms
-      
-      // Set the continuous rainbow mode
-      runningRainbowDemo = enabled;
-      rainbowStepDelay = speed;
-      rainbowStaggered = staggered;
-      
-      Serial.print("Continuous rainbow mode: ");
-      Serial.print(enabled ? "ENABLED" : "DISABLED");
-      Serial.print(", Speed: ");
-      Serial.print(speed);
-      Serial.print("ms, Staggered: ");
-      Serial.println(staggered ? "Yes" : "No");
-      
-      // Configure test fixtures if none exist
-      if (dmx->getNumFixtures() == 0) {
-        Serial.println("Setting up default test fixtures for continuous rainbow");
-        // Initialize 4 test fixtures with 4 channels each (RGBW)
-        dmx->initializeFixtures(4, 4);
-        
-        // Configure fixtures with sequential DMX addresses
-        dmx->setFixtureConfig(0, "Fixture 1", 1, 1, 2, 3, 4);
-        dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
-        dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
-        dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
-      }
-      
-      if (enabled) {
-        // Note: We don't save settings here as they'll continuously change
-        // They'll be saved when the mode is disabled
-      } else {
-        runningRainbowDemo = false;
-        Serial.println("Continuous rainbow mode disabled");
-        
-        // Save the final state when the continuous mode is disabled
-        dmx->saveSettings();
+    frameChanged = true;
+  }
+  
+  void fillFixtures(uint32_t first, uint32_t count, const uint8_t* c) override {
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      uint32_t numFixtures = dmx->getNumFixtures();
+      uint32_t last = first + min(count, numFixtures);
+      for (uint32_t i = first; i < last && i < numFixtures; i++) {
+        dmx->setFixtureColor(i, c[0], c[1], c[2], c[3]);
       }
-      
-      return true;
+      xSemaphoreGive(dmxMutex);
     }
-    else if (pattern == "ping") {
-      // Simple ping command for testing downlink connectivity
-      Serial.println("=== PING RECEIVED ===");
-      Serial.println("Downlink communication is working!");
-      
-      // Blink the LED in a distinctive pattern to indicate ping received
-      for (int i = 0; i < 3; i++) {
-        DmxController::blinkLED(LED_PIN, 3, 100);
-        delay(500);
+    frameChanged = true;
+  }
+  
+  bool isPatternType(uint8_t type) override {
+    return type <= DmxPattern::SWEEP;
+  }
+  
+  void setPattern(uint8_t type, uint32_t speed, uint32_t cycles) override {
+    if (type == DmxPattern::NONE) {
+      patternHandler.stop();
+    } else {
+      patternHandler.start((DmxPattern::PatternType)type, max(speed, (uint32_t)5), cycles);
+    }
+  }
+  
+  void applyFrameDelta(BinaryReader runs) override {
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      binaryDecodeDelta(runs, dmx->getDmxData() + 1, DMX_PACKET_SIZE - 1);
+      xSemaphoreGive(dmxMutex);
+    }
+    frameChanged = true;
+  }
+  
+  void setPaletteEntries(uint32_t first, uint32_t count, const uint8_t* colors) override {
+    for (uint32_t i = 0; i < count; i++) {
+      const uint8_t* c = colors + i * 4;
+      colorPalette.set(first + i, RgbwColor{c[0], c[1], c[2], c[3]});
+    }
+    requestSettingsSave();
+  }
+  
+  void setFixturePalette(uint32_t first, uint32_t count, const uint8_t* indices, uint8_t bits) override {
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      for (uint32_t i = 0; i < count; i++) {
+        RgbwColor color = colorPalette.get(binaryUnpackBits(indices, i, bits));
+        dmx->setFixtureColor(first + i, color.r, color.g, color.b, color.w);
       }
-      
-      // Send a ping response uplink
-      if (loraInitialized && lora != NULL) {
-        String response = "{\"ping_response\":\"ok\"}";
-        if (lora->sendString(response, 1, true)) {
-          Serial.println("Ping response sent (confirmed)");
+      xSemaphoreGive(dmxMutex);
+    }
+    frameChanged = true;
+  }
+  
+  void setGroupPalette(uint8_t group, uint8_t index) override {
+    RgbwColor color = colorPalette.get(index);
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      uint32_t mask = dmx->getGroupMask(group);
+      for (int i = 0; i < dmx->getNumFixtures() && i < 32; i++) {
+        if (mask & (1UL << i)) {
+          dmx->setFixtureColor(i, color.r, color.g, color.b, color.w);
         }
       }
-      
-      return true;
-    }
-    else {
-      Serial.print("Unknown test pattern: ");
-      Serial.println(pattern);
-      return false;
+      xSemaphoreGive(dmxMutex);
     }
+    frameChanged = true;
   }
-  // Finally check for direct light control
-  if (doc.containsKey("lights")) {
-    // Get the lights array
-    JsonArray lightsArray = doc["lights"];
-    
-    // Process the lights array
-    bool success = processLightsJson(lightsArray);
-    
-    // If processing was successful, send the data
-    if (success) {
-      // Save settings to persistent storage (already called in processLightsJson)
-      return true;
-    } else {
-      Serial.println("Failed to process lights array");
-      return false;
+  
+  size_t quantizedSize(uint8_t format, uint32_t count) override {
+    return quantPackedSize(format, count);
+  }
+  
+  void setQuantized(uint8_t format, bool dither, uint32_t first, uint32_t count, const uint8_t* packed) override {
+    RgbwColor colors[MAX_FIXTURES];
+    quantDecode(format, packed, count, dither, first, colors);
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      dmx->setFixtureColors(colors, count, first);
+      xSemaphoreGive(dmxMutex);
     }
+    frameChanged = true;
   }
+};
 
-  // If we got here, no valid command objects were found
-  Serial.println("JSON format error: missing 'lights', 'pattern', or 'test' object");
-  return false;
+DmxCommandSink dmxCommandSink;
+CommandDecoder commandDecoder(dmxCommandSink, MAX_FIXTURES, PALETTE_SIZE);
+
+/**
+ * Process a binary command payload
+ * 
+ * Every command is checked before any is applied, then all are applied
+ * in order; a payload with a malformed command applies nothing.
+ * 
+ * @param payload The payload data
+ * @param size The size of the payload
+ * @return true if every command was applied, false if nothing was
+ */
+bool processBinaryPayload(const uint8_t* payload, size_t size) {
+  if (!dmxInitialized || dmx == NULL) {
+    Serial.println("DMX not initialized, cannot process binary payload");
+    return false;
+  }
+  
+  dmxCommandSink.frameChanged = false;
+  BinaryDecodeInfo info;
+  bool success = commandDecoder.decodeBinary(payload, size, info);
+  
+  if (info.duplicate) {
+    Serial.print("Duplicate binary payload, seq ");
+    Serial.print(info.seq);
+    Serial.println(" already applied");
+    commandReport.recordSequenced(info.seq, true);
+    return true;
+  }
+  if (info.error != NULL) {
+    Serial.print(info.error);
+    Serial.print(" at byte ");
+    Serial.println(info.errorOffset);
+  }
+  
+  // The DMX task sends the new frame; keep it for the next boot
+  if (dmxCommandSink.frameChanged) {
+    requestSettingsSave();
+  }
+  
+  if (info.sequenced) {
+    commandReport.recordSequenced(info.seq, success);
+  }
+  
+  Serial.print("Binary payload: ");
+  Serial.print(info.commands);
+  Serial.println(" commands applied");
+  return success;
 }
 
 // Add this helper function at the end of the file, before the loop() function
@@ -905,538 +2649,536 @@ void debugBytes(const char* label, uint8_t* data, size_t size) {
 }
 
 /**
- * Callback function for receiving downlink data from LoRaWAN
- * This function will be called by the LoRaManager when data is received
+ * Replay part of a completed fragmented payload straight from flash
+ * Called by the DMX task each frame; a binary payload is applied at once,
+ * JSON commands one line at a time until the frame's budget is spent
+ */
+void runFragmentReplay() {
+  if (!fragmentReplayReady) {
+    return;
+  }
+  
+  FragmentReplay& replay = fragmentReplay;
+  if (replay.content == FRAG_CONTENT_BINARY) {
+    replay.success = processBinaryPayload(replay.data, replay.size);
+    replay.offset = replay.size;
+  } else {
+    // One JSON command per line; each is copied out because parsing rewrites it.
+    // A line can hold four downlinks' worth of values, so array commands get
+    // a document sized for it, kept static rather than on the task's stack
+    static char line[MAX_JSON_SIZE];
+    static StaticJsonDocument<FRAGMENT_JSON_CAPACITY> lineDoc;
+    uint32_t started = micros();
+    while (replay.offset < replay.size && micros() - started < FRAGMENT_REPLAY_BUDGET_US) {
+      uint32_t end = replay.offset;
+      while (end < replay.size && replay.data[end] != '\n') end++;
+      uint32_t length = end - replay.offset;
+      if (length > sizeof(line)) {
+        Serial.println("Fragmented JSON command too long");
+        replay.success = false;
+      } else if (length > 0) {
+        memcpy(line, replay.data + replay.offset, length);
+        commandReceivedMs = millis();
+        replay.success &= processJsonPayload(line, length, true, &lineDoc);
+      }
+      replay.offset = end + 1;
+    }
+  }
+  
+  if (replay.offset >= replay.size) {
+    fragmentReplayReady = false;
+    xTaskNotifyGive(fragmentTaskHandle);
+  }
+}
+
+/**
+ * Hand a completed fragmented payload to the DMX task and wait for it to
+ * be replayed; the flash stays mapped and untouched until then
  * 
- * @param payload The payload data
- * @param size The size of the payload
- * @param port The port on which the data was received
+ * @return true if every command was applied
  */
-void handleDownlinkCallback(uint8_t* payload, size_t size, uint8_t port) {
-  Serial.println("\n\n==== DEBUG: ENTERING DOWNLINK CALLBACK ====");
+bool runFragmentedPayload() {
+  spi_flash_mmap_handle_t handle;
+  const uint8_t* data = fragmentTransfer.map(handle);
+  if (data == NULL) {
+    Serial.println("Failed to map reassembled payload");
+    return false;
+  }
   
-  // Print a detailed raw byte dump of the received payload
-  debugBytes("RAW DOWNLINK PAYLOAD", payload, size);
+  fragmentReplay.data = data;
+  fragmentReplay.size = fragmentTransfer.getSize();
+  fragmentReplay.offset = 0;
+  fragmentReplay.content = fragmentTransfer.getContent();
+  fragmentReplay.success = true;
+  fragmentReplayReady = true;
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   
-  // Print a memory report at the start
-  Serial.print("Free heap at start of downlink handler: ");
-  Serial.println(ESP.getFreeHeap());
+  fragmentTransfer.unmap(handle);
+  return fragmentReplay.success;
+}
+
+/**
+ * Apply a message from the fragment port
+ * Called by the fragment worker, which owns the transfer and its flash
+ * 
+ * @param payload The payload data
+ * @param size The size of the payload
+ * @return true if the message was valid
+ */
+bool applyFragmentMessage(const uint8_t* payload, size_t size) {
+  BinaryReader reader(payload, size);
+  uint8_t opcode, session;
+  if (!reader.readByte(opcode) || !reader.readByte(session)) {
+    return false;
+  }
   
-  // Handle basic binary commands (values 0-4) first before any other processing
-  if (size == 1) {
-    uint8_t cmd = payload[0];
-    
-    // Check if it's a binary value 0-4
-    if (cmd <= 4) {
-      Serial.print("DIRECT BINARY COMMAND DETECTED: ");
-      Serial.println(cmd);
+  switch (opcode) {
+    case FRAG_OP_SETUP: {
+      uint8_t content, fragmentSize, parityCount;
+      uint32_t totalSize;
+      const uint8_t* crcBytes;
+      if (!reader.readByte(content) || !reader.readVarint(totalSize) || !reader.readByte(fragmentSize) ||
+          !reader.readByte(parityCount) || (crcBytes = reader.readBytes(4)) == NULL) {
+        return false;
+      }
+      uint32_t crc = crcBytes[0] | (crcBytes[1] << 8) | (crcBytes[2] << 16) | ((uint32_t)crcBytes[3] << 24);
       
-      if (dmxInitialized && dmx != NULL) {
-        switch (cmd) {
-          case 0:
-            Serial.println("COMMAND: Turn all fixtures OFF");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 0, 0, 0, 0);
-            }
-            break;
-          case 1:
-            Serial.println("COMMAND: Set all fixtures to RED");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 255, 0, 0, 0);
-            }
-            break;
-          case 2:
-            Serial.println("COMMAND: Set all fixtures to GREEN");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 0, 255, 0, 0);
-            }
-            break;
-          case 3:
-            Serial.println("COMMAND: Set all fixtures to BLUE");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 0, 0, 255, 0);
-            }
-            break;
-          case 4:
-            Serial.println("COMMAND: Set all fixtures to WHITE");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 0, 0, 0, 255);
-            }
-            break;
-        }
-        
-        // Send the DMX data and save settings
-        dmx->sendData();
-        dmx->saveSettings();
-        Serial.println("Binary command processed successfully");
-        
-        // Blink LED to indicate successful processing
-        DmxController::blinkLED(LED_PIN, 2, 200);
-        return;  // Exit early - we've processed the command
+      // A repeated setup must not wipe the fragments already received
+      if (fragmentTransfer.isSameSession(session, totalSize, fragmentSize, parityCount, crc)) {
+        return true;
       }
+      return fragmentTransfer.begin(session, content, totalSize, fragmentSize, parityCount, crc);
     }
     
-    // Check for ASCII digit '0'-'4'
-    if (cmd >= '0' && cmd <= '4') {
-      int cmdValue = cmd - '0';  // Convert ASCII to integer
-      Serial.print("ASCII DIGIT COMMAND DETECTED: '");
-      Serial.print((char)cmd);
-      Serial.print("' (");
-      Serial.print(cmdValue);
-      Serial.println(")");
-      
-      if (dmxInitialized && dmx != NULL) {
-        switch (cmdValue) {
-          case 0:
-            Serial.println("COMMAND: Turn all fixtures OFF");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 0, 0, 0, 0);
-            }
-            break;
-          case 1:
-            Serial.println("COMMAND: Set all fixtures to RED");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 255, 0, 0, 0);
-            }
-            break;
-          case 2:
-            Serial.println("COMMAND: Set all fixtures to GREEN");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 0, 255, 0, 0);
-            }
-            break;
-          case 3:
-            Serial.println("COMMAND: Set all fixtures to BLUE");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 0, 0, 255, 0);
-            }
-            break;
-          case 4:
-            Serial.println("COMMAND: Set all fixtures to WHITE");
-            for (int i = 0; i < dmx->getNumFixtures(); i++) {
-              dmx->setFixtureColor(i, 0, 0, 0, 255);
-            }
-            break;
-        }
-        
-        // Send the DMX data and save settings
-        dmx->sendData();
-        dmx->saveSettings();
-        Serial.println("ASCII digit command processed successfully");
-        
-        // Blink LED to indicate successful processing
-        DmxController::blinkLED(LED_PIN, 2, 200);
-        return;  // Exit early - we've processed the command
+    case FRAG_OP_DATA: {
+      uint32_t index;
+      if (!reader.readVarint(index)) {
+        return false;
+      }
+      size_t length = reader.remaining();
+      FragmentResult result = fragmentTransfer.addFragment(session, index, reader.readBytes(length), length);
+      if (result == FRAG_COMPLETE) {
+        Serial.print("Fragmented payload complete, ");
+        Serial.print(fragmentTransfer.getRecoveredCount());
+        Serial.println(" fragments rebuilt from parity");
+        fragmentStatusPending = true;
+        return runFragmentedPayload();
       }
+      if (result == FRAG_CORRUPT) {
+        fragmentStatusPending = true;
+        return false;
+      }
+      return result != FRAG_REJECTED;
     }
-  }
-  
-  // Quick test for any special byte (0xAA or 170 decimal or any other non-standard value)
-  if (size == 1 && (payload[0] == 0xAA || payload[0] == 170 || payload[0] == 0xFF || payload[0] == 255)) {
-    Serial.println("DIRECT TEST TRIGGER DETECTED - Running test with JSON from README");
     
-    // Force green on fixtures
-    if (dmxInitialized && dmx != NULL) {
-      Serial.println("\n===== DIRECT TEST: SETTING ALL FIXTURES TO GREEN =====");
-      // Set all fixtures to fixed green
-      for (int i = 0; i < dmx->getNumFixtures(); i++) {
-        dmx->setFixtureColor(i, 0, 255, 0, 0);
+    case FRAG_OP_STATUS:
+      fragmentStatusPending = true;
+      return true;
+    
+    case FRAG_OP_ABORT:
+      if (fragmentTransfer.getSession() == session) {
+        fragmentTransfer.abort();
       }
-      dmx->sendData();
-      dmx->saveSettings();
-      Serial.println("All fixtures set to GREEN");
-      Serial.println("TEST COMPLETED");
-      
-      // Add strong visual confirmation to debugging
-      Serial.println("=================================================");
-      Serial.println("||                                             ||");
-      Serial.println("||  DIRECT TEST: GREEN LIGHTS COMMAND APPLIED  ||");
-      Serial.println("||                                             ||");
-      Serial.println("=================================================");
-      
-      // Blink LED to indicate successful processing
-      DmxController::blinkLED(LED_PIN, 5, 200);
-      return;
+      return true;
+    
+    default:
+      Serial.print("Unknown fragment opcode: 0x");
+      Serial.println(opcode, HEX);
+      return false;
+  }
+}
+
+/**
+ * Fragment message queued for the worker
+ */
+struct FragmentMessage {
+  uint8_t length;
+  uint8_t data[MAX_DOWNLINK_SIZE];
+};
+
+/**
+ * Fragment Worker Task - Runs on Core 1 at idle priority
+ * Erases and writes the transfer area in flash, one message at a time, so
+ * the DMX task never waits on flash for a fragment
+ */
+void fragmentTask(void * parameter) {
+  FragmentMessage message;
+  while (true) {
+    if (xQueueReceive(fragmentQueue, &message, portMAX_DELAY) == pdTRUE &&
+        !applyFragmentMessage(message.data, message.length)) {
+      Serial.println("Fragment message rejected");
     }
   }
+}
+
+/**
+ * Handle a downlink on the fragment port
+ * Only queues the message; the fragment worker applies it
+ * 
+ * @param payload The payload data
+ * @param size The size of the payload
+ * @return true if the message was queued
+ */
+bool processFragmentPayload(uint8_t* payload, size_t size) {
+  if (size < 2 || size > MAX_DOWNLINK_SIZE || fragmentQueue == NULL) {
+    return false;
+  }
+  
+  FragmentMessage message;
+  message.length = size;
+  memcpy(message.data, payload, size);
+  if (xQueueSend(fragmentQueue, &message, 0) != pdTRUE) {
+    Serial.println("Fragment queue full, message dropped");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Handle a downlink on the text port: a single-byte command or JSON
+ */
+bool processTextPayload(uint8_t* payload, size_t size) {
+  if (!dmxInitialized || dmx == NULL) {
+    return false;
+  }
+  return commandDecoder.decodeText(payload, size);
+}
+
+/**
+ * Downlink handlers, looked up by fPort
+ */
+struct PortRoute {
+  uint32_t key;                     // fPort
+  const char* name;
+  bool (*handler)(uint8_t* payload, size_t size);
+};
+
+static const PortRoute portRoutes[] = {
+  {JSON_COMMAND_PORT,    "json",   processTextPayload},
+  {BINARY_PROTOCOL_PORT, "binary", [](uint8_t* payload, size_t size) { return processBinaryPayload(payload, size); }},
+  {FRAGMENT_PORT,        "fragment", processFragmentPayload},
+};
+
+CommandRegistry<PortRoute> portRegistry;
+
+/**
+ * Index the command tables for dispatch
+ * Called from setup() before any command can arrive
+ */
+void buildCommandRegistries() {
+  bool ok = jsonRegistry.build(jsonCommands, sizeof(jsonCommands) / sizeof(jsonCommands[0]));
+  ok &= patternRegistry.build(patternCommands, sizeof(patternCommands) / sizeof(patternCommands[0]));
+  ok &= testRegistry.build(testCommands, sizeof(testCommands) / sizeof(testCommands[0]));
+  ok &= portRegistry.build(portRoutes, sizeof(portRoutes) / sizeof(portRoutes[0]));
+  if (!ok) {
+    Serial.println("ERROR: Command table has a duplicate key or is too large");
+  }
+}
+
+/**
+ * Callback function for receiving downlink data from LoRaWAN
+ * This function will be called by the LoRaManager when data is received
+ * 
+ * Runs inside the uplink call, so it only queues the payload; the DMX
+ * task applies it at the next frame boundary (see applyQueuedCommand)
+ * 
+ * @param payload The payload data
+ * @param size The size of the payload
+ * @param port The port on which the data was received
+ */
+void handleDownlinkCallback(uint8_t* payload, size_t size, uint8_t port) {
+  if (port == NETWORK_TIME_PORT) {
+    return;
+  }
+  if (!dmxInitialized) {
+    Serial.println("ERROR: DMX not initialized, cannot process command");
+    return;
+  }
   
-  // Enhanced logging for regular payload processing
+  if (!commandQueue.push(payload, size, port, millis())) {
+    Serial.print("Downlink dropped, command queue full or payload too large (");
+    Serial.print(commandQueue.getDropped());
+    Serial.println(" dropped)");
+  }
+}
+
+/**
+ * Apply a queued downlink
+ * Called from the DMX task between frames; the payload is parsed once, in
+ * place, by the handler registered for its port in portRoutes
+ * 
+ * @param command The queued downlink
+ */
+void applyQueuedCommand(QueuedCommand& command) {
   static uint32_t downlinkCounter = 0;
   downlinkCounter++;
   
-  Serial.print("\n\n=== DOWNLINK #");
+  Serial.print("\n=== DOWNLINK #");
   Serial.print(downlinkCounter);
-  Serial.println(" RECEIVED ===");
-  Serial.print("Port: ");
-  Serial.print(port);
+  Serial.print(" RECEIVED === Port: ");
+  Serial.print(command.port);
   Serial.print(", Size: ");
-  Serial.println(size);
-  
-  if (size <= MAX_JSON_SIZE) {
-    Serial.println("DEBUG: Size check passed");
-    
-    // Visual indication of downlink reception
-    digitalWrite(LED_PIN, HIGH);
-    delay(50);
-    digitalWrite(LED_PIN, LOW);
-    
-    // Print detailed hex dump of all received bytes for debugging
-    Serial.println("Raw bytes (hex):");
-    for (size_t i = 0; i < size; i++) {
-      if (i % 16 == 0) {
-        if (i > 0) Serial.println();
-        Serial.print(i, HEX);
-        Serial.print(": ");
-      }
-      
-      if (payload[i] < 16) Serial.print("0");
-      Serial.print(payload[i], HEX);
-      Serial.print(" ");
-    }
-    Serial.println();
-    
-    // First analyze the data type based on the raw bytes
-    Serial.println("DEBUG: Analyzing payload type");
-    bool isProbablyBinary = false;
-    bool isProbablyText = true;
-    
-    // Check if payload contains any non-printable, non-whitespace characters
-    for (size_t i = 0; i < size; i++) {
-      if (payload[i] < 32 && payload[i] != '\t' && payload[i] != '\r' && payload[i] != '\n') {
-        // Non-printable character found (except control chars)
-        if (payload[i] != 0) { // Null bytes might be padding
-          isProbablyText = false;
-          isProbablyBinary = true;
-          Serial.print("Non-printable char at position ");
-          Serial.print(i);
-          Serial.print(": 0x");
-          Serial.println(payload[i], HEX);
-        }
-      }
+  Serial.print(command.length);
+  Serial.print(", Queued: ");
+  Serial.print(millis() - command.receivedMs);
+  Serial.println("ms");
+#if DOWNLINK_DEBUG
+  debugBytes("RAW DOWNLINK PAYLOAD", command.payload, command.length);
+#endif
+  
+  // Ports without a route of their own carry JSON, as before port routing
+  const PortRoute* route = portRegistry.find(command.port);
+  if (route == NULL) {
+    route = portRegistry.find(JSON_COMMAND_PORT);
+  }
+  
+  // Commands that confirm with their own LED pattern keep it
+  commandReceivedMs = command.receivedMs;
+  bool success = route->handler(command.payload, command.length);
+  commandReport.recordDownlink(success);
+  if (success) {
+    Serial.println("Successfully processed downlink");
+    if (ledBlinksPending == 0) {
+      requestLedBlinks(2, 200);
     }
-    
-    Serial.print("DEBUG: Payload appears to be ");
-    if (isProbablyBinary) {
-      Serial.println("BINARY data");
+  } else {
+    Serial.println("Failed to process downlink");
+    requestLedBlinks(5, 100);
+  }
+}
+
+/**
+ * Synchronise the show clock to network time queued by loop()
+ * 
+ * @param command The NETWORK_TIME_PORT queue entry
+ */
+void applyNetworkTime(QueuedCommand& command) {
+  NetworkTime time;
+  memcpy(&time, command.payload, sizeof(time));
+  showClock.sync((uint64_t)time.unixSeconds * 1000ULL + time.milliseconds, command.receivedMs);
+  dailyResyncPending = true;
+  
+  Serial.print("Show clock synchronised to network time ");
+  Serial.println(time.unixSeconds);
+}
+
+/**
+ * Apply every queued downlink
+ * Called from the DMX task at the start of every frame
+ */
+void drainCommandQueue() {
+  QueuedCommand* command;
+  while ((command = commandQueue.peek()) != NULL) {
+    if (command->port == NETWORK_TIME_PORT) {
+      applyNetworkTime(*command);
     } else {
-      Serial.println("TEXT data");
+      applyQueuedCommand(*command);
     }
-    
-    // Create a string from the payload (even if binary, for backup processing)
-    String payloadStr = "";
-    Serial.println("DEBUG: Creating payload string");
-    for (size_t i = 0; i < size; i++) {
-      payloadStr += (char)payload[i];
+    commandQueue.pop();
+  }
+}
+
+/**
+ * Execute all scheduled commands whose time has come
+ * Called from the DMX task at the start of every frame, so commands
+ * fire with frame accuracy regardless of downlink delivery time
+ */
+void runDueScheduledCommands() {
+  static ScheduledCommand due;
+  
+  while (true) {
+    // Pop under the mutex, execute without it (commands take it themselves)
+    bool haveCommand = false;
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      haveCommand = commandScheduler.popDue(millis(), due);
+      xSemaphoreGive(dmxMutex);
     }
     
-    // Debug: Log the received data as text
-    Serial.println("\n----- DOWNLINK PAYLOAD CONTENTS -----");
-    Serial.println(payloadStr);
-    Serial.println("-------------------------------------");
-    
-    // First, check for the exact example JSON from README
-    if (size == 1) {
-      // Single byte command
-      Serial.print("Single-byte command detected: ");
-      Serial.println(payload[0]);
-      
-      if (payload[0] == 0x02 || payload[0] == '2') {
-        Serial.println("SPECIAL HANDLING: Setting all fixtures to GREEN");
-        if (dmxInitialized && dmx != NULL) {
-          for (int i = 0; i < dmx->getNumFixtures(); i++) {
-            dmx->setFixtureColor(i, 0, 255, 0, 0);
-          }
-          dmx->sendData();
-          dmx->saveSettings();
-          Serial.println("All fixtures set to GREEN");
-          return; // Command was processed
-        }
-      }
-    } else if (payloadStr.indexOf("\"lights\"") > 0) {
-      // This looks like our target JSON format
-      Serial.println("DETECTED LIGHTS JSON COMMAND");
-      
-      // Parse and process it
-      bool success = false;
-      try {
-        StaticJsonDocument<MAX_JSON_SIZE> doc;
-        DeserializationError error = deserializeJson(doc, payloadStr);
-        
-        if (!error) {
-          Serial.println("JSON parsed successfully");
-          if (doc.containsKey("lights")) {
-            JsonArray lights = doc["lights"];
-            Serial.print("Found ");
-            Serial.print(lights.size());
-            Serial.println(" lights in the payload");
-            
-            if (dmxInitialized && dmx != NULL) {
-              // Process the lights array
-              for (JsonObject light : lights) {
-                if (light.containsKey("address") && light.containsKey("channels")) {
-                  int address = light["address"];
-                  JsonArray channels = light["channels"];
-                  
-                  Serial.print("Setting fixture at address ");
-                  Serial.print(address);
-                  Serial.print(" with values: ");
-                  
-                  if (address > 0 && address <= dmx->getNumFixtures() && channels.size() >= 3) {
-                    // Get the RGBW values (W optional)
-                    int r = channels[0];
-                    int g = channels[1];
-                    int b = channels[2];
-                    int w = (channels.size() >= 4) ? channels[3] : 0;
-                    
-                    Serial.print("R=");
-                    Serial.print(r);
-                    Serial.print(", G=");
-                    Serial.print(g);
-                    Serial.print(", B=");
-                    Serial.print(b);
-                    if (channels.size() >= 4) {
-                      Serial.print(", W=");
-                      Serial.print(w);
-                    }
-                    Serial.println();
-                    
-                    // Set the fixture color directly
-                    dmx->setFixtureColor(address-1, r, g, b, w);
-                    success = true;
-                  }
-                }
-              }
-              
-              if (success) {
-                // Send the data to the fixtures and save the settings
-                dmx->sendData();
-                dmx->saveSettings();
-                Serial.println("DIRECT PROCESSING: DMX data sent and saved");
-                
-                // Blink LED to indicate success
-                DmxController::blinkLED(LED_PIN, 2, 200);
-                
-                // Exit early - we've handled it directly
-                return;
-              }
-            } else {
-              Serial.println("DMX not initialized, cannot process command");
-            }
-          }
-        } else {
-          Serial.print("JSON parse error: ");
-          Serial.println(error.c_str());
-        }
-      } catch (const std::exception& e) {
-        Serial.print("EXCEPTION in payload analysis: ");
-        Serial.println(e.what());
-      } catch (...) {
-        Serial.println("UNKNOWN EXCEPTION in payload analysis");
-      }
+    if (!haveCommand) {
+      break;
     }
     
-    // If we got here, the direct processing didn't succeed
-    // Try the regular JSON processing path
-    if (isProbablyText || size <= 4) {
-      // Break down analysis to track potential crash points
-      Serial.println("DEBUG: Starting regular payload analysis");
-      
-      // Check for JSON format if not a numeric command
-      Serial.println("DEBUG: Checking JSON format");
-      if (payloadStr.indexOf("{") == 0 && payloadStr.indexOf("}") == payloadStr.length() - 1) {
-        Serial.println("DETECTED JSON COMMAND");
-        
-        Serial.println("DEBUG: Attempting to parse JSON");
-        // Parse JSON to display its contents more clearly
-        StaticJsonDocument<MAX_JSON_SIZE> doc;
-        DeserializationError error = deserializeJson(doc, payloadStr);
-        
-        if (!error) {
-          Serial.println("DEBUG: JSON parsed successfully");
-          // Determine command type and details
-          if (doc.containsKey("test")) {
-            Serial.println("COMMAND TYPE: Test Pattern");
-            String pattern = doc["test"]["pattern"];
-            Serial.print("PATTERN: ");
-            Serial.println(pattern);
-            
-            // Output other test parameters if present
-            if (pattern == "rainbow") {
-              int cycles = doc["test"]["cycles"] | 3;
-              int speed = doc["test"]["speed"] | 50;
-              bool staggered = doc["test"]["staggered"] | true;
-              Serial.print("PARAMETERS: Cycles=");
-              Serial.print(cycles);
-              Serial.print(", Speed=");
-              Serial.print(speed);
-              Serial.print(", Staggered=");
-              Serial.println(staggered ? "Yes" : "No");
-            }
-            else if (pattern == "strobe") {
-              int color = doc["test"]["color"] | 0;
-              int count = doc["test"]["count"] | 20;
-              Serial.print("PARAMETERS: Color=");
-              Serial.print(color);
-              Serial.print(", Count=");
-              Serial.println(count);
-            }
-            else if (pattern == "continuous") {
-              bool enabled = doc["test"]["enabled"] | false;
-              int speed = doc["test"]["speed"] | 30;
-              Serial.print("PARAMETERS: Enabled=");
-              Serial.print(enabled ? "Yes" : "No");
-              Serial.print(", Speed=");
-              Serial.println(speed);
-            }
-            else if (pattern == "ping") {
-              Serial.println("PARAMETERS: None (Simple Ping)");
-            }
-          }
-          else if (doc.containsKey("lights")) {
-            Serial.println("COMMAND TYPE: Direct Light Control");
-            JsonArray lights = doc["lights"];
-            Serial.print("CONTROLLING ");
-            Serial.print(lights.size());
-            Serial.println(" FIXTURES:");
-            
-            // Output details for each fixture
-            int lightIndex = 0;
-            for (JsonObject light : lights) {
-              int address = light["address"];
-              Serial.print("  FIXTURE #");
-              Serial.print(++lightIndex);
-              Serial.print(": Address=");
-              Serial.print(address);
-              
-              JsonArray channels = light["channels"];
-              Serial.print(", Channels=[");
-              for (size_t i = 0; i < channels.size(); i++) {
-                if (i > 0) Serial.print(",");
-                Serial.print(channels[i].as<int>());
-              }
-              Serial.println("]");
-              
-              // If this looks like RGBW fixture, provide color interpretation
-              if (channels.size() >= 3) {
-                int r = channels[0];
-                int g = channels[1];
-                int b = channels[2];
-                int w = (channels.size() >= 4) ? channels[3] : 0;
-                
-                Serial.print("    COLOR: R=");
-                Serial.print(r);
-                Serial.print(", G=");
-                Serial.print(g);
-                Serial.print(", B=");
-                Serial.print(b);
-                if (channels.size() >= 4) {
-                  Serial.print(", W=");
-                  Serial.print(w);
-                }
-                Serial.println();
-              }
-            }
-          }
-          else {
-            Serial.println("COMMAND TYPE: Unknown JSON structure");
-          }
-        }
-        else {
-          Serial.print("JSON PARSING ERROR: ");
-          Serial.println(error.c_str());
-        }
-      }
-      
-      // Always process the command directly in the callback
-      Serial.println("DEBUG: Processing command through standard path");
-      if (dmxInitialized) {
-        Serial.println("Processing downlink command immediately");
-        
-        try {
-          // Process the JSON payload
-          bool success = processJsonPayload(payloadStr);
-          
-          if (success) {
-            Serial.println("Successfully processed downlink");
-            // Blink LED to indicate successful processing
-            DmxController::blinkLED(LED_PIN, 2, 200);
-            
-            // Send a confirmation uplink if this is a ping
-            if (payloadStr.indexOf("\"ping\"") > 0) {
-              Serial.println("Sending ping response");
-              // Send a ping response confirmation uplink
-              if (loraInitialized && lora != NULL) {
-                String response = "{\"ping_response\":\"ok\",\"counter\":" + String(downlinkCounter) + "}";
-                if (lora->sendString(response, 1, true)) {
-                  Serial.println("Ping response sent (confirmed)");
-                }
-              }
-            }
-          } else {
-            Serial.println("Failed to process downlink");
-            // Blink LED rapidly to indicate error
-            DmxController::blinkLED(LED_PIN, 5, 100);
-          }
-        } catch (const std::exception& e) {
-          Serial.print("EXCEPTION in command processing: ");
-          Serial.println(e.what());
-        } catch (...) {
-          Serial.println("UNKNOWN EXCEPTION in command processing");
-        }
-      } else {
-        Serial.println("ERROR: DMX not initialized, cannot process command");
-      }
-    }
+    Serial.print("Executing scheduled command (late by ");
+    Serial.print((int32_t)(millis() - due.executeAt));
+    Serial.println("ms)");
     
-    // For backward compatibility, also store in buffer
-    memcpy(receivedData, payload, size);
-    receivedDataSize = size;
-    receivedPort = port;
-    dataReceived = false;
-  } else {
-    Serial.println("ERROR: Received payload exceeds buffer size");
+    commandReceivedMs = millis();
+    processJsonPayload((char*)due.payload, due.length, false);
+  }
+}
+
+/**
+ * Execute a daily schedule entry
+ */
+void runDailyEntry(const DailyEntry* entry) {
+  // Parsing rewrites the buffer in place, so work on a copy
+  char cmdBuffer[DAILY_MAX_PAYLOAD];
+  memcpy(cmdBuffer, entry->payload, entry->length);
+  commandReceivedMs = millis();
+  processJsonPayload(cmdBuffer, entry->length, false);
+}
+
+/**
+ * Run daily schedule events that are due
+ * 
+ * After a clock sync or schedule change the most recent event that
+ * already passed today is replayed, so the lights reach the state the
+ * schedule expects even after a reboot or a long outage
+ */
+void runDailySchedule() {
+  if (!showClock.isSynced() || dailySchedule.size() == 0) {
+    return;
   }
   
-  // Debug current memory state
-  Serial.print("Free heap after downlink: ");
-  Serial.println(ESP.getFreeHeap());
+  uint32_t unixSeconds = (uint32_t)(showClock.toUnixMs(millis()) / 1000);
+  
+  if (dailyResyncPending) {
+    dailyResyncPending = false;
+    const DailyEntry* catchUp = dailySchedule.resync(unixSeconds);
+    
+    Serial.print("Daily schedule resolved, sunrise ");
+    Serial.print(dailySchedule.getSunrise());
+    Serial.print(" sunset ");
+    Serial.print(dailySchedule.getSunset());
+    Serial.print(" next event ");
+    Serial.println(dailySchedule.getNextEventMinute());
+    
+    if (catchUp != NULL) {
+      Serial.println("Catching up on last daily event");
+      runDailyEntry(catchUp);
+    }
+    return;
+  }
   
-  Serial.println("==== DEBUG: EXITING DOWNLINK CALLBACK ====");
+  const DailyEntry* entry;
+  while ((entry = dailySchedule.popDue(unixSeconds)) != NULL) {
+    Serial.println("Executing daily event");
+    runDailyEntry(entry);
+  }
 }
 
 /**
- * Handle incoming downlink data from LoRaWAN
+ * Send an unconfirmed JSON uplink on port 1
  * 
- * @param payload The payload data
- * @param size The size of the payload
- * @param port The port on which the data was received
+ * @param fields The object members, without the braces
+ * @return true if the uplink was sent
+ */
+bool sendJsonUplink(const String& fields) {
+  return lora->sendString("{" + fields + "}", 1, false);
+}
+
+/**
+ * Send the status report: command results and device state, unconfirmed
+ * on the binary port. Doubles as the heartbeat
  */
-void handleDownlink(uint8_t* payload, size_t size, uint8_t port) {
-  Serial.print("Received downlink on port ");
-  Serial.print(port);
-  Serial.print(", size: ");
-  Serial.println(size);
+void sendStatusReport() {
+  uint8_t flags = 0;
+  if (dmxInitialized) flags |= REPORT_DMX_OK;
+  if (showClock.isSynced()) flags |= REPORT_CLOCK_SYNCED;
+  if (fragmentTransfer.isActive() && !fragmentTransfer.isComplete()) flags |= REPORT_TRANSFER_ACTIVE;
   
-  // Convert payload to string
-  String payloadStr = "";
-  for (size_t i = 0; i < size; i++) {
-    payloadStr += (char)payload[i];
+  uint8_t report[REPORT_SIZE];
+  size_t length = commandReport.build(report, flags);
+  if (lora->sendData(report, length, BINARY_PROTOCOL_PORT, false)) {
+    Serial.println("Status report sent");
+  } else {
+    Serial.println("Failed to send status report");
+    commandReport.sendFailed();
+  }
+}
+
+/**
+ * Copy the frame just sent and the running effect into RTC memory
+ * Called by the DMX task with the mutex held
+ */
+void retainLiveState() {
+  RetainedEffect effect;
+  memset(&effect, 0, sizeof(effect));
+  effect.version = RETAINED_EFFECT_VERSION;
+  patternHandler.exportRetained(effect);
+  if (runningRainbowDemo) {
+    effect.rainbow = 1 | (rainbowStaggered ? 2 : 0);
+    effect.rainbowStep = rainbowStepCounter;
+    effect.rainbowStepsLeft = rainbowStepsLeft;
+    effect.rainbowStepDelay = rainbowStepDelay;
+  }
+  retainedFrame.update(dmx->getDmxData() + 1, &effect, sizeof(effect));
+}
+
+/**
+ * Carry on with the effect that was running before a warm reset
+ */
+void resumeRetainedEffect(const RetainedEffect& effect) {
+  if (effect.version != RETAINED_EFFECT_VERSION) {
+    return;
+  }
+  patternHandler.resumeRetained(effect);
+  if (effect.rainbow & 1) {
+    rainbowStaggered = (effect.rainbow & 2) != 0;
+    rainbowStepCounter = effect.rainbowStep;
+    rainbowStepsLeft = effect.rainbowStepsLeft;
+    rainbowStepDelay = max(effect.rainbowStepDelay, (int32_t)5);
+    runningRainbowDemo = true;
+    Serial.println("Rainbow demo resumed");
+  }
+}
+
+/**
+ * Advance the rainbow demo by one step when its delay has passed
+ * Called by the DMX task with dmxMutex held
+ */
+void stepRainbowDemo(uint32_t now) {
+  if (now - lastRainbowStep < (uint32_t)rainbowStepDelay) {
+    return;
   }
+  lastRainbowStep = (now - lastRainbowStep < 2 * (uint32_t)rainbowStepDelay)
+                    ? lastRainbowStep + rainbowStepDelay : now;
   
-  // Process the payload as JSON
-  if (dmxInitialized) {
-    bool success = processJsonPayload(payloadStr);
-    if (success) {
-      // Blink LED to indicate successful processing
-      DmxController::blinkLED(LED_PIN, 2, 200);
-    } else {
-      // Blink LED rapidly to indicate error
-      DmxController::blinkLED(LED_PIN, 5, 100);
+  // One hue period is 256 steps; pre-render it once and replay it
+  int numFixtures = dmx->getNumFixtures();
+  uint32_t key = frameCacheKey(0xFF, numFixtures, rainbowStaggered);
+  if (!frameCache.isValid(key) && frameCache.begin(key, 256, numFixtures)) {
+    for (int frame = 0; frame < 256; frame++) {
+      dmx->renderRainbowStep(frame, rainbowStaggered, frameCache.editFrame(frame));
     }
+    frameCache.commit();
+  }
+  
+  // Generate rainbow colors
+  if (frameCache.isValid(key)) {
+    dmx->setFixtureColors(frameCache.getFrame(rainbowStepCounter++), numFixtures);
   } else {
-    Serial.println("DMX not initialized, cannot process payload");
-    // Blink LED rapidly to indicate error
-    DmxController::blinkLED(LED_PIN, 5, 100);
+    dmx->updateRainbowStep(rainbowStepCounter++, rainbowStaggered);
+  }
+  
+  // A rainbow test ends blacked out, like DmxController::runRainbowChase
+  if (rainbowStepsLeft > 0 && --rainbowStepsLeft == 0) {
+    runningRainbowDemo = false;
+    dmx->clearAllChannels();
+    requestSettingsSave();
+    Serial.println("Rainbow chase test pattern complete!");
+  }
+}
+
+/**
+ * Advance the strobe test by one on or off phase when its time has passed
+ * Called by the DMX task with dmxMutex held
+ */
+void stepStrobeTest(uint32_t now) {
+  if (now - strobeTest.lastChange < (strobeTest.on ? strobeTest.onTime : strobeTest.offTime)) {
+    return;
+  }
+  strobeTest.lastChange = now;
+  if (!strobeTest.on) {
+    strobeTest.flash++;
+  }
+  strobeTest.on = !strobeTest.on && strobeTest.flash < strobeTest.count;
+  dmx->setStrobeFlash(strobeTest.color, strobeTest.flash, strobeTest.on, strobeTest.alternate);
+  
+  if (strobeTest.flash >= strobeTest.count) {
+    strobeTest.active = false;
+    requestSettingsSave();
+    Serial.println("Strobe test pattern complete!");
   }
 }
 
@@ -1458,12 +3200,49 @@ void dmxTask(void * parameter) {
   xLastWakeTime = xTaskGetTickCount();
   
   while(true) {
+    // Apply downlinks received since the last frame, then any scheduled
+    // and daily commands that are due on this frame. Every command runs
+    // here, so the effects below never see a half-applied change
+    if (dmxInitialized && dmx != NULL) {
+      drainCommandQueue();
+      runDueScheduledCommands();
+      runDailySchedule();
+      runFragmentReplay();
+    }
+    
     // Check if DMX is initialized
     if (dmxInitialized && dmx != NULL) {
       // Take mutex to ensure thread-safe access to DMX data
       if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+        uint32_t now = millis();
+        tempoClock.advance(now);
+        showClock.advance(now);
+        
+        // Step the running effect; patterns and the rainbow demo share the
+        // frame cache that pattern commands rebuild
+        if (patternHandler.isActive()) {
+          patternHandler.update();
+        }
+        if (runningRainbowDemo) {
+          stepRainbowDemo(now);
+        }
+        if (strobeTest.active) {
+          stepStrobeTest(now);
+        }
+        
+        // Evaluate the modulation matrix once per frame
+        if (modMatrix.isActive()) {
+          modMatrix.evaluate(now, tempoClock.getPosition(now));
+          if (modMatrix.hasIntensityRoutes()) {
+            for (int i = 0; i < dmx->getNumFixtures(); i++) {
+              dmx->setFixtureIntensity(i, modMatrix.getIntensity(i));
+            }
+          }
+        }
+        
         // Send DMX data - this function now runs uninterrupted by LoRa even during RX windows
         dmx->sendData();
+        retainLiveState();
         
         // Give mutex back
         xSemaphoreGive(dmxMutex);
@@ -1476,18 +3255,87 @@ void dmxTask(void * parameter) {
   }
 }
 
+/**
+ * Record the end of a boot phase
+ */
+void markBootPhase(BootPhase phase) {
+  bootPhaseMs[phase] = millis();
+}
+
+/**
+ * Print the time each boot phase took, up to and including the given phase
+ */
+void printBootTiming(BootPhase last) {
+  Serial.println("Boot timing (ms since reset, phase duration):");
+  uint32_t previous = 0;
+  for (int phase = 0; phase <= last; phase++) {
+    Serial.printf("  %-14s %6u %6u\n", bootPhaseNames[phase], bootPhaseMs[phase], bootPhaseMs[phase] - previous);
+    previous = bootPhaseMs[phase];
+  }
+}
+
+/**
+ * LoRa Join Task - Runs on Core 1 next to loop()
+ * Brings up the radio and joins the network, which can take minutes of
+ * backoff, while the lights are already showing the restored look. loop()
+ * only touches the radio once loraInitialized is set here, so the radio is
+ * never used from two tasks at once
+ */
+void loraJoinTask(void * parameter) {
+  Serial.println("\nInitializing LoRaWAN...");
+  
+  LoRaManager* manager = new LoRaManager(US915, 2); // US915 band, subband 2
+  
+  // Set callback for handling downlinks
+  manager->setDownlinkCallback(handleDownlinkCallback);
+  
+  // Initialize LoRaWAN with the provided credentials
+  if (manager->begin(LORA_CS_PIN, LORA_DIO1_PIN, LORA_RESET_PIN, LORA_BUSY_PIN)) {
+    Serial.println("LoRaWAN initialized successfully!");
+    markBootPhase(BOOT_RADIO);
+    
+    // Set the credentials
+    manager->setCredentials(joinEUI, devEUI, appKey, nwkKey);
+    
+    // Join the network
+    Serial.println("Attempting to join the LoRaWAN network...");
+    if (manager->joinNetwork()) {
+      Serial.println("Successfully joined the network!");
+      requestLedBlinks(3, 200);
+    } else {
+      Serial.println("Failed to join network, will continue attempts in background");
+      requestLedBlinks(4, 200);
+    }
+    markBootPhase(BOOT_JOINED);
+    printBootTiming(BOOT_JOINED);
+    
+    // Hand the radio over to loop(), which sends the online uplink
+    lora = manager;
+    onlineStatusPending = true;
+    loraInitialized = true;
+  } else {
+    Serial.println("Failed to initialize LoRaWAN!");
+    requestLedBlinks(5, 100);
+    delete manager;
+  }
+  
+  loraJoinTaskHandle = NULL;
+  vTaskDelete(NULL);
+}
+
 void setup() {
-  // Initialize Serial at defined baud rate
+  // Initialize Serial at defined baud rate; no waiting for a console, the
+  // lights come first
   Serial.begin(SERIAL_BAUD);
-  delay(500);
   Serial.println("\n\n=== DMX LoRa Controller Starting ===");
   Serial.println("Version: 1.0.0");
+  markBootPhase(BOOT_SERIAL);
   
   // Configure the diagnostic LED as an output
   pinMode(LED_PIN, OUTPUT);
   
-  // Blink the LED twice to indicate startup
-  DmxController::blinkLED(LED_PIN, 2, 500);
+  // Index the command tables before the DMX task or a downlink can use them
+  buildCommandRegistries();
   
   // Create mutex for DMX thread safety
   dmxMutex = xSemaphoreCreateMutex();
@@ -1504,93 +3352,52 @@ void setup() {
   Serial.println("Enabling continuous DMX during LoRa RX windows");
   keepDmxDuringRx = true;
   
-  // Initialize LoRaWAN
-  Serial.println("\nInitializing LoRaWAN...");
-  
-  try {
-    lora = new LoRaManager(US915, 2); // US915 band, subband 2
-    
-    // Set callback for handling downlinks
-    lora->setDownlinkCallback(handleDownlinkCallback);
-    
-    // Initialize LoRaWAN with the provided credentials
-    if (lora->begin(LORA_CS_PIN, LORA_DIO1_PIN, LORA_RESET_PIN, LORA_BUSY_PIN)) {
-      loraInitialized = true;
-      Serial.println("LoRaWAN initialized successfully!");
-      
-      // Set the credentials
-      lora->setCredentials(joinEUI, devEUI, appKey, nwkKey);
-      
-      // Join the network
-      Serial.println("Attempting to join the LoRaWAN network...");
-      if (lora->joinNetwork()) {
-        Serial.println("Successfully joined the network!");
-      } else {
-        Serial.println("Failed to join network, will continue attempts in background");
-      }
-    } else {
-      Serial.println("Failed to initialize LoRaWAN!");
-      loraInitialized = false;
-    }
-  } catch (...) {
-    Serial.println("ERROR: Exception during LoRaWAN initialization!");
-    lora = NULL;
-    loraInitialized = false;
-    DmxController::blinkLED(LED_PIN, 5, 100);  // Error indicator
-  }
-  
   // Initialize DMX
   Serial.println("\nInitializing DMX controller...");
   
-  try {
-    dmx = new DmxController(DMX_PORT, DMX_TX_PIN, DMX_RX_PIN, DMX_DIR_PIN);
-    Serial.println("DMX controller object created");
-    
-    // Initialize DMX
-    dmx->begin();
-    dmxInitialized = true;
-    Serial.println("DMX controller initialized successfully!");
-    
-    // Set initial values to zero and send to make sure fixtures are clear
-    dmx->clearAllChannels();
-    dmx->sendData();
-    Serial.println("DMX channels cleared");
-
-    // Setup test fixtures
-    Serial.println("Setting up default test fixtures for testing");
-    // Initialize 4 test fixtures with 4 channels each (RGBW)
-    dmx->initializeFixtures(4, 4);
-    
-    // Configure fixtures with sequential DMX addresses
-    dmx->setFixtureConfig(0, "Fixture 1", 1, 1, 2, 3, 4);
-    dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
-    dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
-    dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
-    
-    // Print fixture configurations for verification
-    dmx->printFixtureValues();
-    
-    // Set all fixtures to WHITE on device reset
-    Serial.println("\n=== SETTING ALL FIXTURES TO WHITE ON STARTUP ===");
-    for (int i = 0; i < dmx->getNumFixtures(); i++) {
-      dmx->setFixtureColor(i, 0, 0, 0, 255); // White color (R=0, G=0, B=0, W=255)
+  dmx = new DmxController(DMX_PORT, DMX_TX_PIN, DMX_RX_PIN, DMX_DIR_PIN);
+  dmx->begin();
+  dmx->clearAllChannels();
+  
+  // Default patch: 4 test fixtures with 4 channels each (RGBW), replaced
+  // by the saved patch if there is one
+  dmx->initializeFixtures(4, 4);
+  dmx->setFixtureConfig(0, "Fixture 1", 1, 1, 2, 3, 4);
+  dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
+  dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
+  dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+  dmxInitialized = true;
+  markBootPhase(BOOT_DMX_DRIVER);
+  
+  // Restore the last look. Nothing has been sent yet, so the fixtures go
+  // straight to it without a black or white frame in between. After a warm
+  // reset the frame that was being output is still in RTC memory and goes
+  // out before anything is read from flash
+  RetainedEffect retainedEffect;
+  bool warmRestore = retainedFrame.begin();
+  Serial.print("Reset reason: ");
+  Serial.println(RetainedFrame::resetReasonName(retainedFrame.getResetReason()));
+  if (!stateJournal.begin()) {
+    Serial.println("No journal partition, keeping the state in NVS");
+  }
+  if (warmRestore) {
+    memcpy(dmx->getDmxData() + 1, retainedFrame.getFrame(), RETAINED_FRAME_SIZE);
+    if (retainedFrame.getEffect(&retainedEffect, sizeof(retainedEffect)) != sizeof(retainedEffect)) {
+      retainedEffect.version = 0;
     }
-    dmx->sendData();
-    dmx->saveSettings();
-    Serial.println("All fixtures set to white");
-    
-  } catch (...) {
-    Serial.println("ERROR: Exception during DMX initialization!");
-    dmx = NULL;
-    dmxInitialized = false;
-    DmxController::blinkLED(LED_PIN, 5, 100);  // Error indicator
+    Serial.println("Warm reset: resuming the retained frame");
+  } else if (loadState(true)) {
+    Serial.println("Saved state loaded");
+    spatialMap.build(dmx->getAllFixtures(), min(dmx->getNumFixtures(), MAX_FIXTURES));
+  } else {
+    Serial.println("No saved state found, using defaults");
+    dmx->setDefaultWhite();
+    spatialMap.build(dmx->getAllFixtures(), min(dmx->getNumFixtures(), MAX_FIXTURES));
   }
+  markBootPhase(BOOT_LOOK_RESTORED);
   
-  Serial.println("\nSetup complete!");
-  Serial.print("Free heap after setup: ");
-  Serial.println(ESP.getFreeHeap());
-  
-  // Start DMX Task on Core 0 to handle continuous DMX output
+  // First frame now, then the DMX Task on Core 0 keeps it refreshed
+  dmx->sendData();
   xTaskCreatePinnedToCore(
       dmxTask,           // Task function
       "DMX Task",        // Task name
@@ -1599,38 +3406,66 @@ void setup() {
       1,                 // Priority (1-configMAX_PRIORITIES)
       &dmxTaskHandle,    // Task handle
       0);                // Run on Core 0 (LoRa runs on Core 1)
+  markBootPhase(BOOT_OUTPUT_LIVE);
   
-  // Report which core this setup function is running on
-  Serial.print("Main setup running on core: ");
-  Serial.println(xPortGetCoreID());
-  
-  // Send an uplink message to confirm device is online
-  if (loraInitialized) {
-    // Add delay before first transmission to ensure network is ready
-    Serial.println("Preparing to send first uplink...");
-    delay(2000);  // 2 second delay before first uplink
-    
-    String message = "{\"status\":\"online\",\"dmx\":" + String(dmxInitialized ? "true" : "false") + "}";
-    if (lora->sendString(message, 1, true)) { // Changed to confirmed uplink
-      Serial.println("Status uplink sent successfully (confirmed)");
-    } else {
-      Serial.println("Failed to send status uplink");
+  // The retained frame is already out; patch and palette still come from
+  // flash, then the effect carries on from its retained phase
+  if (warmRestore) {
+    if (loadState(false)) {
+      Serial.println("Saved patch and palette loaded");
     }
+    // The DMX task is already stepping effects
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      spatialMap.build(dmx->getAllFixtures(), min(dmx->getNumFixtures(), MAX_FIXTURES));
+      resumeRetainedEffect(retainedEffect);
+      xSemaphoreGive(dmxMutex);
+    }
+    
+    // Flash may be behind the retained frame: changes still waiting for
+    // the persist task were lost with the reset
+    requestSettingsSave();
   }
   
-  // If DMX is initialized, set up fixtures but don't run automatic demos
-  if (dmxInitialized) {
-    // Load any saved settings from persistent storage
-    Serial.println("Loading DMX settings from persistent storage...");
-    if (dmx->loadSettings()) {
-      Serial.println("DMX settings loaded successfully");
-    } else {
-      Serial.println("No saved DMX settings found, using defaults");
-    }
+  // Start the persist task at idle priority, alongside loop() on core 1
+  persistService.setTarget(PERSIST_STATE, "state", persistState);
+  persistService.setTarget(PERSIST_DAILY, "daily schedule", []() { return dailySchedule.save(); });
+  persistService.setTarget(PERSIST_SCENES, "scenes", persistScenes);
+  if (!persistService.begin()) {
+    Serial.println("ERROR: Could not start the persist task");
+  }
+  
+  // Restore the daily schedule; it runs once the clock has been synchronised
+  if (dailySchedule.load()) {
+    Serial.print("Daily schedule loaded with ");
+    Serial.print(dailySchedule.size());
+    Serial.println(" entries");
+  }
+  
+  // Map the scene library; recalls read it straight from flash
+  if (!sceneStore.begin()) {
+    Serial.println("No scenes partition, scenes are not available");
+  }
+  markBootPhase(BOOT_SERVICES);
+  
+  // Fragmented transfers write flash from their own task
+  fragmentQueue = xQueueCreate(FRAGMENT_QUEUE_DEPTH, sizeof(FragmentMessage));
+  if (fragmentQueue == NULL ||
+      xTaskCreatePinnedToCore(fragmentTask, "Fragments", 4096, NULL, tskIDLE_PRIORITY, &fragmentTaskHandle, 1) != pdPASS) {
+    Serial.println("ERROR: Could not start the fragment worker");
+  }
+  
+  // Join the network in the background; loop() runs meanwhile
+  if (xTaskCreatePinnedToCore(loraJoinTask, "LoRa Join", 8192, NULL, 1, &loraJoinTaskHandle, 1) != pdPASS) {
+    Serial.println("ERROR: Could not start the LoRa join task");
   }
   
-  // Final setup indicator
-  DmxController::blinkLED(LED_PIN, 3, 200);
+  Serial.println("\nSetup complete!");
+  printBootTiming(BOOT_SERVICES);
+  Serial.print("Free heap after setup: ");
+  Serial.println(ESP.getFreeHeap());
+  
+  // Device started
+  requestLedBlinks(2, 500);
 }
 
 void loop() {
@@ -1645,36 +3480,128 @@ void loop() {
     lora->handleEvents();  // Process LoRaWAN events
   }
   
-  // Send a heartbeat ping every 60 seconds
-  if (currentMillis - lastHeartbeat >= 60000) {
+  // Announce the device once the join task has handed over the radio
+  if (onlineStatusPending && loraInitialized && lora != NULL) {
+    onlineStatusPending = false;
+    
+    // Ask the network for the time along with the first uplink
+    lora->requestNetworkTime();
+    
+    String message = "{\"status\":\"online\",\"dmx\":" + String(dmxInitialized ? "true" : "false") +
+                     ",\"reset\":\"" + String(RetainedFrame::resetReasonName(retainedFrame.getResetReason())) + "\"" +
+                     ",\"boot\":{\"live\":" + String(bootPhaseMs[BOOT_OUTPUT_LIVE]) +
+                     ",\"join\":" + String(bootPhaseMs[BOOT_JOINED]) + "}}";
+    if (lora->sendString(message, 1, true)) {
+      Serial.println("Status uplink sent successfully (confirmed)");
+    } else {
+      Serial.println("Failed to send status uplink");
+    }
+    lastHeartbeat = currentMillis;
+  }
+  
+  // Send the status report every 60 seconds as the heartbeat, or sooner once
+  // command results have waited long enough for others to join them
+  bool heartbeatDue = currentMillis - lastHeartbeat >= HEARTBEAT_INTERVAL_MS;
+  // (signed: the DMX task may record a result after currentMillis was read)
+  bool reportDue = commandReport.isPending() &&
+                   (int32_t)(currentMillis - commandReport.getPendingSinceMs()) >= (int32_t)REPORT_HOLD_MS;
+  if (heartbeatDue || reportDue) {
     lastHeartbeat = currentMillis;
     
     if (loraInitialized && lora != NULL) {
-      Serial.println("Sending heartbeat ping...");
-      String message = "{\"hb\":1}";
-      lora->sendString(message, 1, true);  // Send on port 1, confirmed
+      // Keep the show clock disciplined against network time
+      if (!showClock.isSynced() || millis() - showClock.getLastSyncLocalMs() >= NETWORK_TIME_RESYNC_MS) {
+        lora->requestNetworkTime();
+      }
+      
+      // Report the minimum free stack seen by each task
+      Serial.print("Stack high-water marks: loop ");
+      Serial.print(uxTaskGetStackHighWaterMark(NULL));
+      Serial.print(" bytes, DMX task ");
+      Serial.print(dmxTaskHandle != NULL ? uxTaskGetStackHighWaterMark(dmxTaskHandle) : 0);
+      Serial.println(" bytes");
+      
+      // Report flash wear of the state journal
+      if (stateJournal.isReady()) {
+        Serial.printf("State journal: %u records, %u erases, %u erases per sector, write amplification %.2f\n",
+                      stateJournal.getRecords(), stateJournal.getErases(),
+                      stateJournal.getSectorWear(), stateJournal.getWriteAmplification());
+      }
+      
+      // Report the scene library: use of its capacity and space to reclaim
+      if (sceneStore.isReady()) {
+        SceneStats stats;
+        sceneStore.getStats(stats);
+        Serial.printf("Scenes: %u of %u, %u of %u bytes, %u bytes free, %u%% fragmented\n",
+                      stats.scenes, stats.maxScenes, stats.liveBytes, stats.capacity,
+                      stats.freeBytes, stats.fragmentation);
+      }
+      
+      sendStatusReport();
     }
   }
   
-  // Only update DMX data when changed (no periodic refresh here since it's handled by the dedicated task)
-  if (runningRainbowDemo && dmxInitialized && dmx != NULL) {
-    if (currentMillis - lastRainbowStep >= rainbowStepDelay) {
-      lastRainbowStep = currentMillis;
-      
-      // Take mutex to safely update DMX data
-      if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
-        // Generate rainbow colors
-        dmx->updateRainbowStep(rainbowStepCounter++, rainbowStaggered);
-        
-        // Give mutex back after updating DMX data
-        xSemaphoreGive(dmxMutex);
+  // Pass network time received with the last uplink to the DMX task through
+  // the command queue (loop() is its producer), like a "time" downlink
+  if (loraInitialized && lora != NULL && dmxInitialized) {
+    NetworkTime time;
+    uint32_t networkLocalMs;
+    if (lora->getNetworkTime(time.unixSeconds, time.milliseconds, networkLocalMs) &&
+        !commandQueue.push((const uint8_t*)&time, sizeof(time), NETWORK_TIME_PORT, networkLocalMs)) {
+      Serial.println("Network time dropped, command queue full; requesting it again");
+      lora->requestNetworkTime();
+    }
+  }
+  
+  // Report the fragmented transfer: progress, and the first missing fragments
+  if (fragmentStatusPending && loraInitialized && lora != NULL) {
+    fragmentStatusPending = false;
+    String fields = "\"frag\":{\"s\":" + String(fragmentTransfer.getSession()) +
+                    ",\"rx\":" + String(fragmentTransfer.getReceivedCount()) +
+                    ",\"n\":" + String(fragmentTransfer.getFragmentCount()) +
+                    ",\"fec\":" + String(fragmentTransfer.getRecoveredCount()) +
+                    ",\"done\":" + String(fragmentTransfer.isComplete() ? "true" : "false");
+    if (fragmentTransfer.isActive() && !fragmentTransfer.isComplete()) {
+      fields += ",\"missing\":[";
+      int listed = 0;
+      for (uint32_t i = 0; i < fragmentTransfer.getFragmentCount() && listed < 8; i++) {
+        if (!fragmentTransfer.hasFragment(i)) {
+          if (listed++ > 0) {
+            fields += ",";
+          }
+          fields += String(i);
+        }
       }
+      fields += "]";
     }
+    fields += "}";
+    sendJsonUplink(fields);
+  }
+  
+  // Report the scene library on request
+  if (sceneReportPending && loraInitialized && lora != NULL) {
+    sceneReportPending = false;
+    SceneStats stats;
+    sceneStore.getStats(stats);
+    sendJsonUplink("\"scenes\":{\"n\":" + String(stats.scenes) +
+                   ",\"max\":" + String(stats.maxScenes) +
+                   ",\"cap\":" + String(stats.capacity) +
+                   ",\"live\":" + String(stats.liveBytes) +
+                   ",\"dead\":" + String(stats.deadBytes) +
+                   ",\"free\":" + String(stats.freeBytes) +
+                   ",\"frag\":" + String(stats.fragmentation) + "}");
   }
   
-  // Update pattern (if active)
-  if (patternHandler.isActive()) {
-    patternHandler.update();
+  // LED confirmation of downlink commands
+  static unsigned long lastLedToggle = 0;
+  static bool ledOn = false;
+  if ((ledOn || ledBlinksPending > 0) && currentMillis - lastLedToggle >= ledBlinkMs) {
+    lastLedToggle = currentMillis;
+    ledOn = !ledOn;
+    digitalWrite(LED_PIN, ledOn ? HIGH : LOW);
+    if (!ledOn && ledBlinksPending > 0) {
+      ledBlinksPending--;
+    }
   }
   
   // Yield to allow other tasks to run
@@ -0,0 +1,142 @@
+/**
+ * command_decoder_fuzz.cpp - libFuzzer harness for CommandDecoder
+ *
+ * Feeds arbitrary payloads to the binary and text decoders with a sink
+ * that checks every command it is handed against the decoder's limits,
+ * and that a rejected payload applied nothing. Build and run on the host:
+ *
+ *   clang++ -g -O1 -fsanitize=fuzzer,address,undefined \
+ *       -Ilib/CommandDecoder -Ilib/BinaryProtocol \
+ *       test/fuzz/command_decoder_fuzz.cpp lib/CommandDecoder/CommandDecoder.cpp \
+ *       lib/BinaryProtocol/BinaryProtocol.cpp -o command_decoder_fuzz
+ *   ./command_decoder_fuzz -max_len=242
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "CommandDecoder.h"
+
+#define FUZZ_MAX_FIXTURES 32
+#define FUZZ_PALETTE_SIZE 64
+
+static void check(bool condition) {
+    if (!condition) {
+        abort();
+    }
+}
+
+/**
+ * Sink that writes into buffers sized to the limits, so an out-of-range
+ * command shows up as a failed check or a sanitizer report
+ */
+class CheckingSink : public CommandSink {
+public:
+    int applied;
+    uint8_t frame[DECODER_MAX_CHANNEL + 1];
+    uint8_t fixtures[FUZZ_MAX_FIXTURES][4];
+    uint8_t palette[FUZZ_PALETTE_SIZE][4];
+
+    bool isRepeat(uint16_t seq) override {
+        return (seq & 7) == 0;      // Some numbers are repeats
+    }
+
+    void recordSequence(uint16_t seq) override {
+        check((seq & 7) != 0);
+    }
+
+    void setAllFixtures(uint8_t, uint8_t, uint8_t, uint8_t, bool) override {
+        applied++;
+    }
+
+    bool applyJson(char* json, size_t length) override {
+        check(json != NULL && length > 1);
+        applied++;
+        return true;
+    }
+
+    void setChannels(uint16_t first, const uint8_t* values, size_t count) override {
+        check(first >= 1 && count > 0 && first + count <= DECODER_MAX_CHANNEL + 1);
+        memcpy(frame + first, values, count);
+        applied++;
+    }
+
+    void setFixtures(uint32_t first, uint32_t count, const uint8_t* colors, uint8_t stride) override {
+        check(count <= FUZZ_MAX_FIXTURES && (stride == 3 || stride == 4));
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(fixtures[i], colors + i * stride, stride);
+        }
+        (void)first;
+        applied++;
+    }
+
+    void fillFixtures(uint32_t, uint32_t, const uint8_t* rgbw) override {
+        memcpy(fixtures[0], rgbw, 4);
+        applied++;
+    }
+
+    bool isPatternType(uint8_t type) override {
+        return type <= 9;
+    }
+
+    void setPattern(uint8_t type, uint32_t, uint32_t) override {
+        check(type <= 9);
+        applied++;
+    }
+
+    void applyFrameDelta(BinaryReader runs) override {
+        check(binaryDecodeDelta(runs, frame + 1, DECODER_MAX_CHANNEL));
+        applied++;
+    }
+
+    void setPaletteEntries(uint32_t first, uint32_t count, const uint8_t* colors) override {
+        check(first <= FUZZ_PALETTE_SIZE && count <= FUZZ_PALETTE_SIZE - first);
+        memcpy(palette[first], colors, count * 4);
+        applied++;
+    }
+
+    void setFixturePalette(uint32_t, uint32_t count, const uint8_t* indices, uint8_t bits) override {
+        check(count <= FUZZ_MAX_FIXTURES && (bits == 4 || bits == 6 || bits == 8));
+        for (uint32_t i = 0; i < count; i++) {
+            fixtures[i][0] = binaryUnpackBits(indices, i, bits);
+        }
+        applied++;
+    }
+
+    void setGroupPalette(uint8_t, uint8_t) override {
+        applied++;
+    }
+
+    size_t quantizedSize(uint8_t format, uint32_t count) override {
+        return format < 2 ? count * (format + 1) : 0;
+    }
+
+    void setQuantized(uint8_t format, bool, uint32_t, uint32_t count, const uint8_t* packed) override {
+        check(format < 2 && count <= FUZZ_MAX_FIXTURES);
+        volatile uint8_t last = count > 0 ? packed[count * (format + 1) - 1] : 0;
+        (void)last;
+        applied++;
+    }
+};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static CheckingSink sink;
+    static CommandDecoder decoder(sink, FUZZ_MAX_FIXTURES, FUZZ_PALETTE_SIZE);
+
+    sink.applied = 0;
+    BinaryDecodeInfo info;
+    bool success = decoder.decodeBinary(data, size, info);
+    check(success ? info.error == NULL : info.error != NULL);
+    check(info.commands == sink.applied);
+    if (!success || info.duplicate) {
+        check(sink.applied == 0);
+    }
+
+    // The text decoder may edit the payload, so it gets a copy
+    uint8_t* text = (uint8_t*)malloc(size + 1);
+    if (text != NULL) {
+        memcpy(text, data, size);
+        decoder.decodeText(text, size);
+        free(text);
+    }
+    return 0;
+}
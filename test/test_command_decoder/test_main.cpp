@@ -0,0 +1,289 @@
+/**
+ * Unit tests for CommandDecoder: field bounds and sequence handling
+ *
+ * Run on the host with: pio test -e native
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "CommandDecoder.h"
+
+#define TEST_MAX_FIXTURES 32
+#define TEST_PALETTE_SIZE 16
+
+/**
+ * Sink that counts what the decoder passes on
+ */
+class RecordingSink : public CommandSink {
+public:
+    int applied;                    // Commands passed on
+    int sequencesAccepted;
+    uint16_t seen[8];               // Accepted sequence numbers
+    uint32_t lastFirst;
+    uint32_t lastCount;
+
+    RecordingSink() { reset(); }
+
+    void reset() {
+        applied = 0;
+        sequencesAccepted = 0;
+        lastFirst = 0;
+        lastCount = 0;
+    }
+
+    bool isRepeat(uint16_t seq) override {
+        for (int i = 0; i < sequencesAccepted && i < 8; i++) {
+            if (seen[i] == seq) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void recordSequence(uint16_t seq) override {
+        seen[sequencesAccepted++ % 8] = seq;
+    }
+
+    void setAllFixtures(uint8_t, uint8_t, uint8_t, uint8_t, bool) override { applied++; }
+    bool applyJson(char*, size_t) override { applied++; return true; }
+    void setChannels(uint16_t first, const uint8_t*, size_t count) override { record(first, count); }
+    void setFixtures(uint32_t first, uint32_t count, const uint8_t*, uint8_t) override { record(first, count); }
+    void fillFixtures(uint32_t first, uint32_t count, const uint8_t*) override { record(first, count); }
+    bool isPatternType(uint8_t type) override { return type <= 9; }
+    void setPattern(uint8_t, uint32_t, uint32_t) override { applied++; }
+    void applyFrameDelta(BinaryReader) override { applied++; }
+    void setPaletteEntries(uint32_t first, uint32_t count, const uint8_t*) override { record(first, count); }
+    void setFixturePalette(uint32_t first, uint32_t count, const uint8_t*, uint8_t) override { record(first, count); }
+    void setGroupPalette(uint8_t, uint8_t) override { applied++; }
+    size_t quantizedSize(uint8_t format, uint32_t count) override { return format == 0 ? count * 2 : 0; }
+    void setQuantized(uint8_t, bool, uint32_t first, uint32_t count, const uint8_t*) override { record(first, count); }
+
+private:
+    void record(uint32_t first, uint32_t count) {
+        applied++;
+        lastFirst = first;
+        lastCount = count;
+    }
+};
+
+static RecordingSink sink;
+static CommandDecoder decoder(sink, TEST_MAX_FIXTURES, TEST_PALETTE_SIZE);
+static uint8_t payload[1024];
+
+// Payload builder: version byte, then opcodes, varints and bytes
+static size_t length;
+
+static void begin(uint8_t version) {
+    length = 0;
+    payload[length++] = version;
+}
+
+static void byte(uint8_t value) {
+    payload[length++] = value;
+}
+
+static void varint(uint32_t value) {
+    while (value >= 0x80) {
+        payload[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    payload[length++] = value;
+}
+
+static void bytes(size_t count, uint8_t value) {
+    memset(payload + length, value, count);
+    length += count;
+}
+
+static bool decode(BinaryDecodeInfo& info) {
+    return decoder.decodeBinary(payload, length, info);
+}
+
+static void channels(uint32_t first, uint32_t count) {
+    byte(BIN_OP_CHANNELS);
+    varint(first);
+    varint(count);
+    bytes(count, 0x55);
+}
+
+void setUp() {
+    sink.reset();
+}
+
+void tearDown() {
+}
+
+void test_channel_run_within_universe() {
+    BinaryDecodeInfo info;
+    begin(BINARY_PROTOCOL_VERSION);
+    channels(1, 512);
+    channels(512, 1);
+    TEST_ASSERT_TRUE(decode(info));
+    TEST_ASSERT_EQUAL(2, info.commands);
+    TEST_ASSERT_EQUAL(512, sink.lastFirst);
+    TEST_ASSERT_EQUAL(1, sink.lastCount);
+}
+
+void test_channel_run_out_of_range() {
+    const uint32_t runs[][2] = {{0, 1}, {513, 1}, {1, 0}, {500, 14}, {1, 513}};
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        BinaryDecodeInfo info;
+        begin(BINARY_PROTOCOL_VERSION);
+        byte(BIN_OP_CHANNELS);
+        varint(runs[i][0]);
+        varint(runs[i][1]);
+        bytes(16, 0);
+        TEST_ASSERT_FALSE(decode(info));
+        TEST_ASSERT_EQUAL_STRING("Binary channel run out of range", info.error);
+        TEST_ASSERT_EQUAL(0, sink.applied);
+    }
+}
+
+void test_fixture_count_limit() {
+    BinaryDecodeInfo info;
+    begin(BINARY_PROTOCOL_VERSION);
+    byte(BIN_OP_FIXTURES_RGBW);
+    varint(0);
+    varint(TEST_MAX_FIXTURES);
+    bytes(TEST_MAX_FIXTURES * 4, 0xFF);
+    TEST_ASSERT_TRUE(decode(info));
+    TEST_ASSERT_EQUAL(TEST_MAX_FIXTURES, sink.lastCount);
+
+    sink.reset();
+    begin(BINARY_PROTOCOL_VERSION);
+    byte(BIN_OP_FIXTURES_RGB);
+    varint(0);
+    varint(TEST_MAX_FIXTURES + 1);
+    bytes((TEST_MAX_FIXTURES + 1) * 3, 0xFF);
+    TEST_ASSERT_FALSE(decode(info));
+    TEST_ASSERT_EQUAL(0, sink.applied);
+
+    // A count whose byte size wraps is rejected before any read
+    begin(BINARY_PROTOCOL_VERSION);
+    byte(BIN_OP_FIXTURES_RGBW);
+    varint(0);
+    varint(0x40000000);
+    TEST_ASSERT_FALSE(decode(info));
+    TEST_ASSERT_EQUAL(0, sink.applied);
+}
+
+void test_palette_set_bounds() {
+    BinaryDecodeInfo info;
+    begin(BINARY_PROTOCOL_VERSION);
+    byte(BIN_OP_PALETTE_SET);
+    varint(TEST_PALETTE_SIZE - 2);
+    varint(2);
+    bytes(8, 0x10);
+    TEST_ASSERT_TRUE(decode(info));
+    TEST_ASSERT_EQUAL(TEST_PALETTE_SIZE - 2, sink.lastFirst);
+
+    const uint32_t ranges[][2] = {{TEST_PALETTE_SIZE - 2, 3}, {TEST_PALETTE_SIZE + 1, 0}, {1, 0xFFFFFFFF}};
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        sink.reset();
+        begin(BINARY_PROTOCOL_VERSION);
+        byte(BIN_OP_PALETTE_SET);
+        varint(ranges[i][0]);
+        varint(ranges[i][1]);
+        bytes(16, 0x10);
+        TEST_ASSERT_FALSE(decode(info));
+        TEST_ASSERT_EQUAL(0, sink.applied);
+    }
+}
+
+void test_packed_palette_bounds() {
+    BinaryDecodeInfo info;
+    begin(BINARY_PROTOCOL_VERSION);
+    byte(BIN_OP_PALETTE_PACKED);
+    byte(4);
+    varint(0);
+    varint(TEST_MAX_FIXTURES);
+    bytes(TEST_MAX_FIXTURES / 2, 0x21);
+    TEST_ASSERT_TRUE(decode(info));
+
+    // Unsupported bits per index, too many fixtures, too few index bytes
+    const uint32_t cases[][3] = {{5, 0, 4}, {6, TEST_MAX_FIXTURES + 1, 64}, {6, 8, 5}};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        sink.reset();
+        begin(BINARY_PROTOCOL_VERSION);
+        byte(BIN_OP_PALETTE_PACKED);
+        byte(cases[i][0]);
+        varint(0);
+        varint(cases[i][1]);
+        bytes(cases[i][2], 0x21);
+        TEST_ASSERT_FALSE(decode(info));
+        TEST_ASSERT_EQUAL(0, sink.applied);
+    }
+}
+
+void test_malformed_payload_applies_nothing() {
+    // A valid command followed by a truncated one
+    BinaryDecodeInfo info;
+    begin(BINARY_PROTOCOL_VERSION);
+    channels(1, 4);
+    byte(BIN_OP_FILL);
+    varint(0);
+    varint(4);
+    bytes(2, 0);
+    TEST_ASSERT_FALSE(decode(info));
+    TEST_ASSERT_EQUAL(0, sink.applied);
+    TEST_ASSERT_EQUAL(0, info.commands);
+}
+
+void test_unknown_pattern_applies_nothing() {
+    BinaryDecodeInfo info;
+    begin(BINARY_PROTOCOL_VERSION);
+    channels(1, 4);
+    byte(BIN_OP_PATTERN);
+    byte(200);
+    varint(100);
+    varint(0);
+    TEST_ASSERT_FALSE(decode(info));
+    TEST_ASSERT_EQUAL_STRING("Unknown binary pattern type", info.error);
+    TEST_ASSERT_EQUAL(0, sink.applied);
+}
+
+void test_malformed_payload_keeps_sequence() {
+    BinaryDecodeInfo info;
+    begin(BINARY_PROTOCOL_VERSION | BINARY_FLAG_SEQUENCE);
+    varint(300);
+    channels(0, 4);
+    TEST_ASSERT_FALSE(decode(info));
+    TEST_ASSERT_TRUE(info.sequenced);
+    TEST_ASSERT_EQUAL(300, info.seq);
+    TEST_ASSERT_EQUAL(0, sink.sequencesAccepted);
+
+    // The corrected retry with the same number is applied, a repeat is not
+    begin(BINARY_PROTOCOL_VERSION | BINARY_FLAG_SEQUENCE);
+    varint(300);
+    channels(1, 4);
+    TEST_ASSERT_TRUE(decode(info));
+    TEST_ASSERT_FALSE(info.duplicate);
+    TEST_ASSERT_EQUAL(1, sink.applied);
+
+    TEST_ASSERT_TRUE(decode(info));
+    TEST_ASSERT_TRUE(info.duplicate);
+    TEST_ASSERT_EQUAL(1, sink.applied);
+}
+
+void test_truncated_sequence() {
+    BinaryDecodeInfo info;
+    begin(BINARY_PROTOCOL_VERSION | BINARY_FLAG_SEQUENCE);
+    byte(0x80);
+    TEST_ASSERT_FALSE(decode(info));
+    TEST_ASSERT_EQUAL_STRING("Truncated sequence number", info.error);
+    TEST_ASSERT_EQUAL(0, sink.sequencesAccepted);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_channel_run_within_universe);
+    RUN_TEST(test_channel_run_out_of_range);
+    RUN_TEST(test_fixture_count_limit);
+    RUN_TEST(test_palette_set_bounds);
+    RUN_TEST(test_packed_palette_bounds);
+    RUN_TEST(test_malformed_payload_applies_nothing);
+    RUN_TEST(test_unknown_pattern_applies_nothing);
+    RUN_TEST(test_malformed_payload_keeps_sequence);
+    RUN_TEST(test_truncated_sequence);
+    return UNITY_END();
+}
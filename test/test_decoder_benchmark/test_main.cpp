@@ -0,0 +1,219 @@
+/**
+ * Host benchmark of CommandDecoder: commands per second and allocations
+ *
+ * Each payload is decoded BENCH_PAYLOADS times into a sink that copies
+ * what it is given into a DMX universe, as the firmware's sink does. The
+ * throughput is printed; every operator new during decoding is counted,
+ * and any allocation fails the test, since the decoder runs in the DMX
+ * task between frames. Host figures are for comparing changes, not the
+ * ESP32's absolute rate.
+ *
+ * Run on the host with: pio test -e native
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include "CommandDecoder.h"
+
+#define BENCH_PAYLOADS 200000      // Decodes timed per payload
+#define BENCH_MAX_FIXTURES 32
+#define BENCH_PALETTE_SIZE 16
+
+// Heap allocations since start, counted by the replaced operator new
+static size_t allocations;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* block = malloc(size ? size : 1);
+    if (block == NULL) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete[](void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    free(block);
+}
+
+/**
+ * Sink that copies every command into a universe and palette
+ */
+class UniverseSink : public CommandSink {
+public:
+    uint8_t universe[DECODER_MAX_CHANNEL];
+    uint8_t palette[BENCH_PALETTE_SIZE][4];
+    uint8_t fixturePalette[BENCH_MAX_FIXTURES];
+
+    bool isRepeat(uint16_t) override { return false; }
+    void recordSequence(uint16_t) override {}
+    void setAllFixtures(uint8_t r, uint8_t g, uint8_t b, uint8_t w, bool) override {
+        const uint8_t rgbw[4] = {r, g, b, w};
+        fillFixtures(0, BENCH_MAX_FIXTURES, rgbw);
+    }
+    bool applyJson(char*, size_t) override { return true; }
+    void setChannels(uint16_t first, const uint8_t* values, size_t count) override {
+        memcpy(universe + first - 1, values, count);
+    }
+    void setFixtures(uint32_t first, uint32_t count, const uint8_t* colors, uint8_t stride) override {
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(universe + (first + i) * 4, colors + i * stride, stride);
+        }
+    }
+    void fillFixtures(uint32_t first, uint32_t count, const uint8_t* rgbw) override {
+        for (uint32_t i = first; i < first + count && i < BENCH_MAX_FIXTURES; i++) {
+            memcpy(universe + i * 4, rgbw, 4);
+        }
+    }
+    bool isPatternType(uint8_t type) override { return type <= 9; }
+    void setPattern(uint8_t, uint32_t, uint32_t) override {}
+    void applyFrameDelta(BinaryReader) override {}
+    void setPaletteEntries(uint32_t first, uint32_t count, const uint8_t* colors) override {
+        memcpy(palette[first], colors, count * 4);
+    }
+    void setFixturePalette(uint32_t first, uint32_t count, const uint8_t* indices, uint8_t bits) override {
+        if (bits == 8) {
+            memcpy(fixturePalette + first, indices, count);
+        }
+    }
+    void setGroupPalette(uint8_t, uint8_t index) override {
+        memset(fixturePalette, index, sizeof(fixturePalette));
+    }
+    size_t quantizedSize(uint8_t format, uint32_t count) override { return format == 0 ? count * 2 : 0; }
+    void setQuantized(uint8_t, bool, uint32_t, uint32_t, const uint8_t*) override {}
+};
+
+static UniverseSink sink;
+static CommandDecoder decoder(sink, BENCH_MAX_FIXTURES, BENCH_PALETTE_SIZE);
+static uint8_t payload[1024];
+
+// Payload builder: version byte, then opcodes, varints and bytes
+static size_t length;
+
+static void begin(uint8_t version) {
+    length = 0;
+    payload[length++] = version;
+}
+
+static void byte(uint8_t value) {
+    payload[length++] = value;
+}
+
+static void varint(uint32_t value) {
+    while (value >= 0x80) {
+        payload[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    payload[length++] = value;
+}
+
+static void bytes(size_t count, uint8_t value) {
+    memset(payload + length, value, count);
+    length += count;
+}
+
+/**
+ * Decode the built payload BENCH_PAYLOADS times and check the cost
+ */
+static void benchmark(const char* name) {
+    BinaryDecodeInfo info;
+    uint32_t commands = 0;
+    size_t allocationsBefore = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_PAYLOADS; i++) {
+        if (!decoder.decodeBinary(payload, length, info)) {
+            TEST_FAIL_MESSAGE(info.error);
+        }
+        commands += info.commands;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    size_t allocated = allocations - allocationsBefore;
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    char message[128];
+    snprintf(message, sizeof(message), "%-24s %5u bytes, %6.2f M commands/s, %.2f allocations/command",
+             name, (unsigned)length, commands / seconds / 1e6, (double)allocated / commands);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, allocated);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_channel_run() {
+    begin(BINARY_PROTOCOL_VERSION);
+    byte(BIN_OP_CHANNELS);
+    varint(1);
+    varint(DECODER_MAX_CHANNEL);
+    bytes(DECODER_MAX_CHANNEL, 0x55);
+    benchmark("512-channel run");
+}
+
+void test_fixture_colors() {
+    begin(BINARY_PROTOCOL_VERSION);
+    byte(BIN_OP_FIXTURES_RGB);
+    varint(0);
+    varint(BENCH_MAX_FIXTURES);
+    bytes(BENCH_MAX_FIXTURES * 3, 0x55);
+    benchmark("32 RGB fixtures");
+}
+
+void test_small_commands() {
+    // The densest case: many short commands in one downlink
+    begin(BINARY_PROTOCOL_VERSION | BINARY_FLAG_SEQUENCE);
+    varint(1234);
+    for (int i = 0; i < 20; i++) {
+        byte(BIN_OP_FILL);
+        varint(i);
+        varint(4);
+        bytes(4, 0xFF);
+        byte(BIN_OP_PALETTE_GROUP);
+        byte(0xFF);
+        byte(i % BENCH_PALETTE_SIZE);
+    }
+    benchmark("40 short commands, seq");
+}
+
+void test_palette() {
+    begin(BINARY_PROTOCOL_VERSION);
+    byte(BIN_OP_PALETTE_SET);
+    varint(0);
+    varint(BENCH_PALETTE_SIZE);
+    bytes(BENCH_PALETTE_SIZE * 4, 0x20);
+    byte(BIN_OP_PALETTE_FIXTURES);
+    varint(0);
+    varint(BENCH_MAX_FIXTURES);
+    bytes(BENCH_MAX_FIXTURES, 3);
+    benchmark("palette and indices");
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_channel_run);
+    RUN_TEST(test_fixture_colors);
+    RUN_TEST(test_small_commands);
+    RUN_TEST(test_palette);
+    return UNITY_END();
+}
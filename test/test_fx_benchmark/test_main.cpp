@@ -0,0 +1,82 @@
+/**
+ * Host benchmark of the FxGenerators: cost per sample of each generator
+ *
+ * Effects sample a generator per fixture per frame, so the cost of one
+ * sample times the fixture count comes out of the 20 ms DMX frame. Each
+ * generator is timed over FX_BENCH_SAMPLES inputs that sweep its phase or
+ * coordinates; the results are printed, and a generator slower than
+ * FX_BENCH_MAX_NS per sample fails. Host figures are for comparing
+ * changes, not the ESP32's absolute cost.
+ *
+ * Run on the host with: pio test -e native
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include "FxGenerators.h"
+
+#define FX_BENCH_SAMPLES 2000000   // Samples timed per generator
+#define FX_BENCH_MAX_NS 1000       // Slowest acceptable sample on the host
+#define FX_BENCH_FIXTURES 512      // Fixtures per frame in the printed frame cost
+
+// Samples are summed into this so the compiler cannot drop them
+static volatile uint32_t checksum;
+
+/**
+ * Time a generator and return its average cost per sample in nanoseconds
+ */
+template <typename Generator>
+static double timeGenerator(const char* name, Generator generator) {
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < FX_BENCH_SAMPLES; i++) {
+        sum += generator(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    checksum += sum;
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / FX_BENCH_SAMPLES;
+    char message[96];
+    snprintf(message, sizeof(message), "%-16s %7.2f ns/sample, %7.2f us per %d-fixture frame",
+             name, ns, ns * FX_BENCH_FIXTURES / 1000.0, FX_BENCH_FIXTURES);
+    TEST_MESSAGE(message);
+    return ns;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_wave_generators() {
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("fxSine8", [](uint32_t i) { return fxSine8(i * 97); }));
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("fxTriangle8", [](uint32_t i) { return fxTriangle8(i * 97); }));
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("fxSaw8", [](uint32_t i) { return fxSaw8(i * 97); }));
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("fxSquare8", [](uint32_t i) { return fxSquare8(i * 97, i); }));
+}
+
+void test_hash_and_noise_generators() {
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("fxHash32", [](uint32_t i) { return fxHash32(i, 7); }));
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("fxValueNoise1D", [](uint32_t i) { return fxValueNoise1D(i * 13, 7); }));
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("fxValueNoise2D",
+        [](uint32_t i) { return fxValueNoise2D((i & 1023) * 13, (i >> 10) * 13, 7); }));
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("fxSimplex2D",
+        [](uint32_t i) { return fxSimplex2D((i & 1023) * 13, (i >> 10) * 13, 7); }));
+}
+
+void test_random_generators() {
+    FxRandom random(7);
+    FxRandomWalk walk(7);
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("FxRandom", [&](uint32_t) { return random.next(); }));
+    TEST_ASSERT_LESS_THAN(FX_BENCH_MAX_NS, timeGenerator("FxRandomWalk", [&](uint32_t) { return walk.step(); }));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_wave_generators);
+    RUN_TEST(test_hash_and_noise_generators);
+    RUN_TEST(test_random_generators);
+    return UNITY_END();
+}
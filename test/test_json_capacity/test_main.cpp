@@ -0,0 +1,91 @@
+/**
+ * Unit tests for JsonCapacity: the longest commands fit their documents
+ *
+ * Lines replayed from a fragmented payload are up to 1 KB, four times a
+ * downlink; each test builds the densest command of a length and parses it
+ * in place, as processJsonPayload does.
+ *
+ * Run on the host with: pio test -e native
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "JsonCapacity.h"
+
+#define TEST_DOWNLINK_SIZE 242     // MAX_DOWNLINK_SIZE
+#define TEST_LINE_SIZE 1024        // MAX_JSON_SIZE
+
+static char text[TEST_LINE_SIZE];
+
+/**
+ * Build {"<key>":[0,0,...]} filling the length with single-digit values
+ */
+static size_t buildArray(const char* key, size_t size) {
+    size_t length = snprintf(text, sizeof(text), "{\"%s\":[0", key);
+    while (length + 4 <= size) {
+        text[length++] = ',';
+        text[length++] = '0';
+    }
+    text[length++] = ']';
+    text[length++] = '}';
+    return length;
+}
+
+/**
+ * Build {"lights":[{"address":1,"channels":[0,...]},...]} filling the length
+ */
+static size_t buildLights(size_t size) {
+    static const char light[] = "{\"address\":1,\"channels\":[0,0,0,0]}";
+    size_t length = snprintf(text, sizeof(text), "{\"lights\":[%s", light);
+    while (length + 1 + strlen(light) + 2 <= size) {
+        length += snprintf(text + length, sizeof(text) - length, ",%s", light);
+    }
+    text[length++] = ']';
+    text[length++] = '}';
+    return length;
+}
+
+void test_downlink_fits() {
+    static StaticJsonDocument<JSON_CAPACITY_FOR(TEST_DOWNLINK_SIZE)> doc;
+    size_t length = buildArray("positions", TEST_DOWNLINK_SIZE);
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_DOWNLINK_SIZE, length);
+    TEST_ASSERT_EQUAL(DeserializationError::Ok, deserializeJson(doc, text, length).code());
+}
+
+void test_long_line_fits() {
+    static StaticJsonDocument<JSON_CAPACITY_FOR(TEST_LINE_SIZE)> doc;
+    size_t length = buildArray("positions", TEST_LINE_SIZE);
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_LINE_SIZE, length);
+    TEST_ASSERT_EQUAL(DeserializationError::Ok, deserializeJson(doc, text, length).code());
+    TEST_ASSERT_EQUAL((length - 15) / 2, doc["positions"].size());
+}
+
+void test_long_line_overflows_downlink_document() {
+    // The document a downlink gets is too small for a replayed line
+    static StaticJsonDocument<JSON_CAPACITY_FOR(TEST_DOWNLINK_SIZE)> doc;
+    size_t length = buildArray("positions", TEST_LINE_SIZE);
+    TEST_ASSERT_EQUAL(DeserializationError::NoMemory, deserializeJson(doc, text, length).code());
+}
+
+void test_long_lights_line_fits() {
+    static StaticJsonDocument<JSON_CAPACITY_FOR(TEST_LINE_SIZE)> doc;
+    size_t length = buildLights(TEST_LINE_SIZE);
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_LINE_SIZE, length);
+    TEST_ASSERT_EQUAL(DeserializationError::Ok, deserializeJson(doc, text, length).code());
+    TEST_ASSERT_EQUAL(4, doc["lights"][0]["channels"].size());
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_downlink_fits);
+    RUN_TEST(test_long_line_fits);
+    RUN_TEST(test_long_line_overflows_downlink_document);
+    RUN_TEST(test_long_lights_line_fits);
+    return UNITY_END();
+}
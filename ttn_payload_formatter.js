@@ -3,6 +3,11 @@
 
 // Uplink decoder function (device to application)
 function decodeUplink(input) {
+  // Binary status report: command results and device state
+  if (input.fPort === BINARY_PORT) {
+    return decodeStatusReport(input.bytes);
+  }
+  
   // Try to parse as JSON first
   try {
     // Convert bytes to string
@@ -28,6 +33,48 @@ function decodeUplink(input) {
   }
 }
 
+var REPORT_VERSION = 1;
+var REPORT_SIZE = 14;
+var REPORT_FLAGS = {dmxOk: 0x01, clockSynced: 0x02, ping: 0x04, transferActive: 0x08};
+var REPORT_HAS_SEQUENCE = 0x10;
+
+// Decode the status report sent with the heartbeat. "applied" and "failed"
+// list sequence numbers in the 32-command window below the highest one;
+// numbers in neither list were not received and should be re-sent.
+function decodeStatusReport(bytes) {
+  if (bytes.length < REPORT_SIZE || bytes[0] !== REPORT_VERSION) {
+    return {data: {raw: bytesToHex(bytes)}, warnings: [], errors: ["Unsupported status report"]};
+  }
+  
+  var flags = bytes[1];
+  var data = {};
+  for (var name in REPORT_FLAGS) {
+    data[name] = (flags & REPORT_FLAGS[name]) !== 0;
+  }
+  
+  if (flags & REPORT_HAS_SEQUENCE) {
+    var highest = bytes[2] | (bytes[3] << 8);
+    var received = (bytes[4] | (bytes[5] << 8) | (bytes[6] << 16) | (bytes[7] << 24)) >>> 0;
+    var applied = (bytes[8] | (bytes[9] << 8) | (bytes[10] << 16) | (bytes[11] << 24)) >>> 0;
+    data.seq = highest;
+    data.applied = [];
+    data.failed = [];
+    for (var i = 0; i < 32; i++) {
+      if (!((received >>> i) & 1)) continue;
+      var seq = (highest - i) & 0xFFFF;
+      if ((applied >>> i) & 1) {
+        data.applied.push(seq);
+      } else {
+        data.failed.push(seq);
+      }
+    }
+  }
+  
+  data.downlinksApplied = bytes[12];
+  data.downlinksFailed = bytes[13];
+  return {data: data, warnings: [], errors: []};
+}
+
 // Helper function to format uptime in a human-readable way
 function formatUptime(seconds) {
   seconds = parseInt(seconds, 10);
@@ -62,8 +109,332 @@ function sanitizeString(str) {
   return str.replace(/[\x00-\x1F\x7F-\x9F]/g, '');
 }
 
+// Binary downlink protocol (fPort 2), see lib/BinaryProtocol/BinaryProtocol.h
+var BINARY_PORT = 2;
+var BINARY_VERSION = 1;
+var BINARY_FLAG_SEQUENCE = 0x80;
+var BINARY_OPS = {
+  channels: 0x01,
+  fixtures: 0x02,
+  fixturesRgb: 0x03,
+  fill: 0x04,
+  pattern: 0x05,
+  delta: 0x06,
+  paletteSet: 0x07,
+  palette: 0x08,
+  paletteGroup: 0x09,
+  palettePacked: 0x0A,
+  quantized: 0x0B
+};
+var QUANT_FORMATS = ['rgb565', 'rgb444', 'hsv'];
+var DELTA_SKIP = 0, DELTA_WRITE = 1, DELTA_REPEAT = 2, DELTA_END = 3;
+var BINARY_PATTERNS = ['stop', 'colorFade', 'rainbow', 'strobe', 'chase', 'alternate',
+                       'noise', 'wave', 'radial', 'sweep'];
+
+// Append an unsigned LEB128 varint
+function pushVarint(bytes, value) {
+  value = Math.max(0, Math.floor(value));
+  while (value >= 0x80) {
+    bytes.push((value & 0x7F) | 0x80);
+    value = Math.floor(value / 128);
+  }
+  bytes.push(value);
+}
+
+// Append a list of 0-255 values
+function pushValues(bytes, values, count) {
+  for (var i = 0; i < count; i++) {
+    var v = values[i] || 0;
+    bytes.push(Math.max(0, Math.min(255, v)));
+  }
+}
+
+// Append a frame delta that turns `base` into `frame` (arrays indexed from channel 1)
+// Unchanged channels are skipped, runs of 3+ equal values repeated, the rest written
+function pushFrameDelta(bytes, base, frame) {
+  var length = Math.min(frame.length, 512);
+  var pos = 0;
+  
+  function token(run, count) {
+    pushVarint(bytes, ((count - 1) * 4) + run);
+  }
+  
+  // Drop unchanged channels at the end, the END run covers them
+  while (length > 0 && (frame[length - 1] || 0) === (base[length - 1] || 0)) {
+    length--;
+  }
+  
+  while (pos < length) {
+    var start = pos;
+    if ((frame[pos] || 0) === (base[pos] || 0)) {
+      while (pos < length && (frame[pos] || 0) === (base[pos] || 0)) pos++;
+      token(DELTA_SKIP, pos - start);
+      continue;
+    }
+    
+    var value = frame[pos] || 0;
+    while (pos < length && (frame[pos] || 0) === value) pos++;
+    if (pos - start >= 3) {
+      token(DELTA_REPEAT, pos - start);
+      bytes.push(value);
+      continue;
+    }
+    
+    // Literal run until the next skip or repeat worth switching to
+    pos = start;
+    while (pos < length && (frame[pos] || 0) !== (base[pos] || 0)) {
+      var v = frame[pos] || 0;
+      if (pos + 2 < length && frame[pos + 1] === v && frame[pos + 2] === v && pos > start) break;
+      pos++;
+    }
+    token(DELTA_WRITE, pos - start);
+    pushValues(bytes, frame.slice(start, pos), pos - start);
+  }
+  
+  token(DELTA_END, 1);
+}
+
+// Append palette indices packed LSB first with the given bits per index
+function pushPacked(bytes, values, bits) {
+  var acc = 0, accBits = 0;
+  for (var i = 0; i < values.length; i++) {
+    acc |= (values[i] & ((1 << bits) - 1)) << accBits;
+    accBits += bits;
+    while (accBits >= 8) {
+      bytes.push(acc & 0xFF);
+      acc >>= 8;
+      accBits -= 8;
+    }
+  }
+  if (accBits > 0) bytes.push(acc & 0xFF);
+}
+
+// Append RGB colors in a reduced-precision format
+function pushQuantized(bytes, format, colors) {
+  var i;
+  if (format === 'rgb565') {
+    for (i = 0; i < colors.length; i++) {
+      var v = ((colors[i][0] >> 3) << 11) | ((colors[i][1] >> 2) << 5) | (colors[i][2] >> 3);
+      bytes.push(v & 0xFF, v >> 8);
+    }
+  } else if (format === 'rgb444') {
+    var nibbles = [];
+    for (i = 0; i < colors.length; i++) {
+      nibbles.push(colors[i][0] >> 4, colors[i][1] >> 4, colors[i][2] >> 4);
+    }
+    pushPacked(bytes, nibbles, 4);
+  } else {
+    // 6-bit hue and 2-bit intensity; saturation is always full
+    for (i = 0; i < colors.length; i++) {
+      var r = colors[i][0], g = colors[i][1], b = colors[i][2];
+      var max = Math.max(r, g, b), min = Math.min(r, g, b), hue = 0;
+      if (max !== min) {
+        if (max === r) hue = ((g - b) / (max - min) + 6) % 6;
+        else if (max === g) hue = (b - r) / (max - min) + 2;
+        else hue = (r - g) / (max - min) + 4;
+      }
+      bytes.push((Math.round(hue * 64 / 6) & 0x3F) | (Math.round(max / 85) << 6));
+    }
+  }
+}
+
+// Encode a list of binary commands; fixture numbers are 1-based like the JSON commands.
+// An optional sequence number (0-65535) lets the device drop retransmissions
+function encodeBinaryCommands(commands, seq) {
+  var bytes = [BINARY_VERSION];
+  if (seq !== undefined && seq !== null) {
+    bytes[0] |= BINARY_FLAG_SEQUENCE;
+    pushVarint(bytes, seq & 0xFFFF);
+  }
+  
+  for (var i = 0; i < commands.length; i++) {
+    var cmd = commands[i];
+    var op = BINARY_OPS[cmd.op];
+    if (op === undefined) {
+      throw new Error("Unknown binary op: " + cmd.op);
+    }
+    
+    // Palette indices for three or more fixtures are sent packed
+    if (cmd.op === 'palette' && cmd.indices.length > 2) {
+      var maxIndex = Math.max.apply(null, cmd.indices);
+      if (maxIndex > 63) {
+        throw new Error("Palette index out of range: " + maxIndex);
+      }
+      bytes.push(BINARY_OPS.palettePacked);
+      bytes.push(maxIndex < 16 ? 4 : 6);
+      pushVarint(bytes, (cmd.first || 1) - 1);
+      pushVarint(bytes, cmd.indices.length);
+      pushPacked(bytes, cmd.indices, maxIndex < 16 ? 4 : 6);
+      continue;
+    }
+    bytes.push(op);
+    
+    switch (cmd.op) {
+      case 'channels':
+        pushVarint(bytes, cmd.address);
+        pushVarint(bytes, cmd.values.length);
+        pushValues(bytes, cmd.values, cmd.values.length);
+        break;
+      case 'fixtures':
+      case 'fixturesRgb':
+        var stride = cmd.op === 'fixtures' ? 4 : 3;
+        pushVarint(bytes, (cmd.first || 1) - 1);
+        pushVarint(bytes, cmd.colors.length);
+        for (var c = 0; c < cmd.colors.length; c++) {
+          pushValues(bytes, cmd.colors[c], stride);
+        }
+        break;
+      case 'fill':
+        pushVarint(bytes, (cmd.first || 1) - 1);
+        pushVarint(bytes, cmd.count || 1);
+        pushValues(bytes, cmd.color, 4);
+        break;
+      case 'pattern':
+        var type = BINARY_PATTERNS.indexOf(cmd.type);
+        if (type < 0) {
+          throw new Error("Unknown pattern type: " + cmd.type);
+        }
+        bytes.push(type);
+        pushVarint(bytes, cmd.speed || 50);
+        pushVarint(bytes, cmd.cycles === undefined ? 5 : cmd.cycles);
+        break;
+      case 'delta':
+        // base: the frame the node currently shows (all zero if omitted)
+        pushFrameDelta(bytes, cmd.base || [], cmd.frame);
+        break;
+      case 'paletteSet':
+        // first: 0-based palette entry
+        pushVarint(bytes, cmd.first || 0);
+        pushVarint(bytes, cmd.colors.length);
+        for (var p = 0; p < cmd.colors.length; p++) {
+          pushValues(bytes, cmd.colors[p], 4);
+        }
+        break;
+      case 'palette':
+        pushVarint(bytes, (cmd.first || 1) - 1);
+        pushVarint(bytes, cmd.indices.length);
+        pushValues(bytes, cmd.indices, cmd.indices.length);
+        break;
+      case 'quantized':
+        // format: rgb565, rgb444 or hsv; colors: [r, g, b] per fixture
+        var format = QUANT_FORMATS.indexOf(cmd.format || 'rgb565');
+        if (format < 0) {
+          throw new Error("Unknown color format: " + cmd.format);
+        }
+        bytes.push(format | (cmd.dither ? 0x80 : 0));
+        pushVarint(bytes, (cmd.first || 1) - 1);
+        pushVarint(bytes, cmd.colors.length);
+        pushQuantized(bytes, cmd.format || 'rgb565', cmd.colors);
+        break;
+      case 'paletteGroup':
+        // group: group ID, or omitted for all fixtures
+        bytes.push(cmd.group === undefined ? 0xFF : cmd.group);
+        bytes.push(cmd.index);
+        break;
+    }
+  }
+  
+  return bytes;
+}
+
+// Fragmented transfers (fPort 3), see lib/FragmentTransfer/FragmentTransfer.h
+var FRAGMENT_PORT = 3;
+var FRAG_OPS = {setup: 0x01, data: 0x02, status: 0x03, abort: 0x04};
+var FRAG_CONTENT = {binary: 0, json: 1};
+
+// CRC32 (IEEE, as zlib) of a byte array
+function crc32(bytes) {
+  var crc = 0xFFFFFFFF;
+  for (var i = 0; i < bytes.length; i++) {
+    crc ^= bytes[i];
+    for (var k = 0; k < 8; k++) {
+      crc = (crc >>> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+// Split a payload into the downlinks of a fragmented transfer. Not usable as
+// a TTN formatter (one call can only return one downlink): run it on the
+// server and queue the returned payloads on FRAGMENT_PORT in order.
+// options: session (0-255), type ('binary' with the version byte, or 'json'
+// lines), fragmentSize (default 48), parity (0-8, default 4)
+function fragmentPayload(bytes, options) {
+  options = options || {};
+  var session = (options.session || 0) & 0xFF;
+  var size = options.fragmentSize || 48;
+  var parity = options.parity === undefined ? 4 : options.parity;
+  var count = Math.ceil(bytes.length / size);
+  var crc = crc32(bytes);
+  
+  var setup = [FRAG_OPS.setup, session, FRAG_CONTENT[options.type || 'binary']];
+  pushVarint(setup, bytes.length);
+  setup.push(size, parity, crc & 0xFF, (crc >>> 8) & 0xFF, (crc >>> 16) & 0xFF, crc >>> 24);
+  var messages = [setup];
+  
+  // Data fragments (the last one zero-padded), then parity p = XOR of fragments p, p + parity, ...
+  var fragments = [];
+  for (var i = 0; i < count; i++) {
+    var fragment = [];
+    for (var j = 0; j < size; j++) fragment.push(bytes[i * size + j] || 0);
+    fragments.push(fragment);
+  }
+  for (var p = 0; p < parity; p++) {
+    var xor = [];
+    for (j = 0; j < size; j++) xor.push(0);
+    for (i = p; i < count; i += parity) {
+      for (j = 0; j < size; j++) xor[j] ^= fragments[i][j];
+    }
+    fragments.push(xor);
+  }
+  
+  for (i = 0; i < fragments.length; i++) {
+    var message = [FRAG_OPS.data, session];
+    pushVarint(message, i);
+    messages.push(message.concat(fragments[i]));
+  }
+  return messages;
+}
+
+// Convert a JSON lights array to binary channel runs
+function lightsToBinaryCommands(lights) {
+  var commands = [];
+  for (var i = 0; i < lights.length; i++) {
+    commands.push({op: 'channels', address: lights[i].address, values: lights[i].channels});
+  }
+  return commands;
+}
+
 // Downlink encoder function (application to device)
 function encodeDownlink(input) {
+  // CASE 0: Binary commands on their own port
+  // {"binary": [{"op": "fill", "first": 1, "count": 8, "color": [255, 0, 0, 0]}]}
+  // {"binary": true, "lights": [...]} sends a lights command as channel runs
+  // Add "seq" to either form to have retransmissions dropped
+  if (input.data.binary) {
+    try {
+      var commands = input.data.binary === true ? lightsToBinaryCommands(input.data.lights || []) : input.data.binary;
+      return {
+        bytes: encodeBinaryCommands(commands, input.data.seq),
+        fPort: BINARY_PORT
+      };
+    } catch (error) {
+      return {
+        errors: [error.message]
+      };
+    }
+  }
+  
+  // CASE 0b: Fragmented transfer control, {"frag": {"status": 1}} or {"frag": {"abort": 1}}
+  // (the fragments themselves come from fragmentPayload)
+  if (input.data.frag) {
+    var op = input.data.frag.abort !== undefined ? 'abort' : 'status';
+    return {
+      bytes: [FRAG_OPS[op], input.data.frag[op] & 0xFF],
+      fPort: FRAGMENT_PORT
+    };
+  }
+  
   // CASE 1: Special command strings
   if (input.data.command === "go") {
     return {
@@ -143,6 +514,17 @@ function encodeDownlink(input) {
           patternObj.pattern.speed = 300;
           patternObj.pattern.cycles = 5;
           break;
+        case 'wave':
+        case 'radial':
+        case 'sweep':
+          patternObj.pattern.speed = 40;
+          patternObj.pattern.cycles = 5;
+          break;
+        case 'noise':
+          patternObj.pattern.speed = 40;
+          patternObj.pattern.cycles = 0;
+          patternObj.pattern.seed = 1;
+          break;
         case 'stop':
           // Just stop the current pattern
           patternObj.pattern.type = 'stop';
@@ -212,8 +594,153 @@ function encodeDownlink(input) {
   };
 }
 
+// Decode a binary downlink into its sequence number (if any) and list of commands
+function decodeBinaryCommands(bytes) {
+  var pos = 1;
+  var commands = [];
+  var seq;
+  
+  function byte() {
+    if (pos >= bytes.length) throw new Error("Truncated command");
+    return bytes[pos++];
+  }
+  function varint() {
+    var value = 0, scale = 1, b;
+    do {
+      b = byte();
+      value += (b & 0x7F) * scale;
+      scale *= 128;
+    } while (b & 0x80);
+    return value;
+  }
+  function values(count) {
+    var out = [];
+    for (var i = 0; i < count; i++) out.push(byte());
+    return out;
+  }
+  
+  if ((bytes[0] & ~BINARY_FLAG_SEQUENCE) !== BINARY_VERSION) {
+    throw new Error("Unsupported binary version " + bytes[0]);
+  }
+  if (bytes[0] & BINARY_FLAG_SEQUENCE) {
+    seq = varint();
+  }
+  
+  while (pos < bytes.length) {
+    var op = byte();
+    var first, count, i;
+    if (op === BINARY_OPS.channels) {
+      first = varint();
+      count = varint();
+      commands.push({op: 'channels', address: first, values: values(count)});
+    } else if (op === BINARY_OPS.fixtures || op === BINARY_OPS.fixturesRgb) {
+      var stride = op === BINARY_OPS.fixtures ? 4 : 3;
+      first = varint() + 1;
+      count = varint();
+      var colors = [];
+      for (i = 0; i < count; i++) colors.push(values(stride));
+      commands.push({op: stride === 4 ? 'fixtures' : 'fixturesRgb', first: first, colors: colors});
+    } else if (op === BINARY_OPS.fill) {
+      first = varint() + 1;
+      count = varint();
+      commands.push({op: 'fill', first: first, count: count, color: values(4)});
+    } else if (op === BINARY_OPS.pattern) {
+      var type = BINARY_PATTERNS[byte()];
+      commands.push({op: 'pattern', type: type, speed: varint(), cycles: varint()});
+    } else if (op === BINARY_OPS.delta) {
+      var runs = [];
+      var t;
+      while (((t = varint()) & 3) !== DELTA_END) {
+        var n = Math.floor(t / 4) + 1;
+        if ((t & 3) === DELTA_SKIP) runs.push({skip: n});
+        else if ((t & 3) === DELTA_WRITE) runs.push({write: values(n)});
+        else runs.push({repeat: byte(), count: n});
+      }
+      commands.push({op: 'delta', runs: runs});
+    } else if (op === BINARY_OPS.paletteSet) {
+      first = varint();
+      count = varint();
+      var entries = [];
+      for (i = 0; i < count; i++) entries.push(values(4));
+      commands.push({op: 'paletteSet', first: first, colors: entries});
+    } else if (op === BINARY_OPS.palette || op === BINARY_OPS.palettePacked) {
+      var bits = op === BINARY_OPS.palettePacked ? byte() : 8;
+      first = varint() + 1;
+      count = varint();
+      var packed = values(Math.ceil(count * bits / 8));
+      var indices = [];
+      for (i = 0; i < count; i++) {
+        var bit = i * bits;
+        var word = packed[bit >> 3] | ((packed[(bit >> 3) + 1] || 0) << 8);
+        indices.push((word >> (bit & 7)) & ((1 << bits) - 1));
+      }
+      commands.push({op: 'palette', first: first, indices: indices});
+    } else if (op === BINARY_OPS.quantized) {
+      var formatByte = byte();
+      var formatName = QUANT_FORMATS[formatByte & 0x7F];
+      first = varint() + 1;
+      count = varint();
+      var size = formatName === 'rgb565' ? count * 2 : (formatName === 'rgb444' ? Math.ceil(count * 3 / 2) : count);
+      commands.push({op: 'quantized', format: formatName, dither: (formatByte & 0x80) !== 0,
+                     first: first, count: count, raw: bytesToHex(values(size))});
+    } else if (op === BINARY_OPS.paletteGroup) {
+      commands.push({op: 'paletteGroup', group: byte(), index: byte()});
+    } else {
+      throw new Error("Unknown opcode 0x" + op.toString(16));
+    }
+  }
+  
+  return {seq: seq, commands: commands};
+}
+
 // Downlink decoder function (for debugging in console)
 function decodeDownlink(input) {
+  if (input.fPort === FRAGMENT_PORT) {
+    var b = input.bytes;
+    var names = ['', 'setup', 'data', 'status', 'abort'];
+    var frag = {op: names[b[0]] || b[0], session: b[1]};
+    if (b[0] === FRAG_OPS.setup || b[0] === FRAG_OPS.data) {
+      var pos = 2, value = 0, scale = 1, v;
+      if (b[0] === FRAG_OPS.setup) frag.type = b[pos++] === FRAG_CONTENT.json ? 'json' : 'binary';
+      do {
+        v = b[pos++];
+        value += (v & 0x7F) * scale;
+        scale *= 128;
+      } while (v & 0x80);
+      if (b[0] === FRAG_OPS.setup) {
+        frag.size = value;
+        frag.fragmentSize = b[pos];
+        frag.parity = b[pos + 1];
+        frag.crc = bytesToHex(b.slice(pos + 2, pos + 6));
+      } else {
+        frag.index = value;
+        frag.length = b.length - pos;
+      }
+    }
+    return {
+      data: {frag: frag},
+      warnings: [],
+      errors: []
+    };
+  }
+  
+  if (input.fPort === BINARY_PORT) {
+    try {
+      var decoded = decodeBinaryCommands(input.bytes);
+      return {
+        data: {seq: decoded.seq, binary: decoded.commands},
+        warnings: [],
+        errors: []
+      };
+    } catch (error) {
+      return {
+        data: {raw: bytesToHex(input.bytes)},
+        warnings: [],
+        errors: [error.message]
+      };
+    }
+  }
+  
   try {
     // Convert byte array to string
     var jsonString = String.fromCharCode.apply(null, input.bytes);